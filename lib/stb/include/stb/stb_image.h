@@ -523,6 +523,52 @@ STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpre
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// jpeg decoding splits large images into independent tasks (restart intervals,
+// rows of idct blocks, bands of colour conversion) and hands them to this function.
+// it must call task(task_data, i) for every i in [0,count), on any threads, and
+// return once all of them have. NULL, the default, runs them on the calling thread
+typedef void stbi_parallel_task(void *task_data, int index);
+typedef void stbi_parallel_for(int count, stbi_parallel_task *task, void *task_data, void *user);
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for *run, void *user);
+
+// routes every allocation the decoders make, the returned pixels included, through
+// user functions. resize gets NULL to allocate, release may get NULL. all three are
+// called from whichever threads decode or free images. switch allocators only while
+// no image is alive, stbi_image_free hands its pointer to the current one. NULL
+// restores malloc, realloc and free. ignored if STBI_MALLOC was defined
+typedef struct
+{
+   void *(*alloc)(void *user, size_t size);
+   void *(*resize)(void *user, void *p, size_t old_size, size_t new_size);
+   void  (*release)(void *user, void *p);
+   void *user;
+} stbi_allocator;
+
+STBIDEF void stbi_set_allocator(stbi_allocator const *allocator);
+
+// jpeg only: the widest simd kernels (idct, colour conversion) the decoder picks at
+// runtime, after capping what the cpu supports at the limit. lowering the limit is
+// mostly useful for benchmarking, it applies to images decoded after the call
+enum
+{
+   STBI_SIMD_NONE = 0,
+   STBI_SIMD_128 = 1, // sse2 or neon
+   STBI_SIMD_AVX2 = 2,
+   STBI_SIMD_AVX512 = 3
+};
+
+STBIDEF int stbi_simd_level(void);
+STBIDEF void stbi_set_simd_limit(int level);
+
+// jpeg only: decodes at 1/2, 1/4 or 1/8 of the size (scale_shift 1, 2 or 3) by
+// running a smaller idct over each block's lowest frequencies. the entropy decode
+// still reads every coefficient, the savings are in the idct, colour conversion and
+// memory. *x and *y receive the reduced size, rounded up
+STBIDEF stbi_uc *stbi_load_jpeg_scaled_from_memory(stbi_uc const *buffer, int len, int scale_shift, int *x, int *y, int *channels_in_file, int desired_channels);
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_jpeg_scaled(char const *filename, int scale_shift, int *x, int *y, int *channels_in_file, int desired_channels);
+#endif
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -137,9 +137,38 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32)==4 ? 1 : -1];
 #endif
 
 #ifndef STBI_MALLOC
-#define STBI_MALLOC(sz)           malloc(sz)
-#define STBI_REALLOC(p,newsz)     realloc(p,newsz)
-#define STBI_FREE(p)              free(p)
+#define STBI_MALLOC(sz)           stbi__alloc(sz)
+#define STBI_REALLOC_SIZED(p,oldsz,newsz) stbi__resize(p,oldsz,newsz)
+#define STBI_FREE(p)              stbi__release(p)
+
+// malloc, realloc and free unless stbi_set_allocator says otherwise
+static stbi_allocator stbi__allocator;
+
+STBIDEF void stbi_set_allocator(stbi_allocator const *allocator)
+{
+   if (allocator)
+      stbi__allocator = *allocator;
+   else
+      memset(&stbi__allocator, 0, sizeof(stbi__allocator));
+}
+
+static void *stbi__alloc(size_t size)
+{
+   if (stbi__allocator.alloc) return stbi__allocator.alloc(stbi__allocator.user, size);
+   return malloc(size);
+}
+
+static void *stbi__resize(void *p, size_t old_size, size_t new_size)
+{
+   if (stbi__allocator.resize) return stbi__allocator.resize(stbi__allocator.user, p, old_size, new_size);
+   return realloc(p, new_size);
+}
+
+static void stbi__release(void *p)
+{
+   if (stbi__allocator.release) stbi__allocator.release(stbi__allocator.user, p);
+   else free(p);
+}
 #endif
 
 #ifndef STBI_REALLOC_SIZED
@@ -232,6 +261,68 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// avx2 and avx-512 kernels are compiled for their own target and only picked at
+// runtime, so the rest of the library keeps running on plain sse2 machines.
+// #define STBI_NO_AVX2 to leave them out
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2) && !defined(STBI_NO_JPEG)
+#if defined(_MSC_VER) && _MSC_VER >= 1900
+#define STBI_AVX2
+#define STBI__TARGET_AVX2
+#if _MSC_VER >= 1920
+#define STBI_AVX512
+#define STBI__TARGET_AVX512
+#endif
+#elif defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)
+#define STBI_AVX2
+#define STBI__TARGET_AVX2 __attribute__((target("avx2")))
+#define STBI_AVX512
+#define STBI__TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw")))
+#endif
+#endif
+
+#ifdef STBI_AVX2
+#include <immintrin.h>
+
+// STBI_SIMD_AVX2 or STBI_SIMD_AVX512 when the cpu and os support them, 0 otherwise
+#ifdef _MSC_VER
+static int stbi__avx_level(void)
+{
+   int info[4];
+   unsigned long long xcr0;
+   int level;
+
+   __cpuid(info, 0);
+   if (info[0] < 7) return 0;
+
+   // osxsave and avx; without the first the os may not save ymm registers
+   __cpuid(info, 1);
+   if (((info[2] >> 27) & 3) != 3) return 0;
+   xcr0 = _xgetbv(0);
+   if ((xcr0 & 6) != 6) return 0;
+
+   __cpuidex(info, 7, 0);
+   if (!((info[1] >> 5) & 1)) return 0;
+   level = STBI_SIMD_AVX2;
+
+#ifdef STBI_AVX512
+   // foundation and byte/word instructions, with the zmm and mask state saved
+   if (((info[1] >> 16) & 1) && ((info[1] >> 30) & 1) && (xcr0 & 0xe6) == 0xe6)
+      level = STBI_SIMD_AVX512;
+#endif
+
+   return level;
+}
+#else
+static int stbi__avx_level(void)
+{
+   __builtin_cpu_init();
+   if (!__builtin_cpu_supports("avx2")) return 0;
+   if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return STBI_SIMD_AVX512;
+   return STBI_SIMD_AVX2;
+}
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -592,6 +683,26 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static stbi_parallel_for *stbi__parallel_run = NULL;
+static void *stbi__parallel_user = NULL;
+
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for *run, void *user)
+{
+   stbi__parallel_run = run;
+   stbi__parallel_user = user;
+}
+
+static void stbi__parallel(int count, stbi_parallel_task *task, void *task_data)
+{
+   int i;
+   if (stbi__parallel_run && count > 1) {
+      stbi__parallel_run(count, task, task_data, stbi__parallel_user);
+      return;
+   }
+   for (i=0; i < count; ++i)
+      task(task_data, i);
+}
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1451,6 +1562,7 @@ typedef struct
 
    int scan_n, order[4];
    int restart_interval, todo;
+   int scale_shift; // blocks come out 8 >> scale_shift pixels wide, see stbi_load_jpeg_scaled
 
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
@@ -1981,6 +2093,73 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
    }
 }
 
+// reduced size idcts for scaled decoding. an n point idct over the n lowest
+// frequencies of a block samples the same continuous signal as the 8 point one,
+// at the centres of n pixels instead of 8; the frequencies above n are dropped.
+// basis[x*n+u] = C(u) cos((2x+1) u pi / 2n) / 2, C(0) = 1/sqrt(2), else 1
+static const float stbi__idct_basis_4[16] = {
+   0.35355339f, 0.46193977f, 0.35355339f, 0.19134172f,
+   0.35355339f, 0.19134172f,-0.35355339f,-0.46193977f,
+   0.35355339f,-0.19134172f,-0.35355339f, 0.46193977f,
+   0.35355339f,-0.46193977f, 0.35355339f,-0.19134172f,
+};
+
+static const float stbi__idct_basis_2[4] = {
+   0.35355339f, 0.35355339f,
+   0.35355339f,-0.35355339f,
+};
+
+static void stbi__idct_reduced(stbi_uc *out, int out_stride, short data[64], int n, const float *basis)
+{
+   float tmp[16];
+   int x,y,u,v,ac = 0;
+   for (v=0; v < n; ++v)
+      for (u=0; u < n; ++u)
+         ac |= (u|v) ? data[v*8+u] : 0;
+   // flat blocks are common, and just their mean
+   if (!ac) {
+      stbi_uc dc = stbi__clamp(((data[0] + 4) >> 3) + 128);
+      for (y=0; y < n; ++y, out += out_stride)
+         for (x=0; x < n; ++x)
+            out[x] = dc;
+      return;
+   }
+   // rows of frequencies, then columns
+   for (v=0; v < n; ++v) {
+      for (x=0; x < n; ++x) {
+         float sum = 0;
+         for (u=0; u < n; ++u)
+            sum += basis[x*n+u] * data[v*8+u];
+         tmp[v*n+x] = sum;
+      }
+   }
+   for (y=0; y < n; ++y, out += out_stride) {
+      for (x=0; x < n; ++x) {
+         float sum = 128.5f;
+         for (v=0; v < n; ++v)
+            sum += basis[y*n+v] * tmp[v*n+x];
+         out[x] = stbi__clamp((int) sum); // truncation only differs from floor below 0
+      }
+   }
+}
+
+static void stbi__idct_block_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+   stbi__idct_reduced(out, out_stride, data, 4, stbi__idct_basis_4);
+}
+
+static void stbi__idct_block_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+   stbi__idct_reduced(out, out_stride, data, 2, stbi__idct_basis_2);
+}
+
+static void stbi__idct_block_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+   STBI_NOTUSED(out_stride);
+   // the dc coefficient is 8 times the block's mean
+   out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2162,6 +2341,180 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// the sse2 idct with its 32-bit intermediates held in one avx2 register per row
+// instead of two. same arithmetic, so it is bit-identical to the generic version too
+static STBI__TARGET_AVX2 void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
+
+   // dot product constant: even elems=x, odd elems=y
+   #define dct_const(x,y)  _mm256_set1_epi32((int) (((unsigned int) (y) << 16) | (unsigned short) (x)))
+
+   // out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+   // out(1) = c1[even]*x + c1[odd]*y
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##xy = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16((x),(y))), _mm_unpackhi_epi16((x),(y)), 1); \
+      __m256i out0 = _mm256_madd_epi16(c0##xy, c0); \
+      __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
+
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
+
+   // wide add
+   #define dct_wadd(out, a, b) \
+      __m256i out = _mm256_add_epi32(a, b)
+
+   // wide sub
+   #define dct_wsub(out, a, b) \
+      __m256i out = _mm256_sub_epi32(a, b)
+
+   // butterfly a/b, add bias, then shift by "s" and pack. packs works within
+   // 128-bit lanes, the permute puts sum and dif back in order
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased = _mm256_add_epi32(a, bias); \
+         __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(abiased, b), s); \
+         __m256i dif = _mm256_srai_epi32(_mm256_sub_epi32(abiased, b), s); \
+         __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(sum, dif), 0xd8); \
+         out0 = _mm256_castsi256_si128(packed); \
+         out1 = _mm256_extracti128_si256(packed, 1); \
+      }
+
+   // 8-bit interleave step (for transposes)
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+   // 16-bit interleave step (for transposes)
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m128i sum04 = _mm_add_epi16(row0, row4); \
+         __m128i dif04 = _mm_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+   row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+   row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+   row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+   row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+   row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+   row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+   row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose pass 1
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      // transpose pass 2
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      // transpose pass 3
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack
+      __m128i p0 = _mm_packus_epi16(row0, row1); // a0a1a2a3...a7b0b1b2b3...b7
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose pass 1
+      dct_interleave8(p0, p2); // a0e0a1e1...
+      dct_interleave8(p1, p3); // c0g0c1g1...
+
+      // transpose pass 2
+      dct_interleave8(p0, p1); // a0c0e0g0...
+      dct_interleave8(p2, p3); // b0d0f0h0...
+
+      // transpose pass 3
+      dct_interleave8(p0, p2); // a0b0c0d0...
+      dct_interleave8(p1, p3); // a4b4c4d4...
+
+      // store
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -2404,13 +2757,166 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+// images at least this large are split into tasks for stbi_set_parallel_for
+#ifndef STBI_PARALLEL_MIN_PIXELS
+#define STBI_PARALLEL_MIN_PIXELS (256*256)
+#endif
+
+static int stbi__jpeg_parallel(stbi__jpeg *z)
+{
+   return stbi__parallel_run != NULL && (size_t) z->s->img_x * z->s->img_y >= STBI_PARALLEL_MIN_PIXELS;
+}
+
+// blocks land in the component planes at their scaled size
+static void stbi__jpeg_idct_at(stbi__jpeg *z, int n, int bx, int by, short data[64])
+{
+   int size = 8 >> z->scale_shift;
+   int stride = z->img_comp[n].w2 >> z->scale_shift;
+   z->idct_block_kernel(z->img_comp[n].data+stride*by*size+bx*size, stride, data);
+}
+
+// a baseline block goes straight through the idct, unless the component has
+// coefficient storage, in which case the idct is deferred to stbi__jpeg_finish
+static int stbi__jpeg_decode_baseline_block(stbi__jpeg *z, int n, int bx, int by)
+{
+   STBI_SIMD_ALIGN(short, block[64]);
+   int ha = z->img_comp[n].ha;
+   short *data = z->img_comp[n].coeff ? z->img_comp[n].coeff + 64 * (bx + by * z->img_comp[n].coeff_w) : block;
+   if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+   if (!z->img_comp[n].coeff)
+      stbi__jpeg_idct_at(z, n, bx, by, data);
+   return 1;
+}
+
+// mcu number m of the current baseline scan, in raster order
+static int stbi__jpeg_decode_baseline_mcu(stbi__jpeg *z, int m)
+{
+   int k,x,y;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      int w = (z->img_comp[n].x+7) >> 3;
+      return stbi__jpeg_decode_baseline_block(z, n, m % w, m / w);
+   }
+   for (k=0; k < z->scan_n; ++k) {
+      int n = z->order[k];
+      for (y=0; y < z->img_comp[n].v; ++y)
+         for (x=0; x < z->img_comp[n].h; ++x)
+            if (!stbi__jpeg_decode_baseline_block(z, n, (m % z->img_mcu_x)*z->img_comp[n].h + x, (m / z->img_mcu_x)*z->img_comp[n].v + y)) return 0;
+   }
+   return 1;
+}
+
+static int stbi__jpeg_baseline_mcu_count(stbi__jpeg *z)
+{
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      return ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   }
+   return z->img_mcu_x * z->img_mcu_y;
+}
+
+// restart markers reset the dc predictions and byte align the bitstream, so the
+// intervals between them decode independently. each task takes a run of them
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc **starts; // interval_count + 1, the last one is where the scan ends
+   int interval_count;
+   int intervals_per_task;
+   int mcu_count;
+   stbi_uc *ok; // per task
+} stbi__jpeg_restart_job;
+
+static void stbi__jpeg_decode_intervals(void *data, int task)
+{
+   stbi__jpeg_restart_job *job = (stbi__jpeg_restart_job *) data;
+   stbi__context s = *job->z->s;
+   stbi__jpeg *z = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   int first = task * job->intervals_per_task;
+   int last = first + job->intervals_per_task < job->interval_count ? first + job->intervals_per_task : job->interval_count;
+   int k,m;
+
+   job->ok[task] = 0;
+   if (!z) return;
+   memcpy(z, job->z, sizeof(stbi__jpeg));
+   z->s = &s;
+
+   for (k=first; k < last; ++k) {
+      int end = (k+1) * z->restart_interval < job->mcu_count ? (k+1) * z->restart_interval : job->mcu_count;
+      s.img_buffer = job->starts[k];
+      s.img_buffer_end = job->starts[k+1];
+      stbi__jpeg_reset(z);
+      for (m=k * z->restart_interval; m < end; ++m)
+         if (!stbi__jpeg_decode_baseline_mcu(z, m)) { STBI_FREE(z); return; }
+   }
+
+   job->ok[task] = 1;
+   STBI_FREE(z);
+}
+
+// returns -1 when the scan can't be split (not in memory, or the restart markers
+// don't add up) and the caller should decode it in order
+static int stbi__jpeg_decode_restart_parallel(stbi__jpeg *z)
+{
+   stbi__jpeg_restart_job job;
+   stbi_uc *p = z->s->img_buffer, *end = z->s->img_buffer_end;
+   int count, tasks, k, result = 1;
+
+   if (z->s->read_from_callbacks || !z->restart_interval || !stbi__jpeg_parallel(z)) return -1;
+
+   job.z = z;
+   job.mcu_count = stbi__jpeg_baseline_mcu_count(z);
+   job.interval_count = (job.mcu_count + z->restart_interval - 1) / z->restart_interval;
+   if (job.interval_count < 2) return -1;
+
+   job.starts = (stbi_uc **) stbi__malloc_mad2(job.interval_count + 1, sizeof(stbi_uc *), 0);
+   if (!job.starts) return -1;
+
+   // find where every interval starts; stuffed zeros and fill bytes aren't markers
+   count = 0;
+   job.starts[count++] = p;
+   while (p+1 < end) {
+      if (p[0] != 0xff || p[1] == 0xff) { ++p; continue; }
+      if (p[1] == 0x00) { p += 2; continue; }
+      if (!STBI__RESTART(p[1]) || count == job.interval_count) break;
+      p += 2;
+      job.starts[count++] = p;
+   }
+   if (p+1 >= end) p = end;
+
+   if (count != job.interval_count) { STBI_FREE(job.starts); return -1; }
+   job.starts[count] = p;
+
+   // enough tasks to keep every core busy, few enough that copying the decoder is noise
+   job.intervals_per_task = job.interval_count >= 128 ? job.interval_count / 64 : 1;
+   tasks = (job.interval_count + job.intervals_per_task - 1) / job.intervals_per_task;
+   job.ok = (stbi_uc *) stbi__malloc(tasks);
+   if (!job.ok) { STBI_FREE(job.starts); return -1; }
+
+   stbi__parallel(tasks, stbi__jpeg_decode_intervals, &job);
+
+   for (k=0; k < tasks; ++k)
+      if (!job.ok[k]) result = stbi__err("bad huffman code","Corrupt JPEG");
+
+   // carry on after the scan, as if it had been decoded in order
+   z->s->img_buffer = p;
+   z->marker = STBI__MARKER_none;
+   z->code_bits = 0;
+   z->nomore = 0;
+
+   STBI_FREE(job.ok);
+   STBI_FREE(job.starts);
+   return result;
+}
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
    stbi__jpeg_reset(z);
    if (!z->progressive) {
+      int parallel = stbi__jpeg_decode_restart_parallel(z);
+      if (parallel >= 0) return parallel;
       if (z->scan_n == 1) {
          int i,j;
-         STBI_SIMD_ALIGN(short, data[64]);
          int n = z->order[0];
          // non-interleaved data, we just need to process one block at a time,
          // in trivial scanline order
@@ -2420,9 +2926,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          int h = (z->img_comp[n].y+7) >> 3;
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
-               int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               if (!stbi__jpeg_decode_baseline_block(z, n, i, j)) return 0;
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2436,7 +2940,6 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          return 1;
       } else { // interleaved
          int i,j,k,x,y;
-         STBI_SIMD_ALIGN(short, data[64]);
          for (j=0; j < z->img_mcu_y; ++j) {
             for (i=0; i < z->img_mcu_x; ++i) {
                // scan an interleaved mcu... process scan_n components in order
@@ -2446,11 +2949,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   // by the basic H and V specified for the component
                   for (y=0; y < z->img_comp[n].v; ++y) {
                      for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
-                        int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        if (!stbi__jpeg_decode_baseline_block(z, n, i*z->img_comp[n].h + x, j*z->img_comp[n].v + y)) return 0;
                      }
                   }
                }
@@ -2535,25 +3034,32 @@ static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
       data[i] *= dequant[i];
 }
 
-static void stbi__jpeg_finish(stbi__jpeg *z)
+// one row of blocks of one component; rows of all components are numbered in turn
+static void stbi__jpeg_finish_row(void *data, int row)
 {
-   if (z->progressive) {
-      // dequantize and idct the data
-      int i,j,n;
-      for (n=0; n < z->s->img_n; ++n) {
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-               stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-            }
-         }
-      }
+   stbi__jpeg *z = (stbi__jpeg *) data;
+   int i,n;
+   for (n=0; row >= (z->img_comp[n].y+7) >> 3; ++n)
+      row -= (z->img_comp[n].y+7) >> 3;
+   for (i=0; i < (z->img_comp[n].x+7) >> 3; ++i) {
+      short *coeff = z->img_comp[n].coeff + 64 * (i + row * z->img_comp[n].coeff_w);
+      // baseline coefficients were dequantized while decoding
+      if (z->progressive)
+         stbi__jpeg_dequantize(coeff, z->dequant[z->img_comp[n].tq]);
+      stbi__jpeg_idct_at(z, n, i, row, coeff);
    }
 }
 
+static void stbi__jpeg_finish(stbi__jpeg *z)
+{
+   // dequantize and idct the data, if it was kept as coefficients
+   int n, rows = 0;
+   if (!z->img_comp[0].coeff) return;
+   for (n=0; n < z->s->img_n; ++n)
+      rows += (z->img_comp[n].y+7) >> 3;
+   stbi__parallel(rows, stbi__jpeg_finish_row, z);
+}
+
 static int stbi__process_marker(stbi__jpeg *z, int m)
 {
    int L;
@@ -2792,12 +3298,15 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
-      z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
+      z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2 >> z->scale_shift, z->img_comp[i].h2 >> z->scale_shift, 15);
       if (z->img_comp[i].raw_data == NULL)
          return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
-      if (z->progressive) {
+      // progressive scans refine coefficients, so they have to be kept. baseline ones
+      // are kept too when the idct can then run in parallel but the entropy decode
+      // can't, because there are no restart intervals to split it at
+      if (z->progressive || (stbi__jpeg_parallel(z) && (!z->restart_interval || z->s->read_from_callbacks))) {
          // w2, h2 are multiples of 8 (see above)
          z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
          z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
@@ -2866,6 +3375,25 @@ static stbi_uc stbi__skip_jpeg_junk_at_end(stbi__jpeg *j)
    return STBI__MARKER_none;
 }
 
+// a scaled decode only reads the lowest n x n frequencies, which in zigzag order
+// end at 24, 4 and 0. progressive scans made only of higher ones can be skipped
+static int stbi__jpeg_scan_unused(stbi__jpeg *j)
+{
+   static const int last_used[4] = { 63, 24, 4, 0 };
+   return j->progressive && j->spec_start > last_used[j->scale_shift];
+}
+
+static void stbi__jpeg_skip_scan(stbi__jpeg *j)
+{
+   // stop at the first marker that isn't a restart; stuffed zeros aren't markers
+   while (!stbi__at_eof(j->s)) {
+      int x = stbi__get8(j->s);
+      if (x != 0xff) continue;
+      do x = stbi__get8(j->s); while (x == 0xff);
+      if (x != 0 && !STBI__RESTART(x)) { j->marker = (unsigned char) x; return; }
+   }
+}
+
 // decode image to YCbCr format
 static int stbi__decode_jpeg_image(stbi__jpeg *j)
 {
@@ -2880,7 +3408,9 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
    while (!stbi__EOI(m)) {
       if (stbi__SOS(m)) {
          if (!stbi__process_scan_header(j)) return 0;
-         if (!stbi__parse_entropy_coded_data(j)) return 0;
+         if (stbi__jpeg_scan_unused(j)) {
+            stbi__jpeg_skip_scan(j);
+         } else if (!stbi__parse_entropy_coded_data(j)) return 0;
          if (j->marker == STBI__MARKER_none ) {
          j->marker = stbi__skip_jpeg_junk_at_end(j);
             // if we reach eof without hitting a marker, stbi__get_marker() below will fail and we'll eventually return 0
@@ -2899,8 +3429,7 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
          m = stbi__get_marker(j);
       }
    }
-   if (j->progressive)
-      stbi__jpeg_finish(j);
+   stbi__jpeg_finish(j);
    return 1;
 }
 
@@ -3275,25 +3804,226 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// interleaves 16 pixels of r, g and b bytes, with an opaque alpha when step == 4
+static STBI__TARGET_AVX2 void stbi__store_rgb16(stbi_uc *out, __m128i r, __m128i g, __m128i b, int step)
+{
+   if (step == 4) {
+      __m128i xw = _mm_set1_epi8(-1); // alpha channel
+      __m128i rg0 = _mm_unpacklo_epi8(r, g);
+      __m128i rg1 = _mm_unpackhi_epi8(r, g);
+      __m128i bx0 = _mm_unpacklo_epi8(b, xw);
+      __m128i bx1 = _mm_unpackhi_epi8(b, xw);
+
+      _mm_storeu_si128((__m128i *) (out + 0), _mm_unpacklo_epi16(rg0, bx0));
+      _mm_storeu_si128((__m128i *) (out + 16), _mm_unpackhi_epi16(rg0, bx0));
+      _mm_storeu_si128((__m128i *) (out + 32), _mm_unpacklo_epi16(rg1, bx1));
+      _mm_storeu_si128((__m128i *) (out + 48), _mm_unpackhi_epi16(rg1, bx1));
+   } else {
+      // for each 16 byte chunk of output, where its bytes come from in r, g and b
+      static const signed char gather[3][3][16] = {
+      {
+         { 0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1,-1,5 },
+         { -1,0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1,-1 },
+         { -1,-1,0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1 },
+      },
+      {
+         { -1,-1,6,-1,-1,7,-1,-1,8,-1,-1,9,-1,-1,10,-1 },
+         { 5,-1,-1,6,-1,-1,7,-1,-1,8,-1,-1,9,-1,-1,10 },
+         { -1,5,-1,-1,6,-1,-1,7,-1,-1,8,-1,-1,9,-1,-1 },
+      },
+      {
+         { -1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15,-1,-1 },
+         { -1,-1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15,-1 },
+         { 10,-1,-1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15 },
+      },
+      };
+      int i;
+
+      for (i=0; i < 3; ++i) {
+         __m128i rs = _mm_shuffle_epi8(r, _mm_loadu_si128((const __m128i *) gather[i][0]));
+         __m128i gs = _mm_shuffle_epi8(g, _mm_loadu_si128((const __m128i *) gather[i][1]));
+         __m128i bs = _mm_shuffle_epi8(b, _mm_loadu_si128((const __m128i *) gather[i][2]));
+         _mm_storeu_si128((__m128i *) (out + i*16), _mm_or_si128(_mm_or_si128(rs, gs), bs));
+      }
+   }
+}
+
+// the sse2 conversion 16 pixels at a time, for rgb as well as rgba output.
+// what's left over goes to the sse2 version
+static STBI__TARGET_AVX2 void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 3 || step == 4) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+
+      for (; i+15 < count; i += 16) {
+         // load
+         __m128i y_bytes = _mm_loadu_si128((const __m128i *) (y+i));
+         __m128i cr_biased = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (pcr+i)), signflip); // -128
+         __m128i cb_biased = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (pcb+i)), signflip); // -128
+
+         // widen to short with the bytes in the high half, as the sse2 unpack does
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cr_biased), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cb_biased), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte. packus works within 128-bit lanes, the permute restores the order
+         __m256i rg = _mm256_permute4x64_epi64(_mm256_packus_epi16(rw, gw), 0xd8);
+         __m256i bb = _mm256_permute4x64_epi64(_mm256_packus_epi16(bw, bw), 0xd8);
+
+         stbi__store_rgb16(out, _mm256_castsi256_si128(rg), _mm256_extracti128_si256(rg, 1), _mm256_castsi256_si128(bb), step);
+         out += 16*step;
+      }
+   }
+
+   stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
+#ifdef STBI_AVX512
+// 32 pixels at a time, the rest goes to the avx2 version
+static STBI__TARGET_AVX512 void stbi__YCbCr_to_RGB_avx512(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 3 || step == 4) {
+      __m256i signflip  = _mm256_set1_epi8(-0x80);
+      __m512i cr_const0 = _mm512_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m512i cr_const1 = _mm512_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m512i cb_const0 = _mm512_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m512i cb_const1 = _mm512_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m512i y_bias = _mm512_set1_epi16(128);
+      __m512i order = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+
+      for (; i+31 < count; i += 32) {
+         // load
+         __m256i y_bytes = _mm256_loadu_si256((const __m256i *) (y+i));
+         __m256i cr_biased = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (pcr+i)), signflip); // -128
+         __m256i cb_biased = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (pcb+i)), signflip); // -128
+
+         // widen to short with the bytes in the high half
+         __m512i yw  = _mm512_or_si512(_mm512_slli_epi16(_mm512_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m512i crw = _mm512_slli_epi16(_mm512_cvtepu8_epi16(cr_biased), 8);
+         __m512i cbw = _mm512_slli_epi16(_mm512_cvtepu8_epi16(cb_biased), 8);
+
+         // color transform
+         __m512i yws = _mm512_srli_epi16(yw, 4);
+         __m512i cr0 = _mm512_mulhi_epi16(cr_const0, crw);
+         __m512i cb0 = _mm512_mulhi_epi16(cb_const0, cbw);
+         __m512i cb1 = _mm512_mulhi_epi16(cbw, cb_const1);
+         __m512i cr1 = _mm512_mulhi_epi16(crw, cr_const1);
+         __m512i rws = _mm512_add_epi16(cr0, yws);
+         __m512i gwt = _mm512_add_epi16(cb0, yws);
+         __m512i bws = _mm512_add_epi16(yws, cb1);
+         __m512i gws = _mm512_add_epi16(gwt, cr1);
+
+         // descale
+         __m512i rw = _mm512_srai_epi16(rws, 4);
+         __m512i bw = _mm512_srai_epi16(bws, 4);
+         __m512i gw = _mm512_srai_epi16(gws, 4);
+
+         // back to byte. packus works within 128-bit lanes, the permute restores the order
+         __m512i rg = _mm512_permutexvar_epi64(order, _mm512_packus_epi16(rw, gw));
+         __m512i bb = _mm512_permutexvar_epi64(order, _mm512_packus_epi16(bw, bw));
+         __m256i r = _mm512_castsi512_si256(rg);
+         __m256i g = _mm512_extracti64x4_epi64(rg, 1);
+         __m256i b = _mm512_castsi512_si256(bb);
+
+         stbi__store_rgb16(out, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g), _mm256_castsi256_si128(b), step);
+         stbi__store_rgb16(out + 16*step, _mm256_extracti128_si256(r, 1), _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(b, 1), step);
+         out += 32*step;
+      }
+   }
+
+   stbi__YCbCr_to_RGB_avx2(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
+static int stbi__simd_limit = STBI_SIMD_AVX512;
+static int stbi__simd_detected = -1;
+
+static int stbi__simd_detect(void)
+{
+#if defined(STBI_SSE2)
+   if (!stbi__sse2_available()) return STBI_SIMD_NONE;
+#ifdef STBI_AVX2
+   {
+      int avx = stbi__avx_level();
+      if (avx) return avx;
+   }
+#endif
+   return STBI_SIMD_128;
+#elif defined(STBI_NEON)
+   return STBI_SIMD_128;
+#else
+   return STBI_SIMD_NONE;
+#endif
+}
+
+STBIDEF int stbi_simd_level(void)
+{
+   // racing threads all detect the same thing
+   if (stbi__simd_detected < 0)
+      stbi__simd_detected = stbi__simd_detect();
+   return stbi__simd_detected < stbi__simd_limit ? stbi__simd_detected : stbi__simd_limit;
+}
+
+STBIDEF void stbi_set_simd_limit(int level)
+{
+   stbi__simd_limit = level;
+}
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
+   int simd = stbi_simd_level();
+   STBI_NOTUSED(simd);
+
    j->idct_block_kernel = stbi__idct_block;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
-#ifdef STBI_SSE2
-   if (stbi__sse2_available()) {
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+   if (simd >= STBI_SIMD_128) {
       j->idct_block_kernel = stbi__idct_simd;
       j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
       j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
    }
 #endif
 
-#ifdef STBI_NEON
-   j->idct_block_kernel = stbi__idct_simd;
-   j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
-   j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+#ifdef STBI_AVX2
+   if (simd >= STBI_SIMD_AVX2) {
+      j->idct_block_kernel = stbi__idct_avx2;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+   }
+#endif
+
+#ifdef STBI_AVX512
+   if (simd >= STBI_SIMD_AVX512)
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx512;
 #endif
 }
 
@@ -3320,6 +4050,144 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+// colour conversion works on bands of output rows. each band gets its own line
+// buffers and starts the resamplers where the rows before it would have left them.
+// the converters write a fourth byte past every pixel even when n == 3, which on a
+// band's last row would land in the next band, so that row goes through a scratch row
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__resample res_comp[4]; // as of the first row
+   stbi_uc *output;
+   stbi_uc *scratch; // per band: decode_n line buffers, then one output row
+   size_t band_scratch;
+   int n, decode_n, is_rgb;
+   int rows_per_band;
+} stbi__jpeg_convert_job;
+
+static void stbi__resample_advance(stbi__resample *r, stbi__jpeg *z, int k)
+{
+   if (++r->ystep >= r->vs) {
+      r->ystep = 0;
+      r->line0 = r->line1;
+      if (++r->ypos < z->img_comp[k].y)
+         r->line1 += z->img_comp[k].w2;
+   }
+}
+
+static void stbi__jpeg_convert_band(void *data, int band)
+{
+   stbi__jpeg_convert_job *job = (stbi__jpeg_convert_job *) data;
+   stbi__jpeg *z = job->z;
+   stbi__resample res_comp[4];
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   stbi_uc *scratch = job->scratch + band * job->band_scratch;
+   stbi_uc *tail = scratch + job->decode_n * (z->s->img_x + 3);
+   int k, n = job->n, decode_n = job->decode_n;
+   unsigned int i,j;
+   unsigned int first = band * job->rows_per_band;
+   unsigned int last = first + job->rows_per_band < z->s->img_y ? first + job->rows_per_band : z->s->img_y;
+
+   for (k=0; k < decode_n; ++k) {
+      res_comp[k] = job->res_comp[k];
+      for (j=0; j < first; ++j)
+         stbi__resample_advance(&res_comp[k], z, k);
+   }
+
+   for (j=first; j < last; ++j) {
+      stbi_uc *row = job->output + n * z->s->img_x * j;
+      stbi_uc *out = j+1 == last ? tail : row;
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(scratch + k * (z->s->img_x + 3),
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         stbi__resample_advance(r, z, k);
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (job->is_rgb) {
+               for (i=0; i < z->s->img_x; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
+                  out += n;
+               }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  out[3] = 255;
+                  out += n;
+               }
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
+                  out += n;
+               }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (job->is_rgb) {
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               out[1] = 255;
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+         }
+      }
+      if (j+1 == last)
+         memcpy(row, tail, n * z->s->img_x);
+   }
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
@@ -3331,6 +4199,19 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // load a jpeg image from whichever source, but leave in YCbCr format
    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
+   // from here on the image is as big as the scaled blocks made it
+   if (z->scale_shift) {
+      int k, round = (1 << z->scale_shift) - 1;
+      z->s->img_x = (z->s->img_x + round) >> z->scale_shift;
+      z->s->img_y = (z->s->img_y + round) >> z->scale_shift;
+      for (k=0; k < z->s->img_n; ++k) {
+         z->img_comp[k].x = (z->img_comp[k].x + round) >> z->scale_shift;
+         z->img_comp[k].y = (z->img_comp[k].y + round) >> z->scale_shift;
+         z->img_comp[k].w2 >>= z->scale_shift;
+         z->img_comp[k].h2 >>= z->scale_shift;
+      }
+   }
+
    // determine actual number of components to generate
    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
 
@@ -3347,20 +4228,18 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 
    // resample and color-convert
    {
-      int k;
-      unsigned int i,j;
-      stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+      int k, bands;
+      stbi__jpeg_convert_job job;
 
-      stbi__resample res_comp[4];
+      job.z = z;
+      job.n = n;
+      job.decode_n = decode_n;
+      job.is_rgb = is_rgb;
+      job.rows_per_band = stbi__jpeg_parallel(z) ? 32 : z->s->img_y;
+      bands = (z->s->img_y + job.rows_per_band - 1) / job.rows_per_band;
 
       for (k=0; k < decode_n; ++k) {
-         stbi__resample *r = &res_comp[k];
-
-         // allocate line buffer big enough for upsampling off the edges
-         // with upsample factor of 4
-         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
-         if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         stbi__resample *r = &job.res_comp[k];
 
          r->hs      = z->img_h_max / z->img_comp[k].h;
          r->vs      = z->img_v_max / z->img_comp[k].v;
@@ -3376,110 +4255,25 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          else                               r->resample = stbi__resample_row_generic;
       }
 
+      // allocate line buffers big enough for upsampling off the edges
+      // with upsample factor of 4
+      job.band_scratch = (size_t) decode_n * (z->s->img_x + 3) + (size_t) n * z->s->img_x + 1;
+      job.scratch = (stbi_uc *) stbi__malloc_mad2(bands, (int) job.band_scratch, 0);
+      if (!job.scratch) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+
       // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      job.output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+      if (!job.output) { STBI_FREE(job.scratch); stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
       // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-            }
-         }
-      }
+      stbi__parallel(bands, stbi__jpeg_convert_band, &job);
+
+      STBI_FREE(job.scratch);
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
       *out_y = z->s->img_y;
       if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
-      return output;
+      return job.output;
    }
 }
 
@@ -3534,6 +4328,51 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
    STBI_FREE(j);
    return result;
 }
+
+static stbi_uc *stbi__load_jpeg_scaled(stbi__context *s, int scale_shift, int *x, int *y, int *comp, int req_comp)
+{
+   static void (*const kernels[4])(stbi_uc *, int, short [64]) = {
+      NULL, stbi__idct_block_4x4, stbi__idct_block_2x2, stbi__idct_block_1x1,
+   };
+   stbi_uc *result;
+   stbi__jpeg *j;
+
+   if (scale_shift < 0 || scale_shift > 3) return stbi__errpuc("bad scale", "JPEG scale must be 1, 1/2, 1/4 or 1/8");
+   if (!stbi__jpeg_test(s)) return stbi__errpuc("not JPEG", "Image not of a supported type");
+
+   j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
+   if (!j) return stbi__errpuc("outofmem", "Out of memory");
+   memset(j, 0, sizeof(stbi__jpeg));
+   j->s = s;
+   stbi__setup_jpeg(j);
+   j->scale_shift = scale_shift;
+   if (scale_shift)
+      j->idct_block_kernel = kernels[scale_shift];
+   result = load_jpeg_image(j, x,y,comp,req_comp);
+   STBI_FREE(j);
+   return result;
+}
+
+STBIDEF stbi_uc *stbi_load_jpeg_scaled_from_memory(stbi_uc const *buffer, int len, int scale_shift, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_jpeg_scaled(&s, scale_shift, x, y, comp, req_comp);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_jpeg_scaled(char const *filename, int scale_shift, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   stbi__context s;
+   stbi_uc *result;
+   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+   stbi__start_file(&s,f);
+   result = stbi__load_jpeg_scaled(&s, scale_shift, x, y, comp, req_comp);
+   fclose(f);
+   return result;
+}
+#endif
 #endif
 
 // public domain zlib decode    v0.2  Sean Barrett 2006-11-18
@@ -1,8 +1,22 @@
 
 #include <cstdio>
 #include <cmath>
+#include <vector>
 
 #include "app.hh"
+#include "atlas.hh"
+#include "geometry.hh"
+#include "gltf.hh"
+#include "jobs.hh"
+#include "loader.hh"
+#include "mesh_file.hh"
+#include "pack.hh"
+#include "primitives.hh"
+#include "registry.hh"
+#include "residency.hh"
+#include "shader_cache.hh"
+#include "stream.hh"
+#include "tools.hh"
 
 namespace {
     inline function now() -> float { return static_cast<float>(glfwGetTime()); }
@@ -11,6 +25,101 @@ namespace {
     char const * concrete_path = "..\\resources\\concrete.jpg";
     char const * paving_path = "..\\resources\\paving.jpg";
     char const * earth_path = "..\\resources\\earth.jpg";
+    
+    // optional, built with 'learngl vt-build'. when present the globe is virtually textured
+    char const * earth_vt_path = "..\\resources\\earth.vt";
+    
+    // optional, converted with 'learngl mesh-convert'. when present it's drawn above the globe
+    char const * model_path = "..\\resources\\model.mesh";
+    
+    // optional, built with 'learngl atlas'. when present the boxes draw from its first three
+    // images, one texture between them
+    char const * atlas_path = "..\\resources\\boxes.atlas";
+    
+    // optional, any gltf 2.0 scene. when present it's drawn around the others
+    char const * gltf_path = "..\\resources\\scene.glb";
+    
+    // optional, built with 'learngl pack'. assets missing from it are read from their files
+    char const * pack_path = "..\\resources\\resources.pack";
+    
+    // program binaries from earlier runs, written on exit
+    char const * shader_cache_path = "..\\resources\\shaders.cache";
+    
+    // how many bytes of texel data texture_stream may upload in a frame
+    constexpr u64 upload_budget = 1024 * 1024;
+    
+    // how much texture memory residency keeps before it starts evicting mip levels
+    constexpr u64 texture_budget = 256 * 1024 * 1024;
+    
+    // jpegs are only hashed on the workers, texture_stream decodes and uploads them after
+    // startup. compressed files are small and go up whole
+    struct t_texture_asset {
+        char const * path;
+        t_texture * texture;
+        u64 key; // of the file's contents, textures that share it share one copy
+        t_compressed_texture compressed;
+    };
+    
+    struct t_mesh_asset {
+        t_mesh ** mesh;
+        t_geometry geometry;
+    };
+    
+    struct t_shader_asset {
+        t_shader_permutations * permutations;
+        uint features;
+        t_shader * shader;
+    };
+    
+    function decode_texture(void * data) -> void {
+        let asset = static_cast<t_texture_asset *>(data);
+        
+        asset->key = registry::texture_key(asset->path);
+        
+        // a compressed file that doesn't load goes to the stream, which leaves it a placeholder
+        if (is_compressed_texture_file(asset->path)) {
+            asset->compressed = load_compressed_texture(asset->path);
+        }
+    }
+    
+    function upload_texture(void * data) -> void {
+        let asset = static_cast<t_texture_asset *>(data);
+        
+        // the assets hash side by side, a duplicate is only noticed here and never requested
+        *asset->texture = registry::find_texture(asset->key);
+        
+        if (!*asset->texture) {
+            let texture = asset->compressed.level_count
+                ? create_texture(&asset->compressed)
+                : texture_stream::request(asset->path);
+            
+            *asset->texture = registry::add_texture(asset->key, residency::add(texture, asset->path));
+        }
+        
+        if (asset->compressed.level_count) free_compressed_texture(&asset->compressed);
+    }
+    
+    // the meshes are primitives, reordered when compiling
+    function upload_mesh(void * data) -> void {
+        let asset = static_cast<t_mesh_asset *>(data);
+        *asset->mesh = registry::acquire_mesh(asset->geometry.vertices, asset->geometry.indices, true);
+        free_geometry(&asset->geometry);
+    }
+    
+    function upload_shader(void * data) -> void {
+        let asset = static_cast<t_shader_asset *>(data);
+        asset->permutations->prepare(asset->features);
+    }
+    
+    // the compile goes on while the other assets load
+    function shader_compiled(void * data) -> bool32 {
+        let asset = static_cast<t_shader_asset *>(data);
+        if (!asset->permutations->ready(asset->features)) return false;
+        
+        *asset->shader = asset->permutations->get(asset->features);
+        
+        return true;
+    }
 }
 
 function t_app::init() -> void {
@@ -67,20 +176,177 @@ function t_app::init() -> void {
     glCullFace(GL_BACK);
     glFrontFace(GL_CCW);
     
-    box = create_box_mesh();
-    sphere = create_sphere_mesh(16, 16);
-    uint basic_shader = create_basic_shader();
+    jobs::init();
+    set_parallel_decoding(true);
+    texture_stream::init(upload_budget);
+    residency::init(texture_budget);
+    pack::open(pack_path);
+    shader_cache::open(shader_cache_path);
+    
+    t_texture_asset static textures[] = {
+        { .path = tile_path, .texture = &tile },
+        { .path = concrete_path, .texture = &concrete },
+        { .path = paving_path, .texture = &paving },
+        { .path = earth_path, .texture = &earth },
+    };
+    
+    // baked and reordered when compiling, nothing to build
+    t_mesh_asset static meshes[] = {
+        { .mesh = &box, .geometry = geometry(primitives::box) },
+        { .mesh = &sphere, .geometry = geometry(primitives::sphere<16, 16>) },
+    };
+    
+    let box_mesh = loader::add({
+        .name = "box mesh",
+        .build = null,
+        .upload = upload_mesh,
+        .data = &meshes[0],
+    });
+    
+    let sphere_mesh = loader::add({
+        .name = "sphere mesh",
+        .build = null,
+        .upload = upload_mesh,
+        .data = &meshes[1],
+    });
+    
+    basic_shaders = create_basic_permutations();
+    
+    t_shader_asset static shaders[] = {
+        { .permutations = &basic_shaders, .features = 0, .shader = &basic_shader },
+    };
+    
+    let shader = loader::add({
+        .name = "basic shader",
+        .build = null,
+        .upload = upload_shader,
+        .ready = shader_compiled,
+        .data = &shaders[0],
+    });
+    
+    loader::t_asset_id texture_ids[4];
+    
+    for (int i = 0; i < 4; i += 1) {
+        texture_ids[i] = loader::add({
+            .name = textures[i].path,
+            .build = decode_texture,
+            .upload = upload_texture,
+            .data = &textures[i],
+        });
+    }
+    
+    // mapped on a worker, so the upload is only create_mesh's copy
+    let model = loader::add({
+        .name = model_path,
+        .build = [] (void * data) { static_cast<t_app *>(data)->model_file = load_mesh_file(model_path); },
+        .upload = [] (void * data) {
+            let app = static_cast<t_app *>(data);
+            let file = &app->model_file;
+            
+            app->model_loaded = file->geometry.vertices.length() && file->lods.length();
+            
+            if (app->model_loaded) {
+                app->model = create_mesh(file->geometry.vertices, file->geometry.indices, true, file->lods);
+                app->model_clusters = create_cluster_mesh(&app->model, file->meshlets);
+            }
+            
+            free_mesh_file(file);
+        },
+        .data = this,
+    });
+    
+    // read on a worker, only the upload and its mips on the gl thread
+    let atlas = loader::add({
+        .name = atlas_path,
+        .build = [] (void * data) { static_cast<t_app *>(data)->atlas = load_atlas(atlas_path); },
+        .upload = [] (void * data) {
+            let app = static_cast<t_app *>(data);
+            let loaded = &app->atlas;
+            
+            app->atlas_loaded = loaded->storage && loaded->regions.length() >= 3;
+            
+            if (app->atlas_loaded) {
+                app->atlas_texture = create_atlas_texture(loaded);
+                for (int i = 0; i < 3; i += 1) app->atlas_regions[i] = loaded->regions[i];
+            }
+            
+            if (loaded->storage) free_atlas(loaded);
+        },
+        .data = this,
+    });
+    
+    let earth_vt = loader::add({
+        .name = earth_vt_path,
+        .build = null,
+        .upload = [] (void * data) {
+            let app = static_cast<t_app *>(data);
+            app->earth_vt_loaded = create_virtual_texture(earth_vt_path, &app->earth_vt);
+        },
+        .data = this,
+    });
+    
+    // decoded on the workers, uploaded once the shader and the texture for untextured primitives are
+    let gltf_scene = loader::add({
+        .name = gltf_path,
+        .build = [] (void * data) {
+            let app = static_cast<t_app *>(data);
+            app->gltf_loaded = load_gltf(gltf_path, &app->gltf);
+        },
+        .upload = [] (void * data) {
+            let app = static_cast<t_app *>(data);
+            if (!app->gltf_loaded) return;
+            
+            let decode_time = app->gltf.decode_time;
+            app->gltf_model = create_model(&app->gltf, app->basic_shader, app->concrete);
+            
+            std::printf(
+                "%s: %llu nodes, %llu meshes, %llu textures, decoded in %.1fms\n",
+                gltf_path,
+                (unsigned long long) app->gltf_model.nodes.size(),
+                (unsigned long long) app->gltf_model.meshes.size(),
+                (unsigned long long) app->gltf_model.textures.size(),
+                decode_time * 1000.f
+            );
+        },
+        .data = this,
+    }, { shader, texture_ids[1] });
+    
+    loader::add({
+        .name = "scene",
+        .build = null,
+        .upload = [] (void * data) { static_cast<t_app *>(data)->init_scene(); },
+        .data = this,
+    }, { box_mesh, sphere_mesh, shader, texture_ids[0], texture_ids[1], texture_ids[2], texture_ids[3], atlas, earth_vt, model, gltf_scene });
+    
+    loader::run();
+    loader::report();
+    
+    let shared = registry::stats();
+    
+    std::printf(
+        "registry: %u textures, %u meshes, %u shaders, %llu loads shared\n",
+        shared.textures,
+        shared.meshes,
+        shared.shaders,
+        (unsigned long long) shared.hits
+    );
     
-    tile = create_texture(tile_path);
-    concrete = create_texture(concrete_path);
-    paving = create_texture(paving_path);
-    earth = create_texture(earth_path);
+    let cached = shader_cache::stats();
     
-    t_node static nodes[4] = {
+    std::printf(
+        "shader cache: %u programs loaded from binaries, %u compiled, %u binaries rejected\n",
+        cached.hits,
+        cached.misses,
+        cached.rejected
+    );
+}
+
+function t_app::init_scene() -> void {
+    std::vector<t_node> static nodes = {
         { .texture = tile },
         { .texture = concrete },
         { .texture = paving },
-        {}
+        {},
     };
     
     for (int i = 0; i < 3; i += 1) {
@@ -94,21 +360,43 @@ function t_app::init() -> void {
         
         nodes[i].position = { xy * radius, 0.f };
         
-        nodes[i].mesh= &box;
+        nodes[i].mesh = box;
         nodes[i].shader = basic_shader;
         nodes[i].orientation = {};
+        
+        // the box's uvs stay in 0..1, so it fits the region as is
+        if (atlas_loaded) place_in_atlas(&nodes[i], &atlas_regions[i], atlas_texture, &atlas_boxes[i]);
     }
     
+    // small enough that the globe's back half culls cluster by cluster
+    sphere_clusters = build_meshlets(sphere, 64, 124);
+    
     nodes[3] = {
-        .mesh = &sphere,
+        .mesh = sphere,
         .texture = earth,
         .shader = basic_shader,
         .position = {},
         .orientation = glm::angleAxis(0.15f, vec3 {0.f, 1.f, 0.f}),
+        .virtual_texture = earth_vt_loaded ? &earth_vt : null,
+        .clusters = &sphere_clusters,
     };
     
+    // at its own size, above the globe
+    if (model_loaded) {
+        nodes.push_back({
+            .mesh = &model,
+            .texture = concrete,
+            .shader = basic_shader,
+            .position = { 0.f, 0.f, 1.5f },
+            .orientation = {},
+            .virtual_texture = null,
+            .clusters = &model_clusters,
+        });
+    }
+    
+    if (gltf_loaded) nodes.insert(nodes.end(), gltf_model.nodes.begin(), gltf_model.nodes.end());
     
-    scene = { .nodes = { .ptr = nodes, .len = sizeof(nodes) / sizeof(t_node) } };
+    scene = { .nodes = { .ptr = nodes.data(), .len = nodes.size() } };
 }
 
 function t_app::update(float dt) -> void {
@@ -166,6 +454,17 @@ function t_app::render() -> void {
     
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     
+    texture_stream::update();
+    residency::update();
+    registry::collect();
+    
+    if (earth_vt_loaded) {
+        earth_vt.update();
+        earth_vt.begin_feedback(width, height);
+        scene.render_feedback(&camera);
+        earth_vt.end_feedback();
+    }
+    
     
     scene.render(&camera);
     
@@ -191,6 +490,27 @@ function t_app::run() -> int {
 }
 
 function t_app::terminate() -> int {
+    set_parallel_decoding(false);
+    jobs::terminate();
+    texture_stream::terminate();
+    basic_shaders.destroy();
+    destroy_meshlets(&sphere_clusters);
+    if (model_loaded) destroy_meshlets(&model_clusters);
+    if (model_loaded) destroy_mesh(&model);
+    if (gltf_loaded) destroy_model(&gltf_model);
+    
+    if (atlas_loaded) {
+        for (auto & box : atlas_boxes) destroy_mesh(&box);
+        glDeleteTextures(1, &atlas_texture);
+    }
+    
+    release_cluster_culling();
+    registry::terminate();
+    residency::terminate();
+    if (earth_vt_loaded) earth_vt.destroy();
+    shader_cache::close();
+    release_decode_memory();
+    pack::close();
     glfwTerminate();
     return 0;
 }
@@ -209,9 +529,20 @@ function t_app::on_key_event(GLFWwindow __in * window, int key, int scancode, in
         
         app.camera.can_move ^= 1;
     }
+    
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        let next = (t_cluster_culling) (((int) cluster_culling() + 1) % 3);
+        set_cluster_culling(next);
+        
+        char const static * names[] = { "none", "cpu", "gpu" };
+        std::printf("cluster culling: %s\n", names[(int) next]);
+    }
 }
 
 function main(int argc, char ** argv) -> int {
+    int status;
+    if (run_tool(argc, argv, &status)) return status;
+    
     app.init();
     return app.run();
 }
@@ -4,14 +4,21 @@
 #include <glad/glad.h>
 #include <glfw/glfw3.h>
 
+#include "atlas.hh"
 #include "camera.hh"
+#include "gltf.hh"
+#include "mesh_file.hh"
+#include "meshlets.hh"
+#include "permutations.hh"
 #include "render.hh"
+#include "virtual_texture.hh"
 
 struct t_app {
     static function on_key_event(GLFWwindow __in * window, int key, int scancode, int action, int mods) -> void;
     
     
     function init() -> void;
+    function init_scene() -> void;
     function update(float dt) -> void;
     function render() -> void;
     function run() -> int;
@@ -26,8 +33,29 @@ struct t_app {
     
     vec3 background_color;
     
-    t_mesh box, sphere;
+    t_mesh * box, * sphere;
+    t_cluster_mesh sphere_clusters;
     t_texture tile, concrete, paving, earth;
+    t_shader_permutations basic_shaders;
+    t_shader basic_shader; // basic_shaders without any features
+    
+    t_atlas atlas; // only while loading
+    t_atlas_region atlas_regions[3];
+    t_texture atlas_texture;
+    t_mesh atlas_boxes[3]; // the box with its uvs moved into each region
+    bool32 atlas_loaded;
+    
+    t_virtual_texture earth_vt;
+    bool32 earth_vt_loaded;
+    
+    t_mesh_file model_file; // only while loading
+    t_mesh model;
+    t_cluster_mesh model_clusters;
+    bool32 model_loaded;
+    
+    t_gltf gltf; // only while loading
+    t_model gltf_model;
+    bool32 gltf_loaded;
 };
 
 extern function main(int argc, char ** argv) -> int;
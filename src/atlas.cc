@@ -0,0 +1,351 @@
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "atlas.hh"
+#include "mips.hh"
+#include "pack.hh"
+
+namespace {
+    u8 const file_magic[8] = { 0xAB, 'L', 'A', 'T', ' ', '1', 0xBB, '\n' };
+    
+    struct t_file_header {
+        u8 magic[8];
+        uint32 width;
+        uint32 height;
+        uint32 level_count;
+        uint32 region_count;
+    };
+    
+    struct t_file_region {
+        uint32 x;
+        uint32 y;
+        uint32 width;
+        uint32 height;
+    };
+    
+    // one run of the skyline: the packed area's top edge between x and x + width
+    struct t_segment {
+        int x;
+        int y;
+        int width;
+    };
+    
+    struct t_skyline {
+        int width;
+        int height;
+        std::vector<t_segment> segments;
+    };
+    
+    // where a rect would sit if its left edge went at segment i, -1 if it doesn't fit
+    function fit(t_skyline __in * skyline, u64 i, int width, int height) -> int {
+        let x = skyline->segments[i].x;
+        if (x + width > skyline->width) return -1;
+        
+        int y = 0;
+        int remaining = width;
+        
+        for (u64 j = i; remaining > 0; j += 1) {
+            y = skyline->segments[j].y > y ? skyline->segments[j].y : y;
+            remaining -= skyline->segments[j].width;
+        }
+        
+        return y + height <= skyline->height ? y : -1;
+    }
+    
+    // bottom left: the spot where the rect's top ends lowest, ties go to the narrower segment
+    function insert(t_skyline * skyline, int width, int height, int __out * x, int __out * y) -> bool32 {
+        let segments = &skyline->segments;
+        
+        u64 best = segments->size();
+        int best_top = 0;
+        int best_y = 0;
+        
+        for (u64 i = 0; i < segments->size(); i += 1) {
+            let fit_y = fit(skyline, i, width, height);
+            if (fit_y < 0) continue;
+            
+            let top = fit_y + height;
+            let better = best == segments->size()
+                || top < best_top
+                || (top == best_top && (*segments)[i].width < (*segments)[best].width);
+            
+            if (better) {
+                best = i;
+                best_top = top;
+                best_y = fit_y;
+            }
+        }
+        
+        if (best == segments->size()) return false;
+        
+        *x = (*segments)[best].x;
+        *y = best_y;
+        
+        // the new top edge shadows whatever segments it covers
+        segments->insert(segments->begin() + best, { .x = *x, .y = best_top, .width = width });
+        
+        let right = *x + width;
+        
+        for (u64 i = best + 1; i < segments->size();) {
+            let segment = &(*segments)[i];
+            if (segment->x >= right) break;
+            
+            let covered = right - segment->x;
+            
+            if (segment->width <= covered) {
+                segments->erase(segments->begin() + i);
+            } else {
+                segment->x += covered;
+                segment->width -= covered;
+                break;
+            }
+        }
+        
+        for (u64 i = 0; i + 1 < segments->size();) {
+            if ((*segments)[i].y == (*segments)[i + 1].y) {
+                (*segments)[i].width += (*segments)[i + 1].width;
+                segments->erase(segments->begin() + i + 1);
+            } else {
+                i += 1;
+            }
+        }
+        
+        return true;
+    }
+    
+    // the kaiser filtered chain reaches about (4 << k) - 3 texels past a region's
+    // edge at level k, bilinear filtering included. levels beyond the padding are dropped
+    function safe_level_count(int padding, int width, int height) -> uint {
+        uint count = 1;
+        
+        while ((4 << count) - 3 <= padding && (width >> count) > 0 && (height >> count) > 0) {
+            count += 1;
+        }
+        
+        return count;
+    }
+    
+    function region_uvs(t_atlas_region * region, int width, int height) -> void {
+        region->uv_offset = { (float) region->x / width, (float) region->y / height };
+        region->uv_scale = { (float) region->width / width, (float) region->height / height };
+    }
+    
+    // one allocation for the regions and the pixels, the regions first
+    function allocate(t_atlas * atlas, u64 region_count, int width, int height) -> void {
+        let regions_size = (sizeof(t_atlas_region) * region_count + 15) & ~(u64) 15;
+        
+        atlas->storage = std::calloc(regions_size + (u64) width * height * 3, 1);
+        atlas->regions = { .ptr = static_cast<t_atlas_region *>(atlas->storage), .len = region_count };
+        atlas->image = {
+            .pixels = static_cast<u8 *>(atlas->storage) + regions_size,
+            .width = width,
+            .height = height,
+            .channels = 3,
+        };
+    }
+}
+
+function pack_atlas(t_slice<t_image> images, int padding, int max_size) -> t_atlas {
+    let count = images.length();
+    
+    std::vector<u64> order(count);
+    u64 area = 0;
+    int widest = 1;
+    int tallest = 1;
+    
+    for (u64 i = 0; i < count; i += 1) {
+        m_assert(images[i].channels == 3);
+        
+        order[i] = i;
+        
+        let width = images[i].width + 2 * padding;
+        let height = images[i].height + 2 * padding;
+        
+        area += (u64) width * height;
+        widest = width > widest ? width : widest;
+        tallest = height > tallest ? height : tallest;
+    }
+    
+    std::sort(order.begin(), order.end(), [&] (u64 a, u64 b) {
+        return images[a].height != images[b].height
+            ? images[a].height > images[b].height
+            : images[a].width > images[b].width;
+    });
+    
+    std::vector<int> xs(count);
+    std::vector<int> ys(count);
+    
+    // wide before square at each size, whichever fits first is the smaller texture
+    for (int size = 1; size <= max_size; size *= 2) {
+        for (int height = size / 2 > 0 ? size / 2 : size; height <= size; height *= 2) {
+            if ((u64) size * height < area || size < widest || height < tallest) continue;
+            
+            t_skyline skyline = { .width = size, .height = height, .segments = { { .x = 0, .y = 0, .width = size } } };
+            bool32 fits = true;
+            
+            for (u64 i = 0; fits && i < count; i += 1) {
+                let image = &images[order[i]];
+                fits = insert(&skyline, image->width + 2 * padding, image->height + 2 * padding, &xs[order[i]], &ys[order[i]]);
+            }
+            
+            if (!fits) continue;
+            
+            t_atlas atlas = { .level_count = safe_level_count(padding, size, height) };
+            allocate(&atlas, count, size, height);
+            
+            for (u64 i = 0; i < count; i += 1) {
+                let image = &images[i];
+                let region = &atlas.regions[i];
+                
+                *region = { .x = xs[i] + padding, .y = ys[i] + padding, .width = image->width, .height = image->height };
+                region_uvs(region, size, height);
+                
+                // the padding repeats the nearest edge texel
+                for (int y = -padding; y < image->height + padding; y += 1) {
+                    let source_y = m_clamp(y, 0, image->height - 1);
+                    let out = atlas.image.pixels + ((u64) (region->y + y) * size + region->x) * 3;
+                    let in = image->pixels + (u64) source_y * image->width * 3;
+                    
+                    for (int x = -padding; x < image->width + padding; x += 1) {
+                        let source_x = m_clamp(x, 0, image->width - 1);
+                        std::memcpy(out + x * 3, in + source_x * 3, 3);
+                    }
+                }
+            }
+            
+            return atlas;
+        }
+    }
+    
+    return {};
+}
+
+function free_atlas(t_atlas __in * atlas) -> void {
+    std::free(atlas->storage);
+    *atlas = {};
+}
+
+function save_atlas(char const * path, t_atlas __in * atlas) -> bool32 {
+    let file = std::fopen(path, "wb");
+    if (!file) return false;
+    
+    t_file_header header = {
+        .width = (uint32) atlas->image.width,
+        .height = (uint32) atlas->image.height,
+        .level_count = atlas->level_count,
+        .region_count = (uint32) atlas->regions.length(),
+    };
+    
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    
+    bool32 ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    
+    for (u64 i = 0; ok && i < atlas->regions.length(); i += 1) {
+        let region = &atlas->regions[i];
+        t_file_region entry = { .x = (uint32) region->x, .y = (uint32) region->y, .width = (uint32) region->width, .height = (uint32) region->height };
+        ok = std::fwrite(&entry, sizeof(entry), 1, file) == 1;
+    }
+    
+    let size = (u64) atlas->image.width * atlas->image.height * 3;
+    ok = ok && std::fwrite(atlas->image.pixels, 1, size, file) == size;
+    
+    std::fclose(file);
+    
+    return ok;
+}
+
+function load_atlas(char const * path) -> t_atlas {
+    let packed = pack::find(path);
+    if (packed.ptr) return load_atlas(packed);
+    
+    let file = std::fopen(path, "rb");
+    if (!file) return {};
+    
+    std::fseek(file, 0, SEEK_END);
+    let size = (u64) std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    
+    let data = static_cast<u8 *>(std::malloc(size));
+    let ok = std::fread(data, 1, size, file) == size;
+    std::fclose(file);
+    
+    let atlas = ok ? load_atlas({ .ptr = data, .len = size }) : t_atlas {};
+    std::free(data);
+    
+    return atlas;
+}
+
+function load_atlas(t_slice<u8 const> file) -> t_atlas {
+    t_file_header header;
+    
+    if (file.length() < sizeof(header)) return {};
+    std::memcpy(&header, file.ptr, sizeof(header));
+    
+    let pixels_offset = sizeof(header) + sizeof(t_file_region) * (u64) header.region_count;
+    let pixels_size = (u64) header.width * header.height * 3;
+    
+    let ok = std::memcmp(header.magic, file_magic, sizeof(file_magic)) == 0
+        && header.level_count > 0
+        && header.level_count <= t_mip_chain::max_levels
+        && file.length() >= pixels_offset + pixels_size;
+    
+    if (!ok) return {};
+    
+    t_atlas atlas = { .level_count = header.level_count };
+    allocate(&atlas, header.region_count, (int) header.width, (int) header.height);
+    
+    for (u64 i = 0; i < header.region_count; i += 1) {
+        t_file_region entry;
+        std::memcpy(&entry, file.ptr + sizeof(header) + sizeof(entry) * i, sizeof(entry));
+        
+        if ((u64) entry.x + entry.width > header.width || (u64) entry.y + entry.height > header.height) {
+            free_atlas(&atlas);
+            return {};
+        }
+        
+        let region = &atlas.regions[i];
+        *region = { .x = (int) entry.x, .y = (int) entry.y, .width = (int) entry.width, .height = (int) entry.height };
+        region_uvs(region, atlas.image.width, atlas.image.height);
+    }
+    
+    std::memcpy(atlas.image.pixels, file.ptr + pixels_offset, pixels_size);
+    
+    return atlas;
+}
+
+function create_atlas_texture(t_atlas __in * atlas) -> t_texture {
+    let mips = generate_mips(&atlas->image);
+    
+    // the levels past the safe ones would mix neighbouring regions, they aren't uploaded
+    mips.level_count = m_clamp(atlas->level_count, 1u, mips.level_count);
+    
+    let texture = create_texture(&mips);
+    free_mips(&mips);
+    
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    
+    return texture;
+}
+
+function place_in_atlas(t_node __in * node, t_atlas_region __in * region, t_texture texture, t_mesh __out * mesh) -> void {
+    let source = node->mesh->vertices;
+    let vertices = static_cast<t_vertex *>(std::malloc(sizeof(t_vertex) * source.length()));
+    
+    for (u64 i = 0; i < source.length(); i += 1) {
+        vertices[i] = source[i];
+        vertices[i].uv = region->uv_offset + source[i].uv * region->uv_scale;
+    }
+    
+    *mesh = create_mesh({ .ptr = vertices, .len = source.len }, node->mesh->indices);
+    std::free(vertices);
+    
+    node->mesh = mesh;
+    node->texture = texture;
+}
@@ -0,0 +1,46 @@
+#ifndef __learngl_atlas__
+#define __learngl_atlas__
+
+#include "common.hh"
+#include "image.hh"
+#include "render.hh"
+
+// many small images packed into one texture, so that nodes using them draw without
+// rebinding. every image is surrounded by copies of its edge texels, padding wide,
+// and the mip chain stops before filtering would reach across into a neighbour.
+// uvs can't repeat inside an atlas, meshes placed in one should stay in 0..1
+struct t_atlas_region {
+    int x; // of the image itself, inside its padding
+    int y;
+    int width;
+    int height;
+    vec2 uv_offset; // atlas uv = uv_offset + image uv * uv_scale
+    vec2 uv_scale;
+};
+
+struct t_atlas {
+    t_image image; // 3 channels, owned by storage, not to be freed with free_image
+    uint level_count; // mips that stay clear of the neighbouring regions
+    t_slice<t_atlas_region> regions; // one per image, in the order they were given
+    
+    void * storage; // null if packing or loading failed
+};
+
+// skyline packing, tallest images first, into the smallest power of two size up to
+// max_size they fit in. the images must have 3 channels
+function pack_atlas(t_slice<t_image> images, int padding, int max_size) -> t_atlas;
+function free_atlas(t_atlas __in * atlas) -> void;
+
+function save_atlas(char const * path, t_atlas __in * atlas) -> bool32;
+// paths are looked up in the asset pack first
+function load_atlas(char const * path) -> t_atlas;
+function load_atlas(t_slice<u8 const> file) -> t_atlas;
+
+// only the safe mip levels, clamped at the edges
+function create_atlas_texture(t_atlas __in * atlas) -> t_texture;
+
+// gives the node a copy of its mesh with the uvs moved into the region, drawn with the
+// atlas texture
+function place_in_atlas(t_node __in * node, t_atlas_region __in * region, t_texture texture, t_mesh __out * mesh) -> void;
+
+#endif // __learngl_atlas__
@@ -0,0 +1,571 @@
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "compress.hh"
+#include "jobs.hh"
+#include "mips.hh"
+#include "pack.hh"
+
+namespace {
+    // the container is modelled on ktx2: a fixed header, a level index, then the
+    // level payloads, each aligned so they can be handed to the driver as they are
+    u8 const file_magic[8] = { 0xAB, 'L', 'T', 'X', ' ', '1', 0xBB, '\n' };
+    constexpr u64 payload_alignment = 16;
+    
+    struct t_file_header {
+        u8 magic[8];
+        uint32 format;
+        uint32 width;
+        uint32 height;
+        uint32 level_count;
+    };
+    
+    struct t_file_level {
+        u64 offset;
+        u64 size;
+    };
+    
+    inline function align(u64 value, u64 alignment) -> u64 {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+    
+    inline function block_size(t_block_format format) -> u64 {
+        return format == t_block_format::bc1 ? 8 : 16;
+    }
+    
+    inline function level_size(t_block_format format, int width, int height) -> u64 {
+        return (u64) ((width + 3) / 4) * ((height + 3) / 4) * block_size(format);
+    }
+    
+    inline function clamp_int(float value, int lo, int hi) -> int {
+        let rounded = (int) std::floorf(value + 0.5f);
+        return rounded < lo ? lo : rounded > hi ? hi : rounded;
+    }
+    
+    // 4x4 texels, edge blocks repeat the last row / column
+    struct t_block {
+        float texels[16][3];
+    };
+    
+    function fetch_block(t_image __in * image, int bx, int by) -> t_block {
+        t_block block;
+        
+        for (int y = 0; y < 4; y += 1) {
+            for (int x = 0; x < 4; x += 1) {
+                let sx = m_clamp(bx * 4 + x, 0, image->width - 1);
+                let sy = m_clamp(by * 4 + y, 0, image->height - 1);
+                let texel = image->pixels + ((u64) sy * image->width + sx) * 3;
+                
+                for (int c = 0; c < 3; c += 1) {
+                    block.texels[y * 4 + x][c] = texel[c];
+                }
+            }
+        }
+        
+        return block;
+    }
+    
+    inline function distance2(float const a[3], float const b[3]) -> float {
+        let r = a[0] - b[0];
+        let g = a[1] - b[1];
+        let b_ = a[2] - b[2];
+        return r * r + g * g + b_ * b_;
+    }
+    
+    // endpoints along the principal axis of the block's colours, pulled in slightly
+    // since the extremes are rarely where the error is lowest
+    function principal_endpoints(t_block __in * block, float e0[3], float e1[3]) -> void {
+        float mean[3] = {};
+        
+        for (int i = 0; i < 16; i += 1) {
+            for (int c = 0; c < 3; c += 1) mean[c] += block->texels[i][c] / 16.f;
+        }
+        
+        float covariance[6] = {}; // rr rg rb gg gb bb
+        
+        for (int i = 0; i < 16; i += 1) {
+            let r = block->texels[i][0] - mean[0];
+            let g = block->texels[i][1] - mean[1];
+            let b = block->texels[i][2] - mean[2];
+            
+            covariance[0] += r * r;
+            covariance[1] += r * g;
+            covariance[2] += r * b;
+            covariance[3] += g * g;
+            covariance[4] += g * b;
+            covariance[5] += b * b;
+        }
+        
+        float axis[3] = { 0.577f, 0.577f, 0.577f };
+        
+        for (int iteration = 0; iteration < 8; iteration += 1) {
+            float next[3] = {
+                covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+                covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+                covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2],
+            };
+            
+            let length = std::sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+            if (length < epsilon) break;
+            
+            for (int c = 0; c < 3; c += 1) axis[c] = next[c] / length;
+        }
+        
+        float lo = 0.f;
+        float hi = 0.f;
+        
+        for (int i = 0; i < 16; i += 1) {
+            let t =
+                (block->texels[i][0] - mean[0]) * axis[0] +
+                (block->texels[i][1] - mean[1]) * axis[1] +
+                (block->texels[i][2] - mean[2]) * axis[2];
+            
+            lo = t < lo ? t : lo;
+            hi = t > hi ? t : hi;
+        }
+        
+        let inset = (hi - lo) / 16.f;
+        lo += inset;
+        hi -= inset;
+        
+        for (int c = 0; c < 3; c += 1) {
+            e0[c] = m_clamp(mean[c] + axis[c] * hi, 0.f, 255.f);
+            e1[c] = m_clamp(mean[c] + axis[c] * lo, 0.f, 255.f);
+        }
+    }
+    
+    // least squares endpoints for fixed interpolation weights, where weights[i]
+    // is how much of e1 texel i gets. false if the system is degenerate
+    function refit_endpoints(t_block __in * block, float const weights[16], float e0[3], float e1[3]) -> bool32 {
+        float aa = 0.f, ab = 0.f, bb = 0.f;
+        float ax[3] = {}, bx[3] = {};
+        
+        for (int i = 0; i < 16; i += 1) {
+            let b = weights[i];
+            let a = 1.f - b;
+            
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            
+            for (int c = 0; c < 3; c += 1) {
+                ax[c] += a * block->texels[i][c];
+                bx[c] += b * block->texels[i][c];
+            }
+        }
+        
+        let determinant = aa * bb - ab * ab;
+        if (std::fabsf(determinant) < epsilon) return false;
+        
+        for (int c = 0; c < 3; c += 1) {
+            e0[c] = m_clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.f, 255.f);
+            e1[c] = m_clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.f, 255.f);
+        }
+        
+        return true;
+    }
+    
+    namespace bc1 {
+        inline function pack(float const color[3]) -> u16 {
+            return (u16) (
+                clamp_int(color[0] * 31.f / 255.f, 0, 31) << 11 |
+                clamp_int(color[1] * 63.f / 255.f, 0, 63) << 5 |
+                clamp_int(color[2] * 31.f / 255.f, 0, 31)
+            );
+        }
+        
+        inline function unpack(u16 packed, float color[3]) -> void {
+            let r = (packed >> 11) & 31;
+            let g = (packed >> 5) & 63;
+            let b = packed & 31;
+            
+            color[0] = (float) (r << 3 | r >> 2);
+            color[1] = (float) (g << 2 | g >> 4);
+            color[2] = (float) (b << 3 | b >> 2);
+        }
+        
+        struct t_encoding {
+            u16 color0;
+            u16 color1;
+            uint32 indices;
+            float error;
+            float weights[16];
+        };
+        
+        // always four colour mode, so color0 > color1 unless both are equal
+        function encode(t_block __in * block, u16 color0, u16 color1) -> t_encoding {
+            if (color0 < color1) {
+                let swap = color0;
+                color0 = color1;
+                color1 = swap;
+            }
+            
+            t_encoding encoding = { .color0 = color0, .color1 = color1 };
+            
+            float palette[4][3];
+            unpack(color0, palette[0]);
+            unpack(color1, palette[1]);
+            
+            for (int c = 0; c < 3; c += 1) {
+                palette[2][c] = (2.f * palette[0][c] + palette[1][c]) / 3.f;
+                palette[3][c] = (palette[0][c] + 2.f * palette[1][c]) / 3.f;
+            }
+            
+            float static const weights[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+            let count = color0 == color1 ? 1 : 4;
+            
+            for (int i = 0; i < 16; i += 1) {
+                uint best = 0;
+                float best_error = distance2(block->texels[i], palette[0]);
+                
+                for (int p = 1; p < count; p += 1) {
+                    let error = distance2(block->texels[i], palette[p]);
+                    
+                    if (error < best_error) {
+                        best = p;
+                        best_error = error;
+                    }
+                }
+                
+                encoding.indices |= best << (2 * i);
+                encoding.error += best_error;
+                encoding.weights[i] = weights[best];
+            }
+            
+            return encoding;
+        }
+        
+        function compress_block(t_block __in * block, u8 * out) -> void {
+            float e0[3], e1[3];
+            principal_endpoints(block, e0, e1);
+            
+            let best = encode(block, pack(e0), pack(e1));
+            
+            if (refit_endpoints(block, best.weights, e0, e1)) {
+                let refit = encode(block, pack(e0), pack(e1));
+                if (refit.error < best.error) best = refit;
+            }
+            
+            out[0] = (u8) (best.color0 & 0xFF);
+            out[1] = (u8) (best.color0 >> 8);
+            out[2] = (u8) (best.color1 & 0xFF);
+            out[3] = (u8) (best.color1 >> 8);
+            std::memcpy(out + 4, &best.indices, 4);
+        }
+    }
+    
+    namespace bc7 {
+        int const weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+        
+        // an endpoint is 7 bits per channel plus a p-bit shared by its channels, alpha
+        // included. alpha is 127 with a p-bit of 1, so that it decodes to exactly 255 and
+        // opaque images stay opaque; the colours make do with odd values
+        struct t_endpoint {
+            int rgba[4];
+            int p;
+        };
+        
+        function quantize(float const color[3]) -> t_endpoint {
+            t_endpoint endpoint = { .p = 1 };
+            
+            for (int c = 0; c < 3; c += 1) {
+                endpoint.rgba[c] = clamp_int((color[c] - 1.f) / 2.f, 0, 127);
+            }
+            
+            endpoint.rgba[3] = 127;
+            
+            return endpoint;
+        }
+        
+        inline function expand(t_endpoint __in * endpoint, int c) -> int {
+            return endpoint->rgba[c] << 1 | endpoint->p;
+        }
+        
+        struct t_encoding {
+            t_endpoint e0;
+            t_endpoint e1;
+            u8 indices[16];
+            float error;
+            float weights[16];
+        };
+        
+        function encode(t_block __in * block, t_endpoint e0, t_endpoint e1) -> t_encoding {
+            t_encoding encoding = { .e0 = e0, .e1 = e1 };
+            
+            // alpha is 255 all the way along, only the colours are interpolated
+            float palette[16][3];
+            
+            for (int i = 0; i < 16; i += 1) {
+                for (int c = 0; c < 3; c += 1) {
+                    palette[i][c] = (float) (((64 - weights[i]) * expand(&e0, c) + weights[i] * expand(&e1, c) + 32) >> 6);
+                }
+            }
+            
+            for (int i = 0; i < 16; i += 1) {
+                uint best = 0;
+                float best_error = distance2(block->texels[i], palette[0]);
+                
+                for (int p = 1; p < 16; p += 1) {
+                    let error = distance2(block->texels[i], palette[p]);
+                    
+                    if (error < best_error) {
+                        best = p;
+                        best_error = error;
+                    }
+                }
+                
+                encoding.indices[i] = (u8) best;
+                encoding.error += best_error;
+                encoding.weights[i] = weights[best] / 64.f;
+            }
+            
+            return encoding;
+        }
+        
+        inline function put_bits(u8 * out, int * bit, uint value, int count) -> void {
+            for (int i = 0; i < count; i += 1, *bit += 1) {
+                out[*bit >> 3] |= ((value >> i) & 1) << (*bit & 7);
+            }
+        }
+        
+        function compress_block(t_block __in * block, u8 * out) -> void {
+            float e0[3], e1[3];
+            principal_endpoints(block, e0, e1);
+            
+            let best = encode(block, quantize(e0), quantize(e1));
+            
+            if (refit_endpoints(block, best.weights, e0, e1)) {
+                let refit = encode(block, quantize(e0), quantize(e1));
+                if (refit.error < best.error) best = refit;
+            }
+            
+            // the msb of the first index is implicit zero, flip the endpoints to make it so
+            if (best.indices[0] & 8) {
+                let swap = best.e0;
+                best.e0 = best.e1;
+                best.e1 = swap;
+                
+                for (int i = 0; i < 16; i += 1) {
+                    best.indices[i] = 15 - best.indices[i];
+                }
+            }
+            
+            std::memset(out, 0, 16);
+            int bit = 0;
+            
+            put_bits(out, &bit, 1 << 6, 7);
+            
+            for (int c = 0; c < 4; c += 1) {
+                put_bits(out, &bit, best.e0.rgba[c], 7);
+                put_bits(out, &bit, best.e1.rgba[c], 7);
+            }
+            
+            put_bits(out, &bit, best.e0.p, 1);
+            put_bits(out, &bit, best.e1.p, 1);
+            put_bits(out, &bit, best.indices[0], 3);
+            
+            for (int i = 1; i < 16; i += 1) {
+                put_bits(out, &bit, best.indices[i], 4);
+            }
+        }
+    }
+    
+    struct t_level_job {
+        t_image * image;
+        u8 * out;
+        t_block_format format;
+    };
+    
+    function compress_block_row(void * data, u64 row) -> void {
+        let job = static_cast<t_level_job *>(data);
+        let blocks_x = (job->image->width + 3) / 4;
+        let size = block_size(job->format);
+        
+        for (int x = 0; x < blocks_x; x += 1) {
+            let block = fetch_block(job->image, x, (int) row);
+            let out = job->out + (row * blocks_x + x) * size;
+            
+            if (job->format == t_block_format::bc1) {
+                bc1::compress_block(&block, out);
+            } else {
+                bc7::compress_block(&block, out);
+            }
+        }
+    }
+}
+
+function compress_image(t_image __in * image, t_block_format format) -> t_compressed_texture {
+    m_assert(image->channels == 3);
+    
+    t_compressed_texture texture = {
+        .format = format,
+        .width = image->width,
+        .height = image->height,
+    };
+    
+    let mips = generate_mips(image);
+    
+    u64 total = 0;
+    
+    for (uint i = 0; i < mips.level_count; i += 1) {
+        texture.levels[i] = {
+            .width = mips.levels[i].width,
+            .height = mips.levels[i].height,
+            .data = null,
+            .size = level_size(format, mips.levels[i].width, mips.levels[i].height),
+        };
+        
+        total += align(texture.levels[i].size, payload_alignment);
+    }
+    
+    texture.level_count = mips.level_count;
+    texture.storage = std::malloc(total);
+    
+    let cursor = static_cast<u8 *>(texture.storage);
+    
+    for (uint i = 0; i < texture.level_count; i += 1) {
+        let level = &texture.levels[i];
+        level->data = cursor;
+        
+        t_level_job job = { .image = &mips.levels[i], .out = cursor, .format = format };
+        jobs::parallel_for((level->height + 3) / 4, compress_block_row, &job);
+        
+        cursor += align(level->size, payload_alignment);
+    }
+    
+    free_mips(&mips);
+    
+    return texture;
+}
+
+function free_compressed_texture(t_compressed_texture __in * texture) -> void {
+    std::free(texture->storage);
+    texture->storage = null;
+}
+
+function save_compressed_texture(char const * path, t_compressed_texture __in * texture) -> bool32 {
+    let file = std::fopen(path, "wb");
+    if (!file) return false;
+    
+    t_file_header header = {
+        .format = (uint32) texture->format,
+        .width = (uint32) texture->width,
+        .height = (uint32) texture->height,
+        .level_count = texture->level_count,
+    };
+    
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    
+    t_file_level index[t_compressed_texture::max_levels];
+    u64 offset = align(sizeof(header) + sizeof(t_file_level) * texture->level_count, payload_alignment);
+    
+    for (uint i = 0; i < texture->level_count; i += 1) {
+        index[i] = { .offset = offset, .size = texture->levels[i].size };
+        offset = align(offset + texture->levels[i].size, payload_alignment);
+    }
+    
+    u8 static const padding[payload_alignment] = {};
+    
+    bool32 ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && std::fwrite(index, sizeof(t_file_level), texture->level_count, file) == texture->level_count;
+    
+    u64 written = sizeof(header) + sizeof(t_file_level) * texture->level_count;
+    
+    for (uint i = 0; ok && i < texture->level_count; i += 1) {
+        ok = std::fwrite(padding, 1, index[i].offset - written, file) == index[i].offset - written;
+        ok = ok && std::fwrite(texture->levels[i].data, 1, index[i].size, file) == index[i].size;
+        written = index[i].offset + index[i].size;
+    }
+    
+    std::fclose(file);
+    
+    return ok;
+}
+
+function load_compressed_texture(char const * path) -> t_compressed_texture {
+    let packed = pack::find(path);
+    if (packed.ptr) return load_compressed_texture(packed);
+    
+    let file = std::fopen(path, "rb");
+    if (!file) return {};
+    
+    std::fseek(file, 0, SEEK_END);
+    let size = (u64) std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    
+    let data = static_cast<u8 *>(std::malloc(size));
+    let ok = std::fread(data, 1, size, file) == size;
+    std::fclose(file);
+    
+    let texture = ok ? load_compressed_texture({ .ptr = data, .len = size }) : t_compressed_texture {};
+    
+    if (texture.level_count == 0) {
+        std::free(data);
+        return {};
+    }
+    
+    texture.storage = data;
+    
+    return texture;
+}
+
+function load_compressed_texture(t_slice<u8 const> file) -> t_compressed_texture {
+    t_file_header header;
+    
+    if (file.length() < sizeof(header)) return {};
+    std::memcpy(&header, file.ptr, sizeof(header));
+    
+    let ok = std::memcmp(header.magic, file_magic, sizeof(file_magic)) == 0;
+    ok = ok && header.level_count > 0 && header.level_count <= t_compressed_texture::max_levels;
+    
+    // the format picks the gl internal format and the level sizes, anything else is garbage
+    ok = ok && (header.format == (uint32) t_block_format::bc1 || header.format == (uint32) t_block_format::bc7);
+    ok = ok && header.width > 0 && header.height > 0 && header.width <= 0x8000 && header.height <= 0x8000;
+    ok = ok && file.length() >= sizeof(header) + sizeof(t_file_level) * header.level_count;
+    
+    if (!ok) return {};
+    
+    t_compressed_texture texture = {
+        .format = (t_block_format) header.format,
+        .width = (int) header.width,
+        .height = (int) header.height,
+        .level_count = header.level_count,
+        .storage = null,
+    };
+    
+    for (uint i = 0; i < header.level_count; i += 1) {
+        t_file_level entry;
+        std::memcpy(&entry, file.ptr + sizeof(header) + sizeof(t_file_level) * i, sizeof(entry));
+        
+        let width = texture.width >> i > 0 ? texture.width >> i : 1;
+        let height = texture.height >> i > 0 ? texture.height >> i : 1;
+        
+        if (entry.offset > file.length() || entry.size > file.length() - entry.offset || entry.size != level_size(texture.format, width, height)) {
+            return {};
+        }
+        
+        texture.levels[i] = { .width = width, .height = height, .data = file.ptr + entry.offset, .size = entry.size };
+    }
+    
+    return texture;
+}
+
+function is_compressed_texture_file(char const * path) -> bool32 {
+    let packed = pack::find(path);
+    
+    if (packed.ptr) {
+        return packed.length() >= sizeof(file_magic) && std::memcmp(packed.ptr, file_magic, sizeof(file_magic)) == 0;
+    }
+    
+    let file = std::fopen(path, "rb");
+    if (!file) return false;
+    
+    u8 magic[sizeof(file_magic)];
+    let ok = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic);
+    std::fclose(file);
+    
+    return ok && std::memcmp(magic, file_magic, sizeof(file_magic)) == 0;
+}
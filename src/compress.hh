@@ -0,0 +1,46 @@
+#ifndef __learngl_compress__
+#define __learngl_compress__
+
+#include "common.hh"
+#include "image.hh"
+
+// gpu block compression of rgb images and the file container holding the result.
+// bc1 stores a 4x4 block in 8 bytes, bc7 in 16 bytes with far less banding (only
+// mode 6 is used, a single subset with 4 bit indices, which suits opaque images)
+enum struct t_block_format : uint32 {
+    bc1 = 1,
+    bc7 = 2,
+};
+
+struct t_compressed_level {
+    int width;
+    int height;
+    u8 const * data;
+    u64 size;
+};
+
+struct t_compressed_texture {
+    static constexpr uint max_levels = 16;
+    
+    t_block_format format;
+    int width;
+    int height;
+    uint level_count;
+    t_compressed_level levels[max_levels];
+    
+    // owns the data of every level. null when the levels point into memory owned
+    // by someone else, like the asset pack. level_count is zero if loading failed
+    void * storage;
+};
+
+// encodes the full mip chain, block rows are spread over the job workers
+function compress_image(t_image __in * image, t_block_format format) -> t_compressed_texture;
+function free_compressed_texture(t_compressed_texture __in * texture) -> void;
+
+function save_compressed_texture(char const * path, t_compressed_texture __in * texture) -> bool32;
+// paths are looked up in the asset pack first, packed textures are used in place
+function load_compressed_texture(char const * path) -> t_compressed_texture;
+function load_compressed_texture(t_slice<u8 const> file) -> t_compressed_texture;
+function is_compressed_texture_file(char const * path) -> bool32;
+
+#endif // __learngl_compress__
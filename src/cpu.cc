@@ -0,0 +1,35 @@
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "cpu.hh"
+
+namespace {
+    function detect_avx2() -> bool32 {
+        #if defined(_MSC_VER)
+        int info[4];
+        
+        __cpuid(info, 0);
+        if (info[0] < 7) return false;
+        
+        __cpuid(info, 1);
+        let osxsave = (info[2] >> 27) & 1;
+        let avx = (info[2] >> 28) & 1;
+        if (!osxsave || !avx) return false;
+        
+        // the os has to save the ymm registers too
+        if ((_xgetbv(0) & 6) != 6) return false;
+        
+        __cpuidex(info, 7, 0);
+        return (info[1] >> 5) & 1;
+        #else
+        return __builtin_cpu_supports("avx2");
+        #endif
+    }
+}
+
+function cpu::has_avx2() -> bool32 {
+    bool32 static const avx2 = detect_avx2();
+    return avx2;
+}
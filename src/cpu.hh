@@ -0,0 +1,18 @@
+#ifndef __learngl_cpu__
+#define __learngl_cpu__
+
+#include "common.hh"
+
+// instruction set extensions are only used behind a runtime check, the build
+// itself targets baseline x64. functions using them are marked m_target_avx2
+#if defined(_MSC_VER)
+#define m_target_avx2
+#else
+#define m_target_avx2 __attribute__((target("avx2")))
+#endif
+
+namespace cpu {
+    function has_avx2() -> bool32;
+};
+
+#endif // __learngl_cpu__
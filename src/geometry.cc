@@ -0,0 +1,427 @@
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "geometry.hh"
+#include "primitives.hh"
+
+namespace {
+    function allocate(u64 vertex_count, u64 index_count) -> t_geometry {
+        let storage = std::malloc(sizeof(t_vertex) * vertex_count + sizeof(uint32) * index_count);
+        let vertices = static_cast<t_vertex *>(storage);
+        
+        return {
+            .vertices = { .ptr = vertices, .len = vertex_count },
+            .indices = { .ptr = reinterpret_cast<uint32 *>(vertices + vertex_count), .len = index_count },
+            .storage = storage,
+        };
+    }
+    
+    // count + 1 evenly spaced angles from 0 to range. a grid's vertices take their sines and
+    // cosines from one of these for its columns and one for its rows, so the trig is paid per
+    // row and column instead of per vertex
+    struct t_angles {
+        std::vector<float> sin;
+        std::vector<float> cos;
+    };
+    
+    function angles(uint count, float range) -> t_angles {
+        t_angles result = { std::vector<float>(count + 1), std::vector<float>(count + 1) };
+        
+        for (uint i = 0; i <= count; i += 1) {
+            let angle = range * (float) i / (float) count;
+            result.sin[i] = std::sin(angle);
+            result.cos[i] = std::cos(angle);
+        }
+        
+        // exactly where they started, so that the seam's vertices meet
+        if (range == tau) {
+            result.sin[count] = result.sin[0];
+            result.cos[count] = result.cos[0];
+        }
+        
+        return result;
+    }
+    
+    // two triangles for each quad of a (columns + 1) by (rows + 1) grid of vertices laid
+    // out row after row from first. front facing when the rows run down and the columns
+    // to the right. returns past the last index written
+    function grid_indices(uint32 __out * indices, uint32 first, uint columns, uint rows) -> uint32 * {
+        for (uint y = 0; y < rows; y += 1) {
+            for (uint x = 0; x < columns; x += 1) {
+                let top = first + y * (columns + 1) + x;
+                let bottom = top + columns + 1;
+                
+                *indices++ = bottom;
+                *indices++ = top + 1;
+                *indices++ = top;
+                
+                *indices++ = bottom;
+                *indices++ = bottom + 1;
+                *indices++ = top + 1;
+            }
+        }
+        
+        return indices;
+    }
+    
+    // the midpoints of the edges one subdivision splits, shared by the two triangles on
+    // either side of each. an edge is kept with its lower numbered vertex, which has at most
+    // six neighbours on a subdivided icosahedron. much friendlier to the cache than hashing
+    // the edges, the vertices of neighbouring triangles are numbered close together
+    struct t_midpoints {
+        static constexpr uint max_neighbours = 6;
+        
+        function find(uint32 a, uint32 b, std::vector<vec3> * positions) -> uint32;
+        
+        std::vector<uint32> neighbours; // max_neighbours for each vertex
+        std::vector<uint32> midpoints;
+        std::vector<u8> counts;
+    };
+    
+    function t_midpoints::find(uint32 a, uint32 b, std::vector<vec3> * positions) -> uint32 {
+        let low = a < b ? a : b;
+        let high = a < b ? b : a;
+        
+        let first = (u64) low * max_neighbours;
+        let count = counts[low];
+        
+        for (uint i = 0; i < count; i += 1) {
+            if (neighbours[first + i] == high) return midpoints[first + i];
+        }
+        
+        m_assert(count < max_neighbours);
+        
+        let midpoint = (uint32) positions->size();
+        positions->push_back(glm::normalize((*positions)[a] + (*positions)[b]));
+        
+        neighbours[first + count] = high;
+        midpoints[first + count] = midpoint;
+        counts[low] = count + 1;
+        
+        return midpoint;
+    }
+}
+
+function free_geometry(t_geometry __in * geometry) -> void {
+    std::free(geometry->storage);
+    *geometry = {};
+}
+
+function generate_box() -> t_geometry {
+    let box = allocate(24, 36);
+    
+    std::memcpy(box.vertices.ptr, primitives::box.vertices, sizeof(primitives::box.vertices));
+    std::memcpy(box.indices.ptr, primitives::box.indices, sizeof(primitives::box.indices));
+    
+    return box;
+}
+
+function generate_sphere(uint longitude_segments, uint latitude_segments) -> t_geometry {
+    m_assert(longitude_segments >= 3 && latitude_segments >= 2);
+    
+    // a row for each latitude, the first and last at the poles. those rows' quads are
+    // single triangles
+    let columns = longitude_segments + 1;
+    let vertex_count = (u64) columns * (latitude_segments + 1);
+    let index_count = (u64) 6 * longitude_segments * (latitude_segments - 1);
+    
+    let sphere = allocate(vertex_count, index_count);
+    
+    let around = angles(longitude_segments, tau);
+    let down = angles(latitude_segments, pi);
+    
+    // the poles exactly on the axis, not a rounding error off it
+    down.sin[0] = 0.f;
+    down.sin[latitude_segments] = 0.f;
+    
+    let vertex = sphere.vertices.ptr;
+    
+    for (uint y = 0; y <= latitude_segments; y += 1) {
+        for (uint x = 0; x <= longitude_segments; x += 1) {
+            *vertex++ = {
+                .position = { around.cos[x] * down.sin[y], around.sin[x] * down.sin[y], down.cos[y] },
+                .uv = { (float) x / (float) longitude_segments, (float) y / (float) latitude_segments },
+            };
+        }
+    }
+    
+    let index = sphere.indices.ptr;
+    
+    for (uint y = 0; y < latitude_segments; y += 1) {
+        for (uint x = 0; x < longitude_segments; x += 1) {
+            let top = y * columns + x;
+            let bottom = top + columns;
+            
+            if (y != 0) {
+                *index++ = bottom;
+                *index++ = top + 1;
+                *index++ = top;
+            }
+            
+            if (y != latitude_segments - 1) {
+                *index++ = bottom;
+                *index++ = bottom + 1;
+                *index++ = top + 1;
+            }
+        }
+    }
+    
+    return sphere;
+}
+
+function generate_icosphere(uint subdivisions) -> t_geometry {
+    m_assert(subdivisions <= 10); // 20 million triangles
+    
+    constexpr float phi = 1.618033988f;
+    
+    // twenty faces: the vertices' count is 10 * 4^n + 2 and the triangles' 20 * 4^n
+    let scale = (u64) 1 << 2 * subdivisions;
+    let vertex_count = 10 * scale + 2;
+    let triangle_count = 20 * scale;
+    
+    std::vector<vec3> positions = {
+        { -1.f, phi, 0.f }, { 1.f, phi, 0.f }, { -1.f, -phi, 0.f }, { 1.f, -phi, 0.f },
+        { 0.f, -1.f, phi }, { 0.f, 1.f, phi }, { 0.f, -1.f, -phi }, { 0.f, 1.f, -phi },
+        { phi, 0.f, -1.f }, { phi, 0.f, 1.f }, { -phi, 0.f, -1.f }, { -phi, 0.f, 1.f },
+    };
+    
+    positions.reserve(vertex_count);
+    for (auto & position : positions) position = glm::normalize(position);
+    
+    std::vector<uint32> triangles = {
+        0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+        1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+        3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+        4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1,
+    };
+    
+    std::vector<uint32> split;
+    
+    for (uint level = 0; level < subdivisions; level += 1) {
+        let slots = positions.size() * t_midpoints::max_neighbours;
+        t_midpoints midpoints = { std::vector<uint32>(slots), std::vector<uint32>(slots), std::vector<u8>(positions.size()) };
+        
+        split.resize(triangles.size() * 4);
+        let out = split.data();
+        
+        for (u64 i = 0; i < triangles.size(); i += 3) {
+            let a = triangles[i];
+            let b = triangles[i + 1];
+            let c = triangles[i + 2];
+            
+            let ab = midpoints.find(a, b, &positions);
+            let bc = midpoints.find(b, c, &positions);
+            let ca = midpoints.find(c, a, &positions);
+            
+            uint32 const four[] = { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca };
+            std::memcpy(out, four, sizeof(four));
+            out += 12;
+        }
+        
+        triangles.swap(split);
+    }
+    
+    m_assert(positions.size() == vertex_count && triangles.size() == triangle_count * 3);
+    
+    // the uvs. a triangle across the seam, where u wraps from 1 back to 0, gets copies of
+    // its vertices on the 0 side moved to 1, shared with the other triangles there. u is
+    // meaningless at the poles, each triangle gets its own pole vertex with the u of its
+    // other two. worked out on the us alone, which are much smaller than the vertices
+    constexpr float pole = -1.f;
+    
+    std::vector<float> us(vertex_count);
+    
+    for (u64 i = 0; i < vertex_count; i += 1) {
+        let position = positions[i];
+        let at_pole = std::fabs(position.x) < 1e-6f && std::fabs(position.y) < 1e-6f;
+        
+        let u = std::atan2(position.y, position.x) / tau;
+        
+        us[i] = at_pole ? pole : u < 0.f ? u + 1.f : u;
+    }
+    
+    // the copies, each of which vertex with what u
+    struct t_copy {
+        uint32 vertex;
+        float u;
+    };
+    
+    std::vector<t_copy> copies;
+    std::vector<uint32> wrapped(vertex_count, ~0u);
+    
+    for (u64 i = 0; i < triangles.size(); i += 3) {
+        let corners = &triangles[i];
+        
+        float low = 1.f;
+        float high = 0.f;
+        
+        for (int k = 0; k < 3; k += 1) {
+            let u = us[corners[k]];
+            if (u == pole) continue;
+            
+            low = std::fmin(low, u);
+            high = std::fmax(high, u);
+        }
+        
+        float corner_us[3];
+        
+        for (int k = 0; k < 3; k += 1) {
+            let corner = corners[k];
+            corner_us[k] = us[corner];
+            
+            if (high - low <= 0.5f || corner_us[k] == pole || corner_us[k] >= 0.5f) continue;
+            
+            if (wrapped[corner] == ~0u) {
+                wrapped[corner] = (uint32) (vertex_count + copies.size());
+                copies.push_back({ corner, corner_us[k] + 1.f });
+            }
+            
+            corners[k] = wrapped[corner];
+            corner_us[k] += 1.f;
+        }
+        
+        for (int k = 0; k < 3; k += 1) {
+            if (corner_us[k] != pole) continue;
+            
+            copies.push_back({ corners[k], (corner_us[(k + 1) % 3] + corner_us[(k + 2) % 3]) * 0.5f });
+            corners[k] = (uint32) (vertex_count + copies.size() - 1);
+        }
+    }
+    
+    let sphere = allocate(vertex_count + copies.size(), triangles.size());
+    
+    for (u64 i = 0; i < vertex_count; i += 1) {
+        let v = std::acos(m_clamp(positions[i].z, -1.f, 1.f)) / pi;
+        sphere.vertices[i] = { .position = positions[i], .uv = { us[i] == pole ? 0.f : us[i], v } };
+    }
+    
+    for (u64 i = 0; i < copies.size(); i += 1) {
+        let vertex = &sphere.vertices[vertex_count + i];
+        *vertex = sphere.vertices[copies[i].vertex];
+        vertex->uv.x = copies[i].u;
+    }
+    
+    std::memcpy(sphere.indices.ptr, triangles.data(), sizeof(uint32) * triangles.size());
+    
+    return sphere;
+}
+
+function generate_cylinder(uint segments) -> t_geometry {
+    m_assert(segments >= 3);
+    
+    // the side is a two row grid, each cap a centre and its own ring, for their own uvs
+    let side_vertices = (u64) (segments + 1) * 2;
+    let cap_vertices = (u64) segments + 2;
+    
+    let cylinder = allocate(side_vertices + cap_vertices * 2, (u64) 6 * segments + (u64) 3 * segments * 2);
+    let around = angles(segments, tau);
+    
+    let vertex = cylinder.vertices.ptr;
+    
+    for (uint y = 0; y <= 1; y += 1) {
+        for (uint x = 0; x <= segments; x += 1) {
+            *vertex++ = {
+                .position = { around.cos[x] * 0.5f, around.sin[x] * 0.5f, 0.5f - (float) y },
+                .uv = { (float) x / (float) segments, (float) y },
+            };
+        }
+    }
+    
+    let index = grid_indices(cylinder.indices.ptr, 0, segments, 1);
+    
+    for (int cap = 0; cap < 2; cap += 1) {
+        let z = cap == 0 ? 0.5f : -0.5f;
+        let centre = (uint32) (vertex - cylinder.vertices.ptr);
+        
+        *vertex++ = { .position = { 0.f, 0.f, z }, .uv = { 0.5f, 0.5f } };
+        
+        for (uint x = 0; x <= segments; x += 1) {
+            *vertex++ = {
+                .position = { around.cos[x] * 0.5f, around.sin[x] * 0.5f, z },
+                .uv = { 0.5f + around.cos[x] * 0.5f, 0.5f - around.sin[x] * 0.5f },
+            };
+        }
+        
+        // counter clockwise seen from above for the top, the other way for the bottom
+        for (uint x = 0; x < segments; x += 1) {
+            *index++ = centre;
+            *index++ = centre + 1 + x + (cap == 0 ? 0 : 1);
+            *index++ = centre + 1 + x + (cap == 0 ? 1 : 0);
+        }
+    }
+    
+    return cylinder;
+}
+
+function generate_torus(uint ring_segments, uint tube_segments, float tube_radius) -> t_geometry {
+    m_assert(ring_segments >= 3 && tube_segments >= 3);
+    
+    let torus = allocate((u64) (ring_segments + 1) * (tube_segments + 1), (u64) 6 * ring_segments * tube_segments);
+    
+    let around = angles(ring_segments, tau);
+    let tube = angles(tube_segments, tau);
+    
+    let vertex = torus.vertices.ptr;
+    
+    // rows around the tube, starting outside and turning under first so that the rows
+    // run down the way grid_indices wants them
+    for (uint y = 0; y <= tube_segments; y += 1) {
+        let distance = 1.f + tube_radius * tube.cos[y];
+        
+        for (uint x = 0; x <= ring_segments; x += 1) {
+            *vertex++ = {
+                .position = { around.cos[x] * distance, around.sin[x] * distance, -tube_radius * tube.sin[y] },
+                .uv = { (float) x / (float) ring_segments, (float) y / (float) tube_segments },
+            };
+        }
+    }
+    
+    grid_indices(torus.indices.ptr, 0, ring_segments, tube_segments);
+    
+    return torus;
+}
+
+function generate_plane(uint columns, uint rows) -> t_geometry {
+    m_assert(columns >= 1 && rows >= 1);
+    
+    let plane = allocate((u64) (columns + 1) * (rows + 1), (u64) 6 * columns * rows);
+    let vertex = plane.vertices.ptr;
+    
+    for (uint y = 0; y <= rows; y += 1) {
+        for (uint x = 0; x <= columns; x += 1) {
+            let uv = vec2 { (float) x / (float) columns, (float) y / (float) rows };
+            *vertex++ = { .position = { uv.x - 0.5f, 0.5f - uv.y, 0.f }, .uv = uv };
+        }
+    }
+    
+    grid_indices(plane.indices.ptr, 0, columns, rows);
+    
+    return plane;
+}
+
+function create_box_mesh() -> t_mesh {
+    let box = generate_box();
+    let mesh = create_mesh(box.vertices, box.indices);
+    free_geometry(&box);
+    
+    return mesh;
+}
+
+function create_icosphere_mesh(uint subdivisions) -> t_mesh {
+    let sphere = generate_icosphere(subdivisions);
+    let mesh = create_mesh(sphere.vertices, sphere.indices);
+    free_geometry(&sphere);
+    
+    return mesh;
+}
+
+function create_sphere_mesh(uint longitude_segments, uint latitude_segments) -> t_mesh {
+    let sphere = generate_sphere(longitude_segments, latitude_segments);
+    let mesh = create_mesh(sphere.vertices, sphere.indices);
+    free_geometry(&sphere);
+    
+    return mesh;
+}
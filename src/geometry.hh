@@ -0,0 +1,44 @@
+#ifndef __learngl_geometry__
+#define __learngl_geometry__
+
+#include "common.hh"
+#include "render.hh"
+
+// cpu side mesh data, as produced by the generators below. each is sized exactly for its
+// parameters and owns one allocation, the indices after the vertices, which free_geometry
+// gives back. every shape faces outwards, counter clockwise, and has unit size.
+// primitives.hh has the same shapes built while compiling
+struct t_geometry {
+    t_slice<t_vertex> vertices;
+    t_slice<uint32> indices;
+    void * storage;
+};
+
+function free_geometry(t_geometry __in * geometry) -> void;
+
+// a face to each side, see primitives.hh for it baked
+function generate_box() -> t_geometry;
+
+// the poles on z, u around it and v from the top. the triangles that would be degenerate
+// at the poles are left out
+function generate_sphere(uint longitude_segments, uint latitude_segments) -> t_geometry;
+
+// an icosahedron with each triangle split in four, subdivisions times, and pushed out onto
+// the sphere. uvs as generate_sphere's, with the vertices on the seam and at the poles
+// doubled up so that no triangle wraps around
+function generate_icosphere(uint subdivisions) -> t_geometry;
+
+// half a unit of radius along z from -0.5 to 0.5, with capped ends
+function generate_cylinder(uint segments) -> t_geometry;
+
+// around z, the tube's centre a unit from it
+function generate_torus(uint ring_segments, uint tube_segments, float tube_radius) -> t_geometry;
+
+// from -0.5 to 0.5 in x and y, facing z
+function generate_plane(uint columns, uint rows) -> t_geometry;
+
+function create_box_mesh() -> t_mesh;
+function create_icosphere_mesh(uint subdivisions) -> t_mesh;
+function create_sphere_mesh(uint longitude_segments, uint latitude_segments) -> t_mesh;
+
+#endif // __learngl_geometry__
@@ -0,0 +1,991 @@
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gltf.hh"
+#include "jobs.hh"
+#include "mapping.hh"
+#include "optimize.hh"
+#include "pack.hh"
+#include "registry.hh"
+#include "residency.hh"
+#include "simplify.hh"
+
+namespace {
+    using t_clock = std::chrono::steady_clock;
+    
+    // as convert_obj's, a half, a quarter and an eighth of the triangles
+    float const lod_ratios[] = { 0.5f, 0.25f, 0.125f };
+    
+    // a json document as a flat array of values, each linked to its first child and
+    // next sibling. strings are views into the text, escapes left in: gltf's keys never
+    // have any, and neither do the uris this reads
+    enum struct t_json_kind : u8 {
+        nil,
+        boolean,
+        number,
+        string,
+        array,
+        object,
+    };
+    
+    struct t_json {
+        t_json_kind kind;
+        bool32 boolean;
+        double number;
+        t_slice<char const> text; // a string's
+        t_slice<char const> key; // a member's
+        uint first; // child, none if it has none
+        uint next;
+    };
+    
+    struct t_json_parser {
+        char const * at;
+        char const * end;
+        std::vector<t_json> * values;
+    };
+    
+    constexpr uint none = 0; // a placeholder, the first value parsed comes after it
+    constexpr uint invalid = ~0u; // what parse_value returns for anything that isn't json
+    constexpr int max_depth = 64;
+    
+    inline function skip_space(t_json_parser __in * parser) -> void {
+        while (parser->at < parser->end && (*parser->at == ' ' || *parser->at == '\t' || *parser->at == '\n' || *parser->at == '\r')) {
+            parser->at += 1;
+        }
+    }
+    
+    inline function parse_string(t_json_parser __in * parser, t_slice<char const> __out * text) -> bool32 {
+        if (parser->at >= parser->end || *parser->at != '"') return false;
+        
+        let start = parser->at + 1;
+        
+        for (parser->at = start; parser->at < parser->end && *parser->at != '"'; parser->at += 1) {
+            if (*parser->at == '\\') parser->at += 1;
+        }
+        
+        if (parser->at >= parser->end) return false;
+        
+        *text = { .ptr = start, .len = (u64) (parser->at - start) };
+        parser->at += 1;
+        
+        return true;
+    }
+    
+    inline function literal(t_json_parser __in * parser, char const * word) -> bool32 {
+        let length = std::strlen(word);
+        if ((u64) (parser->end - parser->at) < length || std::memcmp(parser->at, word, length) != 0) return false;
+        
+        parser->at += length;
+        
+        return true;
+    }
+    
+    // returns the value's index
+    function parse_value(t_json_parser __in * parser, int depth) -> uint {
+        skip_space(parser);
+        if (parser->at >= parser->end || depth > max_depth) return invalid;
+        
+        let index = (uint) parser->values->size();
+        parser->values->push_back({});
+        
+        // the vector grows while the children are parsed, so the value is set through its index
+        let value = [parser, index] () -> t_json & { return (*parser->values)[index]; };
+        let c = *parser->at;
+        
+        if (c == '{' || c == '[') {
+            let object = c == '{';
+            value().kind = object ? t_json_kind::object : t_json_kind::array;
+            parser->at += 1;
+            
+            skip_space(parser);
+            
+            if (parser->at < parser->end && *parser->at == (object ? '}' : ']')) {
+                parser->at += 1;
+                return index;
+            }
+            
+            uint last = none;
+            
+            while (true) {
+                t_slice<char const> key = {};
+                
+                if (object) {
+                    skip_space(parser);
+                    if (!parse_string(parser, &key)) return invalid;
+                    
+                    skip_space(parser);
+                    if (parser->at >= parser->end || *parser->at != ':') return invalid;
+                    parser->at += 1;
+                }
+                
+                let child = parse_value(parser, depth + 1);
+                if (child == invalid) return invalid;
+                
+                (*parser->values)[child].key = key;
+                
+                if (last == none) {
+                    value().first = child;
+                } else {
+                    (*parser->values)[last].next = child;
+                }
+                
+                last = child;
+                
+                skip_space(parser);
+                if (parser->at >= parser->end) return invalid;
+                
+                let separator = *parser->at;
+                parser->at += 1;
+                
+                if (separator == (object ? '}' : ']')) return index;
+                if (separator != ',') return invalid;
+            }
+        }
+        
+        if (c == '"') {
+            value().kind = t_json_kind::string;
+            
+            t_slice<char const> text;
+            if (!parse_string(parser, &text)) return invalid;
+            
+            value().text = text;
+            
+            return index;
+        }
+        
+        if (literal(parser, "true") || literal(parser, "false")) {
+            value().kind = t_json_kind::boolean;
+            value().boolean = c == 't';
+            return index;
+        }
+        
+        if (literal(parser, "null")) return index;
+        
+        // the text isn't terminated, numbers are copied out to be read
+        char number[64];
+        u64 length = 0;
+        
+        while (parser->at < parser->end && length + 1 < sizeof(number) && std::strchr("+-.0123456789eE", *parser->at)) {
+            number[length] = *parser->at;
+            length += 1;
+            parser->at += 1;
+        }
+        
+        number[length] = '\0';
+        
+        char * number_end;
+        value().kind = t_json_kind::number;
+        value().number = std::strtod(number, &number_end);
+        
+        return length && number_end == number + length ? index : invalid;
+    }
+    
+    struct t_document {
+        std::vector<t_json> values;
+    };
+    
+    function member(t_document __in * document, uint object, char const * name) -> uint {
+        if (object == none || document->values[object].kind != t_json_kind::object) return none;
+        
+        let length = std::strlen(name);
+        
+        for (let i = document->values[object].first; i != none; i = document->values[i].next) {
+            let key = document->values[i].key;
+            if (key.length() == length && std::memcmp(key.ptr, name, length) == 0) return i;
+        }
+        
+        return none;
+    }
+    
+    // the values of an array, to be indexed into
+    function elements(t_document __in * document, uint array) -> std::vector<uint> {
+        std::vector<uint> result;
+        if (array == none || document->values[array].kind != t_json_kind::array) return result;
+        
+        for (let i = document->values[array].first; i != none; i = document->values[i].next) result.push_back(i);
+        
+        return result;
+    }
+    
+    inline function at(std::vector<uint> const & array, long index) -> uint {
+        return index >= 0 && (u64) index < array.size() ? array[index] : none;
+    }
+    
+    inline function number(t_document __in * document, uint value, double fallback) -> double {
+        return value != none && document->values[value].kind == t_json_kind::number ? document->values[value].number : fallback;
+    }
+    
+    // exactly count numbers, as in a node's matrix or translation
+    function numbers(t_document __in * document, uint array, float __out * values, u64 count) -> bool32 {
+        let items = elements(document, array);
+        if (items.size() != count) return false;
+        
+        for (u64 i = 0; i < count; i += 1) {
+            if (document->values[items[i]].kind != t_json_kind::number) return false;
+            values[i] = (float) document->values[items[i]].number;
+        }
+        
+        return true;
+    }
+    
+    // an index into one of the top level arrays, -1 when it's missing
+    inline function reference(t_document __in * document, uint object, char const * name) -> long {
+        let value = number(document, member(document, object, name), -1.0);
+        return value >= 0.0 && value == (double) (long) value ? (long) value : -1;
+    }
+    
+    inline function string_is(t_document __in * document, uint value, char const * text) -> bool32 {
+        if (value == none || document->values[value].kind != t_json_kind::string) return false;
+        
+        let string = document->values[value].text;
+        return string.length() == std::strlen(text) && std::memcmp(string.ptr, text, string.length()) == 0;
+    }
+    
+    // uris are relative to the gltf, with their spaces and such percent encoded
+    function uri_path(std::string const & directory, t_slice<char const> uri) -> std::string {
+        std::string path = directory;
+        
+        for (u64 i = 0; i < uri.length(); i += 1) {
+            if (uri[i] == '%' && i + 2 < uri.length()) {
+                char hex[3] = { uri[i + 1], uri[i + 2], '\0' };
+                path += (char) std::strtol(hex, null, 16);
+                i += 2;
+            } else {
+                path += uri[i];
+            }
+        }
+        
+        return path;
+    }
+    
+    inline function is_data_uri(t_slice<char const> uri) -> bool32 {
+        return uri.length() >= 5 && std::memcmp(uri.ptr, "data:", 5) == 0;
+    }
+    
+    // data:<media type>;base64,<data>, the only kind gltf uses
+    function decode_data_uri(t_slice<char const> uri, std::vector<u8> __out * bytes) -> bool32 {
+        let marker = std::string(uri.ptr, uri.length()).find(";base64,");
+        if (marker == std::string::npos) return false;
+        
+        t_slice<char const> text = { .ptr = uri.ptr + marker + 8, .len = uri.length() - marker - 8 };
+        
+        bytes->clear();
+        bytes->reserve(text.length() / 4 * 3);
+        
+        uint bits = 0;
+        int count = 0;
+        
+        for (u64 i = 0; i < text.length(); i += 1) {
+            let c = text[i];
+            int value;
+            
+            if (c >= 'A' && c <= 'Z') value = c - 'A';
+            else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+            else if (c >= '0' && c <= '9') value = c - '0' + 52;
+            else if (c == '+') value = 62;
+            else if (c == '/') value = 63;
+            else if (c == '=') break;
+            else return false;
+            
+            bits = bits << 6 | value;
+            count += 6;
+            
+            if (count >= 8) {
+                count -= 8;
+                bytes->push_back((u8) (bits >> count));
+            }
+        }
+        
+        return true;
+    }
+    
+    // an accessor resolved down to bytes in one of the buffers
+    struct t_accessor {
+        u8 const * data;
+        u64 count;
+        u64 stride;
+        uint component_type;
+        uint components;
+        bool32 normalized;
+    };
+    
+    enum : uint {
+        component_byte = 5120,
+        component_unsigned_byte = 5121,
+        component_short = 5122,
+        component_unsigned_short = 5123,
+        component_unsigned_int = 5125,
+        component_float = 5126,
+    };
+    
+    inline function component_size(uint type) -> u64 {
+        switch (type) {
+            case component_byte: case component_unsigned_byte: return 1;
+            case component_short: case component_unsigned_short: return 2;
+            case component_unsigned_int: case component_float: return 4;
+            default: return 0;
+        }
+    }
+    
+    inline function component(u8 const * p, uint type, bool32 normalized) -> float {
+        switch (type) {
+            case component_float: { float v; std::memcpy(&v, p, 4); return v; }
+            case component_unsigned_byte: return normalized ? *p / 255.f : *p;
+            case component_byte: { let v = (float) (int8_t) *p; return normalized ? std::fmax(v / 127.f, -1.f) : v; }
+            case component_unsigned_short: { u16 v; std::memcpy(&v, p, 2); return normalized ? v / 65535.f : v; }
+            case component_short: { int16_t v; std::memcpy(&v, p, 2); return normalized ? std::fmax(v / 32767.f, -1.f) : v; }
+            case component_unsigned_int: { uint32 v; std::memcpy(&v, p, 4); return (float) v; }
+            default: return 0.f;
+        }
+    }
+    
+    inline function index_at(u8 const * p, uint type) -> uint32 {
+        switch (type) {
+            case component_unsigned_byte: return *p;
+            case component_unsigned_short: { u16 v; std::memcpy(&v, p, 2); return v; }
+            case component_unsigned_int: { uint32 v; std::memcpy(&v, p, 4); return v; }
+            default: return ~0u;
+        }
+    }
+    
+    struct t_import {
+        t_document document;
+        uint root;
+        std::string directory;
+        
+        std::vector<uint> accessors;
+        std::vector<uint> views;
+        std::vector<t_slice<u8 const>> buffers;
+        std::vector<t_mapping> mappings; // of the buffers and images in files
+        std::vector<std::vector<u8>> decoded; // data uris
+        
+        // what the workers go through
+        std::vector<uint> primitive_values; // the json for each of gltf->primitives
+        std::vector<t_slice<u8 const>> image_files;
+        std::vector<bool32> failed;
+        
+        t_gltf * gltf;
+    };
+    
+    // the file, from the pack or mapped. empty if neither has it
+    function read(t_import __in * import, char const * path) -> t_slice<u8 const> {
+        let packed = pack::find(path);
+        if (packed.ptr) return packed;
+        
+        let mapping = map_file(path);
+        if (!mapping.data) return {};
+        
+        import->mappings.push_back(mapping);
+        
+        return { .ptr = mapping.data, .len = mapping.size };
+    }
+    
+    function resolve_accessor(t_import __in * import, long index, t_accessor __out * accessor) -> bool32 {
+        let document = &import->document;
+        let accessor_value = at(import->accessors, index);
+        
+        // sparse accessors and ones without a view, all zeroes, aren't supported
+        if (accessor_value == none || member(document, accessor_value, "sparse") != none) return false;
+        
+        let view = at(import->views, reference(document, accessor_value, "bufferView"));
+        if (view == none) return false;
+        
+        let buffer = reference(document, view, "buffer");
+        if (buffer < 0 || (u64) buffer >= import->buffers.size()) return false;
+        
+        let type = member(document, accessor_value, "type");
+        
+        accessor->components =
+            string_is(document, type, "SCALAR") ? 1 :
+            string_is(document, type, "VEC2") ? 2 :
+            string_is(document, type, "VEC3") ? 3 :
+            string_is(document, type, "VEC4") ? 4 : 0;
+        
+        accessor->component_type = (uint) number(document, member(document, accessor_value, "componentType"), 0.0);
+        accessor->normalized = member(document, accessor_value, "normalized") != none && document->values[member(document, accessor_value, "normalized")].boolean;
+        accessor->count = (u64) number(document, member(document, accessor_value, "count"), 0.0);
+        
+        let element_size = component_size(accessor->component_type) * accessor->components;
+        let view_offset = (u64) number(document, member(document, view, "byteOffset"), 0.0);
+        let view_length = (u64) number(document, member(document, view, "byteLength"), 0.0);
+        let offset = (u64) number(document, member(document, accessor_value, "byteOffset"), 0.0);
+        let bytes = import->buffers[buffer];
+        
+        accessor->stride = (u64) number(document, member(document, view, "byteStride"), (double) element_size);
+        
+        // everything read must be inside the view, and the view inside the buffer
+        let ok = element_size && accessor->count && accessor->stride >= element_size;
+        ok = ok && accessor->count <= view_length && accessor->stride <= view_length;
+        ok = ok && view_offset <= bytes.length() && view_length <= bytes.length() - view_offset;
+        ok = ok && offset + accessor->stride * (accessor->count - 1) + element_size <= view_length;
+        
+        accessor->data = bytes.ptr + view_offset + offset;
+        
+        return ok;
+    }
+    
+    function decode_primitive(t_import __in * import, u64 index) -> bool32 {
+        let document = &import->document;
+        let value = import->primitive_values[index];
+        let attributes = member(document, value, "attributes");
+        
+        t_accessor positions, uvs = {}, indices = {};
+        
+        if (!resolve_accessor(import, reference(document, attributes, "POSITION"), &positions)) return false;
+        if (positions.components != 3 || positions.component_type != component_float) return false;
+        
+        let has_uvs = reference(document, attributes, "TEXCOORD_0") >= 0;
+        if (has_uvs && (!resolve_accessor(import, reference(document, attributes, "TEXCOORD_0"), &uvs) || uvs.components != 2 || uvs.count != positions.count)) return false;
+        
+        let has_indices = reference(document, value, "indices") >= 0;
+        if (has_indices && (!resolve_accessor(import, reference(document, value, "indices"), &indices) || indices.components != 1)) return false;
+        if (has_indices ? indices.count % 3 : positions.count % 3) return false;
+        
+        // without indices, one for each vertex until they're welded
+        let vertex_count = positions.count;
+        let index_count = has_indices ? indices.count : vertex_count;
+        let storage = std::malloc(sizeof(t_vertex) * vertex_count + sizeof(uint32) * index_count);
+        
+        t_geometry geometry = {
+            .vertices = { .ptr = static_cast<t_vertex *>(storage), .len = vertex_count },
+            .indices = { .ptr = reinterpret_cast<uint32 *>(static_cast<t_vertex *>(storage) + vertex_count), .len = index_count },
+            .storage = storage,
+        };
+        
+        let uv_size = component_size(uvs.component_type);
+        
+        for (u64 i = 0; i < vertex_count; i += 1) {
+            let position = positions.data + positions.stride * i;
+            let vertex = &geometry.vertices[i];
+            
+            std::memcpy(&vertex->position, position, sizeof(vec3));
+            
+            if (has_uvs) {
+                let uv = uvs.data + uvs.stride * i;
+                vertex->uv = { component(uv, uvs.component_type, uvs.normalized), component(uv + uv_size, uvs.component_type, uvs.normalized) };
+            } else {
+                vertex->uv = { 0.f, 0.f };
+            }
+        }
+        
+        let ok = true;
+        
+        for (u64 i = 0; has_indices && i < index_count; i += 1) {
+            geometry.indices[i] = index_at(indices.data + indices.stride * i, indices.component_type);
+            ok = ok && geometry.indices[i] < vertex_count;
+        }
+        
+        if (!ok) {
+            free_geometry(&geometry);
+            return false;
+        }
+        
+        if (!has_indices) geometry.vertices.len = weld_vertices(geometry.vertices, geometry.indices);
+        
+        // as create_mesh would, ahead of building the lods
+        optimize_vertex_cache(geometry.indices, geometry.vertices.length());
+        geometry.vertices.len = optimize_vertex_fetch(geometry.vertices, geometry.indices);
+        
+        import->gltf->primitives[index].geometry = geometry;
+        
+        return true;
+    }
+    
+    function decode_image(t_import __in * import, u64 index) -> bool32 {
+        let image = &import->gltf->images[index];
+        let file = import->image_files[index];
+        
+        image->key = registry::texture_key(file);
+        image->image = load_image(file);
+        if (!image->image.pixels) return false;
+        
+        image->mips = generate_mips(&image->image);
+        
+        return true;
+    }
+    
+    // the primitives and the images all in one go, so that a few large images don't
+    // hold up the rest
+    function decode(void * data, u64 index) -> void {
+        let import = static_cast<t_import *>(data);
+        let primitive_count = import->primitive_values.size();
+        
+        import->failed[index] = index < primitive_count
+            ? !decode_primitive(import, index)
+            : !decode_image(import, index - primitive_count);
+    }
+    
+    function scale_draw(void * data, u64 index) -> void {
+        let gltf = static_cast<t_gltf *>(data);
+        let draw = &gltf->draws[index];
+        let scale = draw->scale;
+        
+        if (scale == vec3 { 1.f, 1.f, 1.f }) return;
+        
+        let source = gltf->primitives[draw->primitive].geometry;
+        let vertex_count = source.vertices.length();
+        let index_count = source.indices.length();
+        let storage = std::malloc(sizeof(t_vertex) * vertex_count + sizeof(uint32) * index_count);
+        
+        draw->scaled = {
+            .vertices = { .ptr = static_cast<t_vertex *>(storage), .len = vertex_count },
+            .indices = { .ptr = reinterpret_cast<uint32 *>(static_cast<t_vertex *>(storage) + vertex_count), .len = index_count },
+            .storage = storage,
+        };
+        
+        for (u64 i = 0; i < vertex_count; i += 1) {
+            draw->scaled.vertices[i] = { .position = source.vertices[i].position * scale, .uv = source.vertices[i].uv };
+        }
+        
+        std::memcpy(draw->scaled.indices.ptr, source.indices.ptr, sizeof(uint32) * index_count);
+        
+        // mirrored, the triangles would face inwards
+        if (scale.x * scale.y * scale.z < 0.f) {
+            for (u64 i = 0; i + 2 < index_count; i += 3) {
+                std::swap(draw->scaled.indices[i + 1], draw->scaled.indices[i + 2]);
+            }
+        }
+    }
+    
+    struct t_transform {
+        vec3 position;
+        glm::quat orientation;
+        vec3 scale;
+    };
+    
+    function local_transform(t_document __in * document, uint node) -> t_transform {
+        t_transform transform = { .position = { 0.f, 0.f, 0.f }, .orientation = glm::quat(1.f, 0.f, 0.f, 0.f), .scale = { 1.f, 1.f, 1.f } };
+        
+        float m[16];
+        
+        if (numbers(document, member(document, node, "matrix"), m, 16)) {
+            // column major, taken apart into translation, rotation and scale. shear is lost
+            vec3 axes[3] = { { m[0], m[1], m[2] }, { m[4], m[5], m[6] }, { m[8], m[9], m[10] } };
+            
+            transform.position = { m[12], m[13], m[14] };
+            transform.scale = { glm::length(axes[0]), glm::length(axes[1]), glm::length(axes[2]) };
+            
+            if (glm::dot(glm::cross(axes[0], axes[1]), axes[2]) < 0.f) transform.scale.x = -transform.scale.x;
+            
+            for (int k = 0; k < 3; k += 1) {
+                if (transform.scale[k] != 0.f) axes[k] = axes[k] / transform.scale[k];
+            }
+            
+            transform.orientation = glm::normalize(glm::quat_cast(glm::mat3(axes[0], axes[1], axes[2])));
+            
+            return transform;
+        }
+        
+        float translation[3], rotation[4], scale[3];
+        
+        if (numbers(document, member(document, node, "translation"), translation, 3)) {
+            transform.position = { translation[0], translation[1], translation[2] };
+        }
+        
+        // stored x, y, z, w
+        if (numbers(document, member(document, node, "rotation"), rotation, 4)) {
+            transform.orientation = glm::normalize(glm::quat(rotation[3], rotation[0], rotation[1], rotation[2]));
+        }
+        
+        if (numbers(document, member(document, node, "scale"), scale, 3)) {
+            transform.scale = { scale[0], scale[1], scale[2] };
+        }
+        
+        return transform;
+    }
+    
+    // the parent's scale is applied as if it were uniform, which it almost always is
+    inline function combine(t_transform parent, t_transform local) -> t_transform {
+        return {
+            .position = parent.position + parent.orientation * (parent.scale * local.position),
+            .orientation = parent.orientation * local.orientation,
+            .scale = parent.scale * local.scale,
+        };
+    }
+    
+    function parse(t_import __in * import, t_slice<u8 const> file) -> bool32 {
+        let text = reinterpret_cast<char const *>(file.ptr);
+        let length = file.length();
+        t_slice<u8 const> binary = {};
+        
+        // a .glb: a header, then the json chunk and, optionally, the binary chunk, used in place
+        if (length >= 12 && std::memcmp(text, "glTF", 4) == 0) {
+            uint32 header[3];
+            std::memcpy(header, text, sizeof(header));
+            
+            if (header[1] != 2 || header[2] > length) return false;
+            
+            let total = (u64) header[2];
+            u64 offset = 12;
+            
+            for (int i = 0; i < 2 && offset + 8 <= total; i += 1) {
+                uint32 chunk[2]; // length, type
+                std::memcpy(chunk, file.ptr + offset, sizeof(chunk));
+                
+                if (chunk[0] > total - offset - 8) return false;
+                
+                let data = file.ptr + offset + 8;
+                
+                if (i == 0 && chunk[1] == 0x4E4F534A) { // "JSON"
+                    text = reinterpret_cast<char const *>(data);
+                    length = chunk[0];
+                } else if (i == 1 && chunk[1] == 0x004E4942) { // "BIN"
+                    binary = { .ptr = data, .len = chunk[0] };
+                } else {
+                    return false;
+                }
+                
+                offset += 8 + ((chunk[0] + 3ull) & ~3ull);
+            }
+            
+            if (text == reinterpret_cast<char const *>(file.ptr)) return false;
+        }
+        
+        import->document.values.push_back({});
+        
+        t_json_parser parser = { .at = text, .end = text + length, .values = &import->document.values };
+        import->root = parse_value(&parser, 0);
+        
+        let document = &import->document;
+        if (import->root == invalid || document->values[import->root].kind != t_json_kind::object) return false;
+        
+        // "2.0", or a later minor version, which stays compatible
+        let version = member(document, member(document, import->root, "asset"), "version");
+        if (version == none || document->values[version].kind != t_json_kind::string) return false;
+        
+        let version_text = document->values[version].text;
+        if (version_text.length() < 2 || version_text[0] != '2' || version_text[1] != '.') return false;
+        
+        import->accessors = elements(document, member(document, import->root, "accessors"));
+        import->views = elements(document, member(document, import->root, "bufferViews"));
+        
+        let buffers = elements(document, member(document, import->root, "buffers"));
+        
+        for (u64 i = 0; i < buffers.size(); i += 1) {
+            let buffer = buffers[i];
+            let uri = member(document, buffer, "uri");
+            let byte_length = (u64) number(document, member(document, buffer, "byteLength"), 0.0);
+            
+            t_slice<u8 const> bytes = {};
+            
+            if (uri == none) {
+                bytes = i == 0 ? binary : t_slice<u8 const> {};
+            } else if (document->values[uri].kind == t_json_kind::string) {
+                let uri_text = document->values[uri].text;
+                
+                if (is_data_uri(uri_text)) {
+                    import->decoded.emplace_back();
+                    if (!decode_data_uri(uri_text, &import->decoded.back())) return false;
+                    
+                    bytes = { .ptr = import->decoded.back().data(), .len = import->decoded.back().size() };
+                } else {
+                    bytes = read(import, uri_path(import->directory, uri_text).c_str());
+                }
+            }
+            
+            // a glb's binary chunk may be padded past it
+            if (!bytes.ptr || bytes.length() < byte_length) return false;
+            
+            import->buffers.push_back(bytes);
+        }
+        
+        return true;
+    }
+}
+
+function load_gltf(char const * path, t_gltf __out * gltf) -> bool32 {
+    let start = t_clock::now();
+    
+    *gltf = {};
+    
+    t_import import = { .root = none, .gltf = gltf };
+    
+    let path_string = std::string(path);
+    let separator = path_string.find_last_of("\\/");
+    import.directory = separator == std::string::npos ? "" : path_string.substr(0, separator + 1);
+    
+    let file = read(&import, path);
+    let ok = file.ptr && parse(&import, file);
+    
+    let document = &import.document;
+    let root = import.root;
+    
+    // base colour image for each material
+    std::vector<int> material_images;
+    
+    if (ok) {
+        let materials = elements(document, member(document, root, "materials"));
+        let textures = elements(document, member(document, root, "textures"));
+        
+        for (let material : materials) {
+            let base = member(document, member(document, material, "pbrMetallicRoughness"), "baseColorTexture");
+            let texture = at(textures, reference(document, base, "index"));
+            
+            material_images.push_back(base != none && texture != none ? (int) reference(document, texture, "source") : -1);
+        }
+    }
+    
+    // the primitives of each mesh, in order. ones that aren't triangles are left out
+    std::vector<std::vector<uint>> mesh_primitives;
+    
+    if (ok) {
+        for (let mesh : elements(document, member(document, root, "meshes"))) {
+            mesh_primitives.emplace_back();
+            
+            for (let primitive : elements(document, member(document, mesh, "primitives"))) {
+                if (number(document, member(document, primitive, "mode"), 4.0) != 4.0) continue;
+                
+                let material = reference(document, primitive, "material");
+                
+                mesh_primitives.back().push_back((uint) gltf->primitives.size());
+                import.primitive_values.push_back(primitive);
+                gltf->primitives.push_back({ .image = material >= 0 && (u64) material < material_images.size() ? material_images[material] : -1 });
+            }
+        }
+    }
+    
+    if (ok) {
+        for (let image : elements(document, member(document, root, "images"))) {
+            let uri = member(document, image, "uri");
+            let view = at(import.views, reference(document, image, "bufferView"));
+            
+            t_gltf_image decoded = {};
+            t_slice<u8 const> bytes = {};
+            
+            if (uri != none && document->values[uri].kind == t_json_kind::string) {
+                let text = document->values[uri].text;
+                
+                if (is_data_uri(text)) {
+                    import.decoded.emplace_back();
+                    
+                    ok = decode_data_uri(text, &import.decoded.back());
+                    bytes = { .ptr = import.decoded.back().data(), .len = import.decoded.back().size() };
+                } else {
+                    decoded.path = uri_path(import.directory, text);
+                    bytes = read(&import, decoded.path.c_str());
+                }
+            } else if (view != none) {
+                let buffer = reference(document, view, "buffer");
+                let offset = (u64) number(document, member(document, view, "byteOffset"), 0.0);
+                let length = (u64) number(document, member(document, view, "byteLength"), 0.0);
+                
+                if (buffer >= 0 && (u64) buffer < import.buffers.size() && offset <= import.buffers[buffer].length() && length <= import.buffers[buffer].length() - offset) {
+                    bytes = { .ptr = import.buffers[buffer].ptr + offset, .len = length };
+                }
+            }
+            
+            ok = ok && bytes.ptr;
+            
+            gltf->images.push_back(decoded);
+            import.image_files.push_back(bytes);
+            
+            if (!ok) break;
+        }
+    }
+    
+    if (ok) {
+        import.failed.assign(gltf->primitives.size() + gltf->images.size(), false);
+        jobs::parallel_for(import.failed.size(), decode, &import);
+        
+        for (u64 i = 0; i < import.failed.size(); i += 1) ok = ok && !import.failed[i];
+    }
+    
+    for (u64 i = 0; ok && i < gltf->primitives.size(); i += 1) {
+        let image = gltf->primitives[i].image;
+        if (image >= (int) gltf->images.size()) gltf->primitives[i].image = -1;
+    }
+    
+    // the scene's node trees, depth first. gltf is y up, the root turns it z up
+    if (ok) {
+        let nodes = elements(document, member(document, root, "nodes"));
+        let scenes = elements(document, member(document, root, "scenes"));
+        let scene = at(scenes, std::max(reference(document, root, "scene"), 0l));
+        
+        struct t_pending {
+            long node;
+            t_transform parent;
+        };
+        
+        let z_up = t_transform { .position = { 0.f, 0.f, 0.f }, .orientation = glm::angleAxis(kappa, vec3 { 1.f, 0.f, 0.f }), .scale = { 1.f, 1.f, 1.f } };
+        
+        // pushed in reverse, to be visited in order
+        std::vector<t_pending> pending;
+        
+        let push_children = [&] (std::vector<uint> const & children, t_transform parent) {
+            for (u64 k = children.size(); k > 0; k -= 1) {
+                pending.push_back({ .node = (long) number(document, children[k - 1], -1.0), .parent = parent });
+            }
+        };
+        
+        if (scene != none) {
+            push_children(elements(document, member(document, scene, "nodes")), z_up);
+        } else {
+            // without scenes, every node that isn't a child
+            std::vector<bool32> child(nodes.size(), false);
+            
+            for (let node : nodes) {
+                for (let value : elements(document, member(document, node, "children"))) {
+                    let index = (long) number(document, value, -1.0);
+                    if (index >= 0 && (u64) index < nodes.size()) child[index] = true;
+                }
+            }
+            
+            for (u64 i = nodes.size(); i > 0; i -= 1) {
+                if (!child[i - 1]) pending.push_back({ .node = (long) i - 1, .parent = z_up });
+            }
+        }
+        
+        // a valid gltf is a forest, visiting more nodes than it has means a cycle
+        u64 visited = 0;
+        
+        while (ok && !pending.empty()) {
+            let next = pending.back();
+            pending.pop_back();
+            
+            ok = at(nodes, next.node) != none && visited < nodes.size();
+            if (!ok) break;
+            
+            visited += 1;
+            
+            let node = nodes[next.node];
+            let transform = combine(next.parent, local_transform(document, node));
+            let mesh = reference(document, node, "mesh");
+            
+            if (mesh >= 0 && (u64) mesh < mesh_primitives.size()) {
+                for (let primitive : mesh_primitives[mesh]) {
+                    gltf->draws.push_back({
+                        .primitive = primitive,
+                        .position = transform.position,
+                        .orientation = transform.orientation,
+                        .scale = transform.scale,
+                    });
+                }
+            }
+            
+            push_children(elements(document, member(document, node, "children")), transform);
+        }
+    }
+    
+    // every lod's indices after lod 0's, so that the scaled copies get them too
+    if (ok) {
+        std::vector<t_geometry> geometries;
+        for (let & primitive : gltf->primitives) geometries.push_back(primitive.geometry);
+        
+        std::vector<t_lod_chain> chains(geometries.size());
+        build_lod_chains({ .ptr = geometries.data(), .len = geometries.size() }, { .ptr = lod_ratios, .len = sizeof(lod_ratios) / sizeof(float) }, chains.data());
+        
+        for (u64 i = 0; i < chains.size(); i += 1) {
+            let primitive = &gltf->primitives[i];
+            let vertex_count = primitive->geometry.vertices.length();
+            let index_count = chains[i].indices.size();
+            let storage = std::malloc(sizeof(t_vertex) * vertex_count + sizeof(uint32) * index_count);
+            
+            t_geometry geometry = {
+                .vertices = { .ptr = static_cast<t_vertex *>(storage), .len = vertex_count },
+                .indices = { .ptr = reinterpret_cast<uint32 *>(static_cast<t_vertex *>(storage) + vertex_count), .len = index_count },
+                .storage = storage,
+            };
+            
+            std::memcpy(geometry.vertices.ptr, primitive->geometry.vertices.ptr, sizeof(t_vertex) * vertex_count);
+            std::memcpy(geometry.indices.ptr, chains[i].indices.data(), sizeof(uint32) * index_count);
+            
+            free_geometry(&primitive->geometry);
+            primitive->geometry = geometry;
+            primitive->lods = std::move(chains[i].lods);
+        }
+    }
+    
+    if (ok) jobs::parallel_for(gltf->draws.size(), scale_draw, gltf);
+    
+    // everything kept was copied out of them
+    for (let & mapping : import.mappings) unmap_file(&mapping);
+    
+    if (!ok) {
+        free_gltf(gltf);
+        return false;
+    }
+    
+    gltf->decode_time = std::chrono::duration<float>(t_clock::now() - start).count();
+    
+    return true;
+}
+
+function free_gltf(t_gltf __in * gltf) -> void {
+    for (let & primitive : gltf->primitives) free_geometry(&primitive.geometry);
+    for (let & draw : gltf->draws) free_geometry(&draw.scaled);
+    
+    for (let & image : gltf->images) {
+        free_mips(&image.mips);
+        if (image.image.pixels) free_image(&image.image);
+    }
+    
+    *gltf = {};
+}
+
+function create_model(t_gltf __in * gltf, t_shader shader, t_texture texture) -> t_model {
+    t_model model;
+    
+    // images in files can be reloaded by residency, embedded ones stay as they are
+    for (let & image : gltf->images) {
+        let found = registry::find_texture(image.key);
+        
+        if (found) {
+            model.textures.push_back(found);
+        } else {
+            let created = create_texture(&image.mips);
+            model.textures.push_back(registry::add_texture(image.key, image.path.empty() ? created : residency::add(created, image.path.c_str())));
+        }
+        
+        free_mips(&image.mips);
+        free_image(&image.image);
+    }
+    
+    // acquired on first use, a primitive only ever drawn scaled doesn't need its own
+    std::vector<t_mesh *> meshes(gltf->primitives.size(), null);
+    
+    for (let & draw : gltf->draws) {
+        let primitive = &gltf->primitives[draw.primitive];
+        let mesh = draw.scaled.storage ? null : meshes[draw.primitive];
+        
+        if (!mesh) {
+            let geometry = draw.scaled.storage ? draw.scaled : primitive->geometry;
+            
+            // the errors are in the mesh's units, which the scale changes
+            let lods = primitive->lods;
+            let largest = std::max({ std::abs(draw.scale.x), std::abs(draw.scale.y), std::abs(draw.scale.z) });
+            for (auto & lod : lods) lod.error *= largest;
+            
+            mesh = registry::acquire_mesh(geometry.vertices, geometry.indices, true, { .ptr = lods.data(), .len = lods.size() });
+            model.meshes.push_back(mesh);
+            
+            if (!draw.scaled.storage) meshes[draw.primitive] = mesh;
+        }
+        
+        model.nodes.push_back({
+            .mesh = mesh,
+            .texture = primitive->image >= 0 ? model.textures[primitive->image] : texture,
+            .shader = shader,
+            .position = draw.position,
+            .orientation = draw.orientation,
+            .virtual_texture = null,
+            .clusters = null,
+        });
+    }
+    
+    free_gltf(gltf);
+    
+    return model;
+}
+
+function destroy_model(t_model __in * model) -> void {
+    for (let mesh : model->meshes) registry::release_mesh(mesh);
+    for (let texture : model->textures) registry::release_texture(texture);
+    
+    *model = {};
+}
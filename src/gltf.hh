@@ -0,0 +1,64 @@
+#ifndef __learngl_gltf__
+#define __learngl_gltf__
+
+#include <string>
+#include <vector>
+
+#include "common.hh"
+#include "geometry.hh"
+#include "mips.hh"
+#include "render.hh"
+
+// gltf 2.0 scenes, .gltf with its buffers and images beside it or embedded, and .glb.
+// load_gltf does the cpu side on the job workers: every primitive's accessors and every
+// image are decoded side by side, straight out of the mapped files into the geometry and
+// images kept, a .glb's binary chunk included. each primitive gets lods, see simplify.hh,
+// built side by side too. create_model then uploads on the gl thread.
+// only what t_vertex holds is kept: positions, the first uvs and the base colour texture
+struct t_gltf_primitive {
+    t_geometry geometry; // welded and reordered, every lod's indices after lod 0's
+    std::vector<t_mesh_lod> lods; // see simplify.hh
+    int image; // its base colour, -1 for none
+};
+
+struct t_gltf_image {
+    std::string path; // empty for images embedded in a buffer
+    u64 key; // for the registry, of the encoded image
+    t_image image;
+    t_mip_chain mips;
+};
+
+// the node tree flattened, one for each primitive of each node with a mesh, in z up world
+// space. t_node has no scale, so the node's is baked into a copy of the geometry
+struct t_gltf_draw {
+    uint primitive;
+    vec3 position;
+    glm::quat orientation;
+    vec3 scale;
+    t_geometry scaled; // the primitive's geometry scaled, empty for a scale of 1
+};
+
+struct t_gltf {
+    std::vector<t_gltf_primitive> primitives;
+    std::vector<t_gltf_image> images;
+    std::vector<t_gltf_draw> draws;
+    float decode_time; // seconds, parsing included
+};
+
+// meshes and textures come from the registry, shared with anything else that has them
+struct t_model {
+    std::vector<t_node> nodes;
+    std::vector<t_mesh *> meshes;
+    std::vector<t_texture> textures;
+};
+
+// paths are looked up in the asset pack first, then read from files. false if the file
+// isn't gltf or refers to anything that isn't there
+function load_gltf(char const * path, t_gltf __out * gltf) -> bool32;
+function free_gltf(t_gltf __in * gltf) -> void;
+
+// texture is for primitives without one. the gltf's decoded images are given back
+function create_model(t_gltf __in * gltf, t_shader shader, t_texture texture) -> t_model;
+function destroy_model(t_model __in * model) -> void;
+
+#endif // __learngl_gltf__
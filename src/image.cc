@@ -0,0 +1,361 @@
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include <stb/stb_image.h>
+
+#include "image.hh"
+#include "jobs.hh"
+#include "pack.hh"
+
+namespace {
+    // decoder memory, see stbi_set_allocator. every allocation sits behind a header.
+    // small ones made while the thread is decoding an image are bumped from its arena,
+    // which resets when the image is done. the rest are blocks that go back to a shared
+    // pool when freed, so once the pool has warmed up decoding doesn't touch the heap
+    constexpr u64 header_size = 32;
+    constexpr u64 arena_size = 256 * 1024;
+    constexpr u64 max_arena_allocation = 64 * 1024;
+    constexpr int max_pooled_blocks = 256;
+    constexpr u64 max_pooled_bytes = 512ull * 1024 * 1024;
+    
+    std::atomic<u64> heap_allocations = 0;
+    std::atomic<u64> heap_frees = 0;
+    std::atomic<u64> arena_allocations = 0;
+    std::atomic<u64> reused_blocks = 0;
+    
+    struct t_arena {
+        u8 * base; // allocated on first use, kept for the thread's lifetime
+        u64 used;
+        int depth; // loads in progress on this thread
+        
+        // on thread exit. nothing lives in it by then, see end_decode
+        ~t_arena() {
+            if (base) heap_frees += 1;
+            std::free(base);
+        }
+    };
+    
+    struct t_header {
+        u64 size;
+        u64 capacity; // bytes usable after the header
+        t_arena * arena; // null for pool blocks
+    };
+    
+    static_assert(sizeof(t_header) <= header_size);
+    
+    thread_local t_arena arena = {};
+    
+    std::mutex pool_mutex;
+    t_header * pool[max_pooled_blocks];
+    int pool_count = 0;
+    u64 pooled_bytes = 0;
+    
+    inline function header_of(void * p) -> t_header * {
+        return reinterpret_cast<t_header *>(static_cast<u8 *>(p) - header_size);
+    }
+    
+    inline function data_of(t_header * header) -> u8 * {
+        return reinterpret_cast<u8 *>(header) + header_size;
+    }
+    
+    // a quarter of a power of two steps, so similar sizes share blocks
+    inline function size_class(u64 size) -> u64 {
+        u64 step = 1024;
+        while (step * 8 < size) step *= 2;
+        
+        return (size + step - 1) / step * step;
+    }
+    
+    function acquire_block(u64 size) -> void * {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            
+            // the smallest block that fits, as long as it isn't more than twice the size
+            let wanted = size_class(size);
+            int best = -1;
+            
+            for (int i = 0; i < pool_count; i += 1) {
+                let capacity = pool[i]->capacity;
+                if (capacity < wanted || capacity > wanted * 2) continue;
+                if (best < 0 || capacity < pool[best]->capacity) best = i;
+            }
+            
+            if (best >= 0) {
+                let header = pool[best];
+                pool_count -= 1;
+                pool[best] = pool[pool_count];
+                pooled_bytes -= header->capacity;
+                
+                header->size = size;
+                reused_blocks += 1;
+                
+                return data_of(header);
+            }
+        }
+        
+        let capacity = size_class(size);
+        let header = static_cast<t_header *>(std::malloc(header_size + capacity));
+        if (!header) return null;
+        
+        *header = { .size = size, .capacity = capacity, .arena = null };
+        heap_allocations += 1;
+        
+        return data_of(header);
+    }
+    
+    function release_block(t_header * header) -> void {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            
+            // a full pool gives up its smallest block for a larger one, those are the expensive ones
+            if (pool_count == max_pooled_blocks) {
+                int smallest = 0;
+                
+                for (int i = 1; i < pool_count; i += 1) {
+                    if (pool[i]->capacity < pool[smallest]->capacity) smallest = i;
+                }
+                
+                if (pool[smallest]->capacity < header->capacity) {
+                    let evicted = pool[smallest];
+                    pool[smallest] = header;
+                    pooled_bytes += header->capacity - evicted->capacity;
+                    header = evicted;
+                }
+            } else if (pooled_bytes + header->capacity <= max_pooled_bytes) {
+                pool[pool_count] = header;
+                pool_count += 1;
+                pooled_bytes += header->capacity;
+                return;
+            }
+        }
+        
+        std::free(header);
+        heap_frees += 1;
+    }
+    
+    inline function is_last_in_arena(t_header * header) -> bool32 {
+        return header->arena == &arena && data_of(header) + header->capacity == arena.base + arena.used;
+    }
+    
+    function decoder_alloc(void *, size_t size) -> void * {
+        let total = header_size + ((size + 15) & ~(u64) 15);
+        
+        if (arena.depth > 0 && size <= max_arena_allocation) {
+            if (!arena.base) {
+                arena.base = static_cast<u8 *>(std::malloc(arena_size));
+                if (arena.base) heap_allocations += 1;
+            }
+            
+            if (arena.base && arena.used + total <= arena_size) {
+                let header = reinterpret_cast<t_header *>(arena.base + arena.used);
+                *header = { .size = size, .capacity = total - header_size, .arena = &arena };
+                
+                arena.used += total;
+                arena_allocations += 1;
+                
+                return data_of(header);
+            }
+        }
+        
+        return acquire_block(size);
+    }
+    
+    function decoder_release(void *, void * p) -> void {
+        if (!p) return;
+        
+        let header = header_of(p);
+        
+        if (!header->arena) {
+            release_block(header);
+        } else if (is_last_in_arena(header)) {
+            arena.used -= header_size + header->capacity;
+        }
+        
+        // any other arena memory comes back when that thread's image is done
+    }
+    
+    function decoder_resize(void * user, void * p, size_t, size_t size) -> void * {
+        if (!p) return decoder_alloc(user, size);
+        
+        let header = header_of(p);
+        
+        if (size <= header->capacity) {
+            header->size = size;
+            return p;
+        }
+        
+        let moved = decoder_alloc(user, size);
+        if (!moved) return null;
+        
+        std::memcpy(moved, p, header->size);
+        decoder_release(user, p);
+        
+        return moved;
+    }
+    
+    stbi_allocator const allocator = {
+        .alloc = decoder_alloc,
+        .resize = decoder_resize,
+        .release = decoder_release,
+        .user = null,
+    };
+    
+    function begin_decode() -> void {
+        // before the first image, so that every image is freed by the allocator that made it
+        bool32 static const installed = (stbi_set_allocator(&allocator), true);
+        (void) installed;
+        
+        arena.depth += 1;
+    }
+    
+    // the pixels outlive the arena, small images are moved into a pool block
+    function end_decode(u8 * pixels) -> u8 * {
+        if (pixels && header_of(pixels)->arena) {
+            let size = header_of(pixels)->size;
+            let block = static_cast<u8 *>(acquire_block(size));
+            
+            if (block) std::memcpy(block, pixels, size);
+            pixels = block;
+        }
+        
+        arena.depth -= 1;
+        if (arena.depth == 0) arena.used = 0;
+        
+        return pixels;
+    }
+    
+    struct t_parallel_task {
+        stbi_parallel_task * task;
+        void * data;
+    };
+    
+    function run_parallel(int count, stbi_parallel_task * task, void * task_data, void *) -> void {
+        t_parallel_task parallel = { .task = task, .data = task_data };
+        
+        jobs::parallel_for(count, [] (void * data, u64 index) {
+            let parallel = static_cast<t_parallel_task *>(data);
+            parallel->task(parallel->data, (int) index);
+        }, &parallel);
+    }
+    
+    // in place: every output texel is written at or before the first source texel it reads
+    function box_downsample(t_image * image, int scale_shift) -> void {
+        let factor = 1 << scale_shift;
+        let width = (image->width + factor - 1) / factor;
+        let height = (image->height + factor - 1) / factor;
+        let n = image->channels;
+        
+        for (int y = 0; y < height; y += 1) {
+            for (int x = 0; x < width; x += 1) {
+                for (int c = 0; c < n; c += 1) {
+                    int sum = 0;
+                    int count = 0;
+                    
+                    for (int sy = y * factor; sy < m_clamp(y * factor + factor, 0, image->height); sy += 1) {
+                        for (int sx = x * factor; sx < m_clamp(x * factor + factor, 0, image->width); sx += 1) {
+                            sum += image->pixels[((u64) sy * image->width + sx) * n + c];
+                            count += 1;
+                        }
+                    }
+                    
+                    image->pixels[((u64) y * width + x) * n + c] = (u8) ((sum + count / 2) / count);
+                }
+            }
+        }
+        
+        image->width = width;
+        image->height = height;
+    }
+}
+
+function load_image(char const * path, int channels) -> t_image {
+    let packed = pack::find(path);
+    if (packed.ptr) return load_image(packed, channels);
+    
+    t_image image = { .channels = channels };
+    begin_decode();
+    image.pixels = end_decode(stbi_load(path, &image.width, &image.height, null, channels));
+    
+    return image;
+}
+
+function load_image(t_slice<u8 const> file, int channels) -> t_image {
+    t_image image = { .channels = channels };
+    begin_decode();
+    image.pixels = end_decode(stbi_load_from_memory(file.ptr, (int) file.length(), &image.width, &image.height, null, channels));
+    
+    return image;
+}
+
+function load_image_scaled(char const * path, int scale_shift, int channels) -> t_image {
+    let packed = pack::find(path);
+    if (packed.ptr) return load_image_scaled(packed, scale_shift, channels);
+    
+    t_image image = { .channels = channels };
+    begin_decode();
+    image.pixels = end_decode(stbi_load_jpeg_scaled(path, scale_shift, &image.width, &image.height, null, channels));
+    
+    if (!image.pixels) {
+        image = load_image(path, channels);
+        if (image.pixels) box_downsample(&image, scale_shift);
+    }
+    
+    return image;
+}
+
+function load_image_scaled(t_slice<u8 const> file, int scale_shift, int channels) -> t_image {
+    t_image image = { .channels = channels };
+    begin_decode();
+    image.pixels = end_decode(stbi_load_jpeg_scaled_from_memory(file.ptr, (int) file.length(), scale_shift, &image.width, &image.height, null, channels));
+    
+    if (!image.pixels) {
+        image = load_image(file, channels);
+        if (image.pixels) box_downsample(&image, scale_shift);
+    }
+    
+    return image;
+}
+
+function free_image(t_image __in * image) -> void {
+    stbi_image_free(image->pixels);
+    image->pixels = null;
+}
+
+function decode_allocations() -> t_decode_allocations {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    
+    return {
+        .heap = heap_allocations,
+        .heap_frees = heap_frees,
+        .arena = arena_allocations,
+        .reused = reused_blocks,
+        .pooled_bytes = pooled_bytes,
+    };
+}
+
+function release_decode_memory() -> void {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    
+    for (int i = 0; i < pool_count; i += 1) {
+        std::free(pool[i]);
+        heap_frees += 1;
+    }
+    
+    pool_count = 0;
+    pooled_bytes = 0;
+}
+
+function set_parallel_decoding(bool32 enabled) -> void {
+    stbi_set_parallel_for(enabled ? run_parallel : null, null);
+}
+
+function decoding_simd_level() -> int {
+    return stbi_simd_level();
+}
+
+function set_decoding_simd_limit(int level) -> void {
+    stbi_set_simd_limit(level);
+}
@@ -0,0 +1,49 @@
+#ifndef __learngl_image__
+#define __learngl_image__
+
+#include "common.hh"
+
+// decoded 8 bit pixels, rows tightly packed top to bottom
+struct t_image {
+    u8 * pixels;
+    int width;
+    int height;
+    int channels;
+};
+
+// paths are looked up in the asset pack first, see pack.hh
+function load_image(char const * path, int channels = 3) -> t_image;
+function load_image(t_slice<u8 const> file, int channels = 3) -> t_image;
+function free_image(t_image __in * image) -> void;
+
+// a quick preview at 1 / (1 << scale_shift) of the size, rounded up. jpegs skip most
+// of the work, see stbi_load_jpeg_scaled; anything else is decoded in full and box filtered
+function load_image_scaled(char const * path, int scale_shift, int channels = 3) -> t_image;
+function load_image_scaled(t_slice<u8 const> file, int scale_shift, int channels = 3) -> t_image;
+
+// splits large jpegs over the job workers (restart intervals, idct, colour conversion).
+// off until turned on, jobs::init has to come first
+function set_parallel_decoding(bool32 enabled) -> void;
+
+// counts since startup of the memory decoding asked for. heap is what had to be malloc'd,
+// the rest came from a thread's scratch arena or reused a pooled block. once loading
+// has warmed up, heap should stay put
+struct t_decode_allocations {
+    u64 heap;
+    u64 heap_frees;
+    u64 arena;
+    u64 reused;
+    u64 pooled_bytes; // freed blocks held for reuse
+};
+
+function decode_allocations() -> t_decode_allocations;
+
+// gives the pooled blocks back to the heap. images still alive are unaffected
+function release_decode_memory() -> void;
+
+// the widest simd kernels jpeg decoding runs, from 0 for none to 3 for avx-512, after
+// capping what the cpu has at the limit. see stbi_simd_level, the limit is for benchmarks
+function decoding_simd_level() -> int;
+function set_decoding_simd_limit(int level) -> void;
+
+#endif // __learngl_image__
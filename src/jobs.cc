@@ -0,0 +1,144 @@
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+#include "jobs.hh"
+
+namespace {
+    std::vector<std::thread> workers;
+    std::deque<jobs::t_job> queue;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool quit = false;
+    
+    // shared between a parallel_for caller and its helper jobs. helpers may start
+    // after the caller has already returned, so the last one out frees it
+    struct t_parallel_for {
+        void (* proc)(void * data, u64 index);
+        void * data;
+        u64 count;
+        
+        std::atomic<u64> next;
+        std::atomic<u64> finished;
+        std::atomic<uint> references;
+        
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    
+    function release(t_parallel_for * loop) -> void {
+        if (loop->references.fetch_sub(1) == 1) {
+            delete loop;
+        }
+    }
+    
+    function run_iterations(t_parallel_for * loop) -> void {
+        for (;;) {
+            let index = loop->next.fetch_add(1);
+            if (index >= loop->count) break;
+            
+            loop->proc(loop->data, index);
+            
+            if (loop->finished.fetch_add(1) + 1 == loop->count) {
+                std::lock_guard lock { loop->mutex };
+                loop->done.notify_all();
+            }
+        }
+    }
+    
+    function helper(void * data) -> void {
+        let loop = static_cast<t_parallel_for *>(data);
+        run_iterations(loop);
+        release(loop);
+    }
+    
+    function worker_main() -> void {
+        for (;;) {
+            jobs::t_job job;
+            
+            {
+                std::unique_lock lock { mutex };
+                wake.wait(lock, [] { return quit || !queue.empty(); });
+                
+                if (queue.empty()) return;
+                
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            
+            job.proc(job.data);
+        }
+    }
+}
+
+function jobs::init(uint worker_count) -> void {
+    m_assert(workers.empty());
+    
+    if (worker_count == 0) {
+        // leave one core to the main thread, it has the gl context
+        let cores = std::thread::hardware_concurrency();
+        worker_count = cores > 1 ? cores - 1 : 1;
+    }
+    
+    quit = false;
+    
+    for (uint i = 0; i < worker_count; i += 1) {
+        workers.emplace_back(worker_main);
+    }
+}
+
+function jobs::submit(t_job job) -> void {
+    m_assert(!workers.empty());
+    
+    {
+        std::lock_guard lock { mutex };
+        queue.push_back(job);
+    }
+    
+    wake.notify_one();
+}
+
+function jobs::parallel_for(u64 count, void (* proc)(void * data, u64 index), void * data) -> void {
+    if (count == 0) return;
+    
+    let loop = new t_parallel_for { .proc = proc, .data = data, .count = count };
+    let helpers = count - 1 < workers.size() ? count - 1 : workers.size();
+    
+    loop->references = static_cast<uint>(helpers + 1);
+    
+    for (u64 i = 0; i < helpers; i += 1) {
+        submit({ .proc = helper, .data = loop });
+    }
+    
+    run_iterations(loop);
+    
+    {
+        std::unique_lock lock { loop->mutex };
+        loop->done.wait(lock, [loop] { return loop->finished.load() == loop->count; });
+    }
+    
+    release(loop);
+}
+
+function jobs::worker_count() -> uint {
+    return static_cast<uint>(workers.size());
+}
+
+function jobs::terminate() -> void {
+    {
+        std::lock_guard lock { mutex };
+        quit = true;
+    }
+    
+    wake.notify_all();
+    
+    for (auto & worker : workers) {
+        worker.join();
+    }
+    
+    workers.clear();
+}
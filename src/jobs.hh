@@ -0,0 +1,25 @@
+#ifndef __learngl_jobs__
+#define __learngl_jobs__
+
+#include "common.hh"
+
+// a small pool of worker threads for cpu-side work (decoding, building meshes ...)
+// anything touching gl stays on the main thread
+namespace jobs {
+    struct t_job {
+        void (* proc)(void * data);
+        void * data;
+    };
+    
+    function init(uint worker_count = 0) -> void;
+    function submit(t_job job) -> void;
+    
+    // runs proc for every index in [0, count) on the workers and the calling thread,
+    // returns once all of them are done. safe to call from inside a job
+    function parallel_for(u64 count, void (* proc)(void * data, u64 index), void * data) -> void;
+    
+    function worker_count() -> uint;
+    function terminate() -> void;
+};
+
+#endif // __learngl_jobs__
@@ -0,0 +1,193 @@
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "jobs.hh"
+#include "loader.hh"
+
+namespace {
+    using t_clock = std::chrono::steady_clock;
+    
+    struct t_entry {
+        loader::t_asset asset;
+        std::vector<loader::t_asset_id> dependents;
+        uint unresolved;
+        
+        // seconds since run() started
+        float queued_at;
+        float built_at;
+        float done_at;
+        float build_time;
+        float upload_time;
+    };
+    
+    std::vector<t_entry> entries;
+    t_clock::time_point start;
+    float total_time = 0.f;
+    
+    // built assets waiting for their gl step
+    std::deque<loader::t_asset_id> built;
+    std::mutex mutex;
+    std::condition_variable wake;
+    
+    inline function since_start() -> float {
+        return std::chrono::duration<float>(t_clock::now() - start).count();
+    }
+    
+    function finish_build(loader::t_asset_id id) -> void {
+        {
+            std::lock_guard lock { mutex };
+            entries[id].built_at = since_start();
+            built.push_back(id);
+        }
+        
+        wake.notify_one();
+    }
+    
+    function build(void * data) -> void {
+        let id = static_cast<loader::t_asset_id>(reinterpret_cast<u64>(data));
+        let & asset = entries[id].asset;
+        
+        let then = since_start();
+        asset.build(asset.data);
+        entries[id].build_time = since_start() - then;
+        
+        finish_build(id);
+    }
+    
+    function dispatch(loader::t_asset_id id) -> void {
+        entries[id].queued_at = since_start();
+        
+        if (entries[id].asset.build) {
+            jobs::submit({ .proc = build, .data = reinterpret_cast<void *>(static_cast<u64>(id)) });
+        } else {
+            finish_build(id);
+        }
+    }
+    
+    // the asset is done, gl work included, its dependents may go
+    function complete(loader::t_asset_id id) -> void {
+        entries[id].done_at = since_start();
+        
+        for (let dependent : entries[id].dependents) {
+            entries[dependent].unresolved -= 1;
+            
+            if (entries[dependent].unresolved == 0) {
+                dispatch(dependent);
+            }
+        }
+    }
+}
+
+function loader::add(t_asset asset, std::initializer_list<t_asset_id> dependencies) -> t_asset_id {
+    let id = static_cast<t_asset_id>(entries.size());
+    
+    entries.push_back({ .asset = asset, .unresolved = static_cast<uint>(dependencies.size()) });
+    
+    for (let dependency : dependencies) {
+        m_assert(dependency < id); // declaring in order rules out cycles
+        entries[dependency].dependents.push_back(id);
+    }
+    
+    return id;
+}
+
+function loader::run() -> void {
+    start = t_clock::now();
+    
+    // the dependents lists don't change from here on, workers may read entries freely
+    for (t_asset_id id = 0; id < entries.size(); id += 1) {
+        if (entries[id].unresolved == 0) {
+            dispatch(id);
+        }
+    }
+    
+    // uploaded, their gl work still going
+    std::vector<t_asset_id> waiting;
+    
+    for (u64 done = 0; done < entries.size();) {
+        for (u64 i = 0; i < waiting.size();) {
+            let & entry = entries[waiting[i]];
+            
+            let then = since_start();
+            let ready = entry.asset.ready(entry.asset.data);
+            entry.upload_time += since_start() - then;
+            
+            if (ready) {
+                complete(waiting[i]);
+                done += 1;
+                
+                waiting.erase(waiting.begin() + i);
+            } else {
+                i += 1;
+            }
+        }
+        
+        if (done == entries.size()) break;
+        
+        t_asset_id id;
+        
+        {
+            std::unique_lock lock { mutex };
+            
+            // while something is in flight on the gpu side, come back to poll it
+            if (waiting.empty()) {
+                wake.wait(lock, [] { return !built.empty(); });
+            } else if (!wake.wait_for(lock, std::chrono::milliseconds(1), [] { return !built.empty(); })) {
+                continue;
+            }
+            
+            id = built.front();
+            built.pop_front();
+        }
+        
+        let & entry = entries[id];
+        
+        let then = since_start();
+        if (entry.asset.upload) entry.asset.upload(entry.asset.data);
+        entry.upload_time = since_start() - then;
+        
+        if (entry.asset.ready) {
+            waiting.push_back(id);
+        } else {
+            complete(id);
+            done += 1;
+        }
+    }
+    
+    total_time = since_start();
+}
+
+function loader::report() -> void {
+    float build_sum = 0.f;
+    float upload_sum = 0.f;
+    
+    std::printf("%-32s %10s %10s %10s %10s\n", "asset", "queued", "build", "upload", "done");
+    
+    for (let & entry : entries) {
+        std::printf(
+            "%-32s %8.2fms %8.2fms %8.2fms %8.2fms\n",
+            entry.asset.name,
+            entry.queued_at * 1000.f,
+            entry.build_time * 1000.f,
+            entry.upload_time * 1000.f,
+            entry.done_at * 1000.f
+        );
+        
+        build_sum += entry.build_time;
+        upload_sum += entry.upload_time;
+    }
+    
+    std::printf(
+        "%llu assets in %.2fms on %u workers (%.2fms of building, %.2fms of gl work)\n",
+        (unsigned long long) entries.size(),
+        total_time * 1000.f,
+        jobs::worker_count(),
+        build_sum * 1000.f,
+        upload_sum * 1000.f
+    );
+}
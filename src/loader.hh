@@ -0,0 +1,29 @@
+#ifndef __learngl_loader__
+#define __learngl_loader__
+
+#include <initializer_list>
+
+#include "common.hh"
+
+// startup asset loading. assets are declared up front together with the assets
+// they depend on; run() then builds everything that is ready in parallel on the
+// job workers, while the main thread performs the gl steps as builds complete
+namespace loader {
+    using t_asset_id = uint;
+    
+    struct t_asset {
+        char const * name;
+        void (* build)(void * data); // on a worker, no gl calls. may be null
+        void (* upload)(void * data); // on the gl thread. may be null
+        // on the gl thread, polled after upload until true, for gl work that goes on by
+        // itself such as shader compiles. other assets load in the meantime. may be null
+        bool32 (* ready)(void * data);
+        void * data;
+    };
+    
+    function add(t_asset asset, std::initializer_list<t_asset_id> dependencies = {}) -> t_asset_id;
+    function run() -> void;
+    function report() -> void;
+};
+
+#endif // __learngl_loader__
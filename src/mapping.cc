@@ -0,0 +1,77 @@
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapping.hh"
+
+function map_file(char const * path) -> t_mapping {
+    t_mapping result = {};
+    
+    #if defined(_WIN32)
+    let file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, null, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, null);
+    if (file == INVALID_HANDLE_VALUE) return {};
+    
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    
+    let object = CreateFileMappingA(file, null, PAGE_READONLY, 0, 0, null);
+    
+    if (!object) {
+        CloseHandle(file);
+        return {};
+    }
+    
+    result.data = static_cast<u8 const *>(MapViewOfFile(object, FILE_MAP_READ, 0, 0, 0));
+    result.size = size.QuadPart;
+    result.file = reinterpret_cast<intptr_t>(file);
+    result.object = reinterpret_cast<intptr_t>(object);
+    
+    if (!result.data) {
+        CloseHandle(object);
+        CloseHandle(file);
+        return {};
+    }
+    #else
+    let file = ::open(path, O_RDONLY);
+    if (file < 0) return {};
+    
+    struct stat info;
+    fstat(file, &info);
+    
+    let data = mmap(null, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    
+    if (data == MAP_FAILED) {
+        ::close(file);
+        return {};
+    }
+    
+    result.data = static_cast<u8 const *>(data);
+    result.size = info.st_size;
+    result.file = file;
+    #endif
+    
+    return result;
+}
+
+function unmap_file(t_mapping __in * mapping) -> void {
+    if (!mapping->data) return;
+    
+    #if defined(_WIN32)
+    UnmapViewOfFile(mapping->data);
+    CloseHandle(reinterpret_cast<HANDLE>(mapping->object));
+    CloseHandle(reinterpret_cast<HANDLE>(mapping->file));
+    #else
+    munmap(const_cast<u8 *>(mapping->data), mapping->size);
+    ::close((int) mapping->file);
+    #endif
+    
+    *mapping = {};
+}
@@ -0,0 +1,21 @@
+#ifndef __learngl_mapping__
+#define __learngl_mapping__
+
+#include <cstdint>
+
+#include "common.hh"
+
+// a whole file mapped read-only into memory, for formats that are used in place
+struct t_mapping {
+    u8 const * data; // null if the file couldn't be mapped
+    u64 size;
+    
+    // the platform's: the file, and on windows the mapping object
+    intptr_t file;
+    intptr_t object;
+};
+
+function map_file(char const * path) -> t_mapping;
+function unmap_file(t_mapping __in * mapping) -> void;
+
+#endif // __learngl_mapping__
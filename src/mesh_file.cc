@@ -0,0 +1,365 @@
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "mesh_file.hh"
+#include "optimize.hh"
+#include "pack.hh"
+
+namespace {
+    // header, then the section table, then the sections, each starting on a
+    // payload_alignment boundary so that they're used in place. readers skip the
+    // sections they don't know, so new ones can be added without a new version
+    u8 const file_magic[8] = { 0xAB, 'L', 'M', 'S', ' ', '1', 0xBB, '\n' };
+    constexpr u64 payload_alignment = 64;
+    
+    enum struct t_section_kind : uint32 {
+        layout = 1, // t_file_attributes, what the vertices hold and where
+        vertices = 2,
+        indices = 3, // uint32
+        lods = 4, // t_mesh_lod
+        meshlets = 5, // t_meshlet
+    };
+    
+    struct t_file_header {
+        u8 magic[8];
+        uint32 section_count;
+        uint32 vertex_stride;
+        float low[3];
+        float high[3];
+    };
+    
+    struct t_file_section {
+        t_section_kind kind;
+        uint32 count; // of elements
+        u64 offset;
+        u64 size;
+    };
+    
+    enum struct t_attribute_semantic : uint32 {
+        position = 1,
+        uv = 2,
+    };
+    
+    enum struct t_attribute_format : uint32 {
+        float32 = 1,
+    };
+    
+    struct t_file_attribute {
+        t_attribute_semantic semantic;
+        t_attribute_format format;
+        uint32 components;
+        uint32 offset;
+    };
+    
+    // t_vertex's, the only layout create_mesh takes for now
+    t_file_attribute const vertex_layout[] = {
+        { t_attribute_semantic::position, t_attribute_format::float32, 3, 0 },
+        { t_attribute_semantic::uv, t_attribute_format::float32, 2, sizeof(vec3) },
+    };
+    
+    inline function align(u64 value, u64 alignment) -> u64 {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+    
+    // obj indices count from 1, negative ones back from the last one read
+    inline function obj_index(long index, u64 count) -> long {
+        return index < 0 ? (long) count + index : index - 1;
+    }
+}
+
+function load_mesh_file(char const * path) -> t_mesh_file {
+    let packed = pack::find(path);
+    if (packed.ptr) return load_mesh_file(packed);
+    
+    let mapping = map_file(path);
+    if (!mapping.data) return {};
+    
+    let mesh = load_mesh_file({ .ptr = mapping.data, .len = mapping.size });
+    
+    if (!mesh.geometry.vertices.ptr) {
+        unmap_file(&mapping);
+        return {};
+    }
+    
+    mesh.mapping = mapping;
+    
+    return mesh;
+}
+
+function load_mesh_file(t_slice<u8 const> file) -> t_mesh_file {
+    t_file_header header;
+    
+    if (file.length() < sizeof(header)) return {};
+    std::memcpy(&header, file.ptr, sizeof(header));
+    
+    let ok = std::memcmp(header.magic, file_magic, sizeof(file_magic)) == 0;
+    ok = ok && header.vertex_stride == sizeof(t_vertex);
+    ok = ok && file.length() >= sizeof(header) + sizeof(t_file_section) * header.section_count;
+    
+    if (!ok) return {};
+    
+    t_mesh_file mesh = {
+        .low = { header.low[0], header.low[1], header.low[2] },
+        .high = { header.high[0], header.high[1], header.high[2] },
+    };
+    
+    bool32 layout_matches = false;
+    
+    for (uint32 i = 0; ok && i < header.section_count; i += 1) {
+        t_file_section section;
+        std::memcpy(&section, file.ptr + sizeof(header) + sizeof(section) * i, sizeof(section));
+        
+        ok = section.offset % payload_alignment == 0 && section.offset <= file.length() && section.size <= file.length() - section.offset;
+        if (!ok) break;
+        
+        let data = file.ptr + section.offset;
+        
+        switch (section.kind) {
+            case t_section_kind::layout:
+                layout_matches = section.size == sizeof(vertex_layout) && std::memcmp(data, vertex_layout, sizeof(vertex_layout)) == 0;
+                break;
+            
+            case t_section_kind::vertices:
+                ok = section.size == (u64) section.count * header.vertex_stride;
+                mesh.geometry.vertices = { .ptr = const_cast<t_vertex *>(reinterpret_cast<t_vertex const *>(data)), .len = section.count };
+                break;
+            
+            case t_section_kind::indices:
+                ok = section.size == sizeof(uint32) * section.count && section.count % 3 == 0;
+                mesh.geometry.indices = { .ptr = const_cast<uint32 *>(reinterpret_cast<uint32 const *>(data)), .len = section.count };
+                break;
+            
+            case t_section_kind::lods:
+                ok = section.size == sizeof(t_mesh_lod) * section.count;
+                mesh.lods = { .ptr = reinterpret_cast<t_mesh_lod const *>(data), .len = section.count };
+                break;
+            
+            case t_section_kind::meshlets:
+                ok = section.size == sizeof(t_meshlet) * section.count;
+                mesh.meshlets = { .ptr = reinterpret_cast<t_meshlet const *>(data), .len = section.count };
+                break;
+            
+            default:
+                break;
+        }
+    }
+    
+    ok = ok && layout_matches && mesh.geometry.vertices.length() && mesh.geometry.indices.length();
+    
+    // what points into the indices must stay inside them, and the indices inside the
+    // vertices. create_mesh would otherwise read past them, or narrow a bad index into a
+    // good looking one. one pass over memory that's mapped anyway, every lod's included
+    let index_count = mesh.geometry.indices.length();
+    let vertex_count = mesh.geometry.vertices.length();
+    
+    uint32 highest = 0;
+    for (u64 i = 0; ok && i < index_count; i += 1) highest = std::max(highest, mesh.geometry.indices[i]);
+    
+    ok = ok && highest < vertex_count;
+    
+    for (u64 i = 0; ok && i < mesh.lods.length(); i += 1) {
+        ok = (u64) mesh.lods[i].first_index + mesh.lods[i].index_count <= index_count && mesh.lods[i].index_count % 3 == 0;
+    }
+    
+    // lod 0 is the whole mesh, the others after it
+    ok = ok && (!mesh.lods.length() || mesh.lods[0].first_index == 0);
+    
+    for (u64 i = 0; ok && i < mesh.meshlets.length(); i += 1) {
+        ok = (u64) mesh.meshlets[i].first_index + mesh.meshlets[i].index_count <= index_count;
+    }
+    
+    return ok ? mesh : t_mesh_file {};
+}
+
+function free_mesh_file(t_mesh_file __in * file) -> void {
+    unmap_file(&file->mapping);
+    *file = {};
+}
+
+function save_mesh_file(char const * path, t_geometry geometry, t_slice<t_mesh_lod const> lods, t_slice<t_meshlet const> meshlets) -> bool32 {
+    struct t_payload {
+        t_section_kind kind;
+        uint32 count;
+        void const * data;
+        u64 size;
+    };
+    
+    t_payload const payloads[] = {
+        { t_section_kind::layout, sizeof(vertex_layout) / sizeof(t_file_attribute), vertex_layout, sizeof(vertex_layout) },
+        { t_section_kind::vertices, (uint32) geometry.vertices.length(), geometry.vertices.ptr, sizeof(t_vertex) * geometry.vertices.length() },
+        { t_section_kind::indices, (uint32) geometry.indices.length(), geometry.indices.ptr, sizeof(uint32) * geometry.indices.length() },
+        { t_section_kind::lods, (uint32) lods.length(), lods.ptr, sizeof(t_mesh_lod) * lods.length() },
+        { t_section_kind::meshlets, (uint32) meshlets.length(), meshlets.ptr, sizeof(t_meshlet) * meshlets.length() },
+    };
+    
+    constexpr uint32 section_count = sizeof(payloads) / sizeof(t_payload);
+    
+    t_file_header header = { .section_count = section_count, .vertex_stride = sizeof(t_vertex) };
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    
+    if (geometry.vertices.length()) {
+        vec3 low = geometry.vertices[0].position;
+        vec3 high = low;
+        
+        for (u64 i = 0; i < geometry.vertices.length(); i += 1) {
+            low = glm::min(low, geometry.vertices[i].position);
+            high = glm::max(high, geometry.vertices[i].position);
+        }
+        
+        for (int k = 0; k < 3; k += 1) {
+            header.low[k] = low[k];
+            header.high[k] = high[k];
+        }
+    }
+    
+    t_file_section sections[section_count];
+    u64 offset = align(sizeof(header) + sizeof(sections), payload_alignment);
+    
+    for (uint32 i = 0; i < section_count; i += 1) {
+        sections[i] = { .kind = payloads[i].kind, .count = payloads[i].count, .offset = offset, .size = payloads[i].size };
+        offset = align(offset + payloads[i].size, payload_alignment);
+    }
+    
+    let file = std::fopen(path, "wb");
+    if (!file) return false;
+    
+    u8 static const padding[payload_alignment] = {};
+    
+    bool32 ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && std::fwrite(sections, sizeof(sections), 1, file) == 1;
+    
+    u64 written = sizeof(header) + sizeof(sections);
+    
+    for (uint32 i = 0; ok && i < section_count; i += 1) {
+        ok = std::fwrite(padding, 1, sections[i].offset - written, file) == sections[i].offset - written;
+        ok = ok && std::fwrite(payloads[i].data, 1, payloads[i].size, file) == payloads[i].size;
+        written = sections[i].offset + sections[i].size;
+    }
+    
+    std::fclose(file);
+    
+    return ok;
+}
+
+function convert_obj(char const * input, char const * output) -> bool32 {
+    let file = std::fopen(input, "rb");
+    if (!file) return false;
+    
+    std::fseek(file, 0, SEEK_END);
+    let size = (u64) std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    
+    std::vector<char> text(size + 1);
+    let read = std::fread(text.data(), 1, size, file) == size;
+    std::fclose(file);
+    
+    if (!read) return false;
+    text[size] = '\0';
+    
+    std::vector<vec3> positions;
+    std::vector<vec2> uvs;
+    std::vector<t_vertex> corners; // three for each triangle, welded below
+    
+    let ok = true;
+    
+    for (char * line = text.data(); ok && *line; ) {
+        let end = line + std::strcspn(line, "\r\n");
+        let next = *end ? end + 1 : end;
+        *end = '\0';
+        
+        if (line[0] == 'v' && line[1] == ' ') {
+            vec3 position;
+            ok = std::sscanf(line + 2, "%f %f %f", &position.x, &position.y, &position.z) == 3;
+            positions.push_back(position);
+        } else if (line[0] == 'v' && line[1] == 't' && line[2] == ' ') {
+            vec2 uv = {};
+            ok = std::sscanf(line + 3, "%f %f", &uv.x, &uv.y) >= 1;
+            
+            // obj's v goes up the image, ours down it
+            uvs.push_back({ uv.x, 1.f - uv.y });
+        } else if (line[0] == 'f' && line[1] == ' ') {
+            // a fan from the first corner
+            t_vertex polygon[3];
+            uint count = 0;
+            
+            for (char * cursor = line + 2; ok && *cursor; ) {
+                while (*cursor == ' ' || *cursor == '\t') cursor += 1;
+                if (!*cursor) break;
+                
+                let position = obj_index(std::strtol(cursor, &cursor, 10), positions.size());
+                long uv = -1;
+                
+                if (*cursor == '/') {
+                    cursor += 1;
+                    if (*cursor != '/') uv = obj_index(std::strtol(cursor, &cursor, 10), uvs.size());
+                }
+                
+                // normals aren't kept
+                while (*cursor && *cursor != ' ' && *cursor != '\t') cursor += 1;
+                
+                ok = position >= 0 && position < (long) positions.size() && uv < (long) uvs.size();
+                if (!ok) break;
+                
+                let vertex = t_vertex { .position = positions[position], .uv = uv >= 0 ? uvs[uv] : vec2 { 0.f, 0.f } };
+                
+                if (count < 3) {
+                    polygon[count] = vertex;
+                } else {
+                    polygon[1] = polygon[2];
+                    polygon[2] = vertex;
+                }
+                
+                count += 1;
+                
+                if (count >= 3) corners.insert(corners.end(), polygon, polygon + 3);
+            }
+        }
+        
+        line = next;
+    }
+    
+    if (!ok || corners.empty()) return false;
+    
+    // as create_mesh would: welded, then reordered
+    std::vector<uint32> indices(corners.size());
+    
+    t_slice<t_vertex> vertices = { .ptr = corners.data(), .len = corners.size() };
+    t_slice<uint32> index_slice = { .ptr = indices.data(), .len = indices.size() };
+    
+    vertices.len = weld_vertices(vertices, index_slice);
+    optimize_vertex_cache(index_slice, vertices.length());
+    vertices.len = optimize_vertex_fetch(vertices, index_slice);
+    
+    let meshlets = split_meshlets(vertices, index_slice, 64, 124);
+    
+    float const ratios[] = { 0.5f, 0.25f, 0.125f };
+    let chain = build_lod_chain({ .ptr = vertices.ptr, .len = vertices.length() }, { .ptr = indices.data(), .len = indices.size() }, { .ptr = ratios, .len = 3 });
+    
+    let saved = save_mesh_file(
+        output,
+        { .vertices = vertices, .indices = { .ptr = chain.indices.data(), .len = chain.indices.size() } },
+        { .ptr = chain.lods.data(), .len = chain.lods.size() },
+        { .ptr = meshlets.data(), .len = meshlets.size() }
+    );
+    
+    std::printf(
+        "%s: %llu triangles, %llu vertices welded from %llu, %llu meshlets\n",
+        input,
+        (unsigned long long) indices.size() / 3,
+        (unsigned long long) vertices.length(),
+        (unsigned long long) corners.size(),
+        (unsigned long long) meshlets.size()
+    );
+    
+    for (u64 i = 1; i < chain.lods.size(); i += 1) {
+        std::printf("  lod %llu: %u triangles, error %g\n", (unsigned long long) i, chain.lods[i].index_count / 3, chain.lods[i].error);
+    }
+    
+    std::printf("  lods built in %.1fms\n", chain.time * 1000.f);
+    
+    return saved;
+}
@@ -0,0 +1,36 @@
+#ifndef __learngl_mesh_file__
+#define __learngl_mesh_file__
+
+#include "common.hh"
+#include "geometry.hh"
+#include "mapping.hh"
+#include "meshlets.hh"
+#include "simplify.hh"
+
+// meshes converted ahead of time, so that loading one is mapping the file and handing
+// create_mesh views into it. they're stored the way create_mesh would leave them, welded
+// and in vertex cache and fetch order, with their meshlets, so it's told not to redo it
+struct t_mesh_file {
+    t_geometry geometry; // into the file. no vertices if loading failed
+    vec3 low; // the bounds
+    vec3 high;
+    t_slice<t_mesh_lod const> lods; // see simplify.hh, all of them in the indices
+    t_slice<t_meshlet const> meshlets; // of lod 0, for create_cluster_mesh
+    
+    t_mapping mapping; // not mapped when the file is used in place from the asset pack
+};
+
+// paths are looked up in the asset pack first
+function load_mesh_file(char const * path) -> t_mesh_file;
+function load_mesh_file(t_slice<u8 const> file) -> t_mesh_file;
+function free_mesh_file(t_mesh_file __in * file) -> void;
+
+// the geometry must be indexed and reordered already, see convert_obj
+function save_mesh_file(char const * path, t_geometry geometry, t_slice<t_mesh_lod const> lods, t_slice<t_meshlet const> meshlets) -> bool32;
+
+// a wavefront obj's positions, uvs and faces, polygons split into fans, then welded,
+// reordered and split into meshlets as create_mesh and build_meshlets would, with lods
+// of a half, a quarter and an eighth of the triangles after it
+function convert_obj(char const * input, char const * output) -> bool32;
+
+#endif // __learngl_mesh_file__
@@ -0,0 +1,405 @@
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "meshlets.hh"
+
+namespace {
+    constexpr int bounds_arrays = 8; // center x y z, radius, cone axis x y z, cutoff
+    
+    // padding clusters get a radius no plane can pass
+    constexpr float never_visible = -1e30f;
+    
+    struct t_gpu_bounds {
+        vec4 sphere;
+        vec4 cone; // axis, cutoff
+    };
+    
+    // DrawElementsIndirectCommand
+    struct t_draw_command {
+        uint32 count;
+        uint32 instance_count;
+        uint32 first_index;
+        int base_vertex;
+        uint32 base_instance;
+    };
+    
+    char const * cull_source = R"(
+        #version 450 core
+        
+        layout (local_size_x = 64) in;
+        
+        struct t_bounds {
+            vec4 sphere;
+            vec4 cone;
+        };
+        
+        struct t_draw_command {
+            uint count;
+            uint instance_count;
+            uint first_index;
+            int base_vertex;
+            uint base_instance;
+        };
+        
+        layout (std430, binding = 0) readonly buffer bounds_buffer { t_bounds bounds[]; };
+        layout (std430, binding = 1) buffer command_buffer { t_draw_command commands[]; };
+        
+        uniform vec4 planes[6];
+        uniform vec3 camera;
+        uniform uint meshlet_count;
+        
+        void main() {
+            uint i = gl_GlobalInvocationID.x;
+            if (i >= meshlet_count) return;
+            
+            vec4 sphere = bounds[i].sphere;
+            vec4 cone = bounds[i].cone;
+            
+            bool visible = true;
+            
+            for (int p = 0; p < 6; p += 1) {
+                visible = visible && dot(planes[p].xyz, sphere.xyz) + planes[p].w >= -sphere.w;
+            }
+            
+            vec3 view = sphere.xyz - camera;
+            visible = visible && dot(view, cone.xyz) < cone.w * length(view) + sphere.w;
+            
+            commands[i].instance_count = visible ? 1u : 0u;
+        }
+    )";
+    
+    t_cluster_culling culling = t_cluster_culling::cpu;
+    uint cull_program = 0;
+    
+    // reused between draws
+    std::vector<int> draw_counts;
+    std::vector<void const *> draw_offsets;
+    
+    inline function rounded_count(u64 meshlet_count) -> u64 {
+        return (meshlet_count + 3) & ~(u64) 3;
+    }
+    
+    function bound(t_meshlet * meshlet, t_slice<t_vertex> vertices, t_slice<uint32> indices) -> void {
+        let first = indices.ptr + meshlet->first_index;
+        
+        vec3 low = vertices[first[0]].position;
+        vec3 high = low;
+        
+        for (uint i = 0; i < meshlet->index_count; i += 1) {
+            let position = vertices[first[i]].position;
+            low = glm::min(low, position);
+            high = glm::max(high, position);
+        }
+        
+        meshlet->center = (low + high) * 0.5f;
+        meshlet->radius = 0.f;
+        
+        for (uint i = 0; i < meshlet->index_count; i += 1) {
+            meshlet->radius = std::fmax(meshlet->radius, glm::distance(meshlet->center, vertices[first[i]].position));
+        }
+        
+        // the cone's axis is the mean of the normals, its width the one furthest from it.
+        // degenerate triangles have no normal and don't count
+        vec3 normals[128];
+        uint normal_count = 0;
+        vec3 sum = {};
+        
+        for (uint i = 0; i < meshlet->index_count; i += 3) {
+            let a = vertices[first[i]].position;
+            let b = vertices[first[i + 1]].position;
+            let c = vertices[first[i + 2]].position;
+            
+            let normal = glm::cross(b - a, c - a);
+            let length = glm::length(normal);
+            if (length <= epsilon) continue;
+            
+            normals[normal_count] = normal / length;
+            sum += normals[normal_count];
+            normal_count += 1;
+        }
+        
+        let sum_length = glm::length(sum);
+        
+        meshlet->cone_axis = sum_length > epsilon ? sum / sum_length : vec3 { 0.f, 0.f, 1.f };
+        meshlet->cone_cutoff = 1.f;
+        
+        if (normal_count == 0 || sum_length <= epsilon) return;
+        
+        float min_dot = 1.f;
+        
+        for (uint i = 0; i < normal_count; i += 1) {
+            min_dot = std::fmin(min_dot, glm::dot(normals[i], meshlet->cone_axis));
+        }
+        
+        // wider than a hemisphere, some triangle always faces the camera
+        if (min_dot > 0.f) meshlet->cone_cutoff = std::sqrt(1.f - min_dot * min_dot);
+    }
+    
+    // gribb and hartmann: the clip space planes pulled back through mvp land in the mesh's
+    // own space. normalized so that distances to them are true distances
+    function frustum_planes(mat4 mvp, vec4 __out * planes) -> void {
+        for (int i = 0; i < 3; i += 1) {
+            let row = vec4 { mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i] };
+            let w = vec4 { mvp[0][3], mvp[1][3], mvp[2][3], mvp[3][3] };
+            
+            planes[i * 2] = w + row;
+            planes[i * 2 + 1] = w - row;
+        }
+        
+        for (int i = 0; i < 6; i += 1) {
+            planes[i] /= glm::length(vec3 { planes[i] });
+        }
+    }
+    
+    // four clusters a lane each: in front of all six planes and not facing away
+    function cull_cpu(t_cluster_mesh __in * clusters, vec4 __in * planes, vec3 camera) -> void {
+        let stride = rounded_count(clusters->meshlets.length());
+        let bounds = clusters->bounds;
+        let index_size = clusters->mesh->index_type == GL_UNSIGNED_SHORT ? sizeof(u16) : sizeof(uint32);
+        
+        let zero = _mm_setzero_ps();
+        
+        for (u64 i = 0; i < stride; i += 4) {
+            let x = _mm_load_ps(bounds + 0 * stride + i);
+            let y = _mm_load_ps(bounds + 1 * stride + i);
+            let z = _mm_load_ps(bounds + 2 * stride + i);
+            let radius = _mm_load_ps(bounds + 3 * stride + i);
+            
+            let visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            
+            for (int p = 0; p < 6; p += 1) {
+                let distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].x), x), _mm_mul_ps(_mm_set1_ps(planes[p].y), y)),
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].z), z), _mm_set1_ps(planes[p].w))
+                );
+                
+                visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+            }
+            
+            let view_x = _mm_sub_ps(x, _mm_set1_ps(camera.x));
+            let view_y = _mm_sub_ps(y, _mm_set1_ps(camera.y));
+            let view_z = _mm_sub_ps(z, _mm_set1_ps(camera.z));
+            
+            let along = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(view_x, _mm_load_ps(bounds + 4 * stride + i)), _mm_mul_ps(view_y, _mm_load_ps(bounds + 5 * stride + i))),
+                _mm_mul_ps(view_z, _mm_load_ps(bounds + 6 * stride + i))
+            );
+            
+            let distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(view_x, view_x), _mm_mul_ps(view_y, view_y)), _mm_mul_ps(view_z, view_z)));
+            let limit = _mm_add_ps(_mm_mul_ps(_mm_load_ps(bounds + 7 * stride + i), distance), radius);
+            
+            visible = _mm_and_ps(visible, _mm_cmplt_ps(along, limit));
+            
+            let mask = _mm_movemask_ps(visible);
+            
+            for (int lane = 0; lane < 4; lane += 1) {
+                if (!(mask & 1 << lane)) continue;
+                
+                let meshlet = &clusters->meshlets[i + lane];
+                draw_counts.push_back((int) meshlet->index_count);
+                draw_offsets.push_back(reinterpret_cast<void const *>(index_size * meshlet->first_index));
+            }
+        }
+    }
+    
+    function create_cull_program() -> uint {
+        let shader = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(shader, 1, &cull_source, null);
+        glCompileShader(shader);
+        
+        int ok = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+        m_assert(ok);
+        
+        let program = glCreateProgram();
+        glAttachShader(program, shader);
+        glLinkProgram(program);
+        
+        glGetProgramiv(program, GL_LINK_STATUS, &ok);
+        m_assert(ok);
+        
+        glDeleteShader(shader);
+        
+        return program;
+    }
+    
+    function cull_gpu(t_cluster_mesh __in * clusters, vec4 __in * planes, vec3 camera) -> void {
+        if (!cull_program) cull_program = create_cull_program();
+        
+        int drawing_program = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &drawing_program);
+        
+        glUseProgram(cull_program);
+        glUniform4fv(glGetUniformLocation(cull_program, "planes"), 6, &planes[0].x);
+        glUniform3f(glGetUniformLocation(cull_program, "camera"), camera.x, camera.y, camera.z);
+        glUniform1ui(glGetUniformLocation(cull_program, "meshlet_count"), (uint) clusters->meshlets.length());
+        
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, clusters->bounds_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, clusters->command_buffer);
+        glDispatchCompute((uint) (clusters->meshlets.length() + 63) / 64, 1, 1);
+        
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+        glUseProgram(drawing_program);
+    }
+}
+
+function split_meshlets(t_slice<t_vertex> vertices, t_slice<uint32> indices, uint max_vertices, uint max_triangles) -> std::vector<t_meshlet> {
+    m_assert(indices.length() > 0 && max_triangles <= 128);
+    
+    // greedily, in the index buffer's order. a vertex belongs to the meshlet being
+    // built when its stamp is that meshlet's number
+    std::vector<t_meshlet> meshlets;
+    std::vector<uint32> stamps(vertices.length(), ~0u);
+    
+    t_meshlet current = {};
+    uint vertex_count = 0;
+    
+    for (u64 i = 0; i < indices.length(); i += 3) {
+        uint added = 0;
+        for (int k = 0; k < 3; k += 1) {
+            added += stamps[indices[i + k]] != meshlets.size();
+        }
+        
+        // full, the triangle starts the next one
+        if (vertex_count + added > max_vertices || current.index_count / 3 + 1 > max_triangles) {
+            meshlets.push_back(current);
+            current = { .first_index = (uint32) i };
+            vertex_count = 0;
+        }
+        
+        for (int k = 0; k < 3; k += 1) {
+            if (stamps[indices[i + k]] != meshlets.size()) {
+                stamps[indices[i + k]] = (uint32) meshlets.size();
+                vertex_count += 1;
+            }
+        }
+        
+        current.index_count += 3;
+    }
+    
+    meshlets.push_back(current);
+    
+    for (auto & meshlet : meshlets) {
+        bound(&meshlet, vertices, indices);
+    }
+    
+    return meshlets;
+}
+
+function build_meshlets(t_mesh * mesh, uint max_vertices, uint max_triangles) -> t_cluster_mesh {
+    let meshlets = split_meshlets(mesh->vertices, mesh->indices, max_vertices, max_triangles);
+    return create_cluster_mesh(mesh, { .ptr = meshlets.data(), .len = meshlets.size() });
+}
+
+function create_cluster_mesh(t_mesh * mesh, t_slice<t_meshlet const> meshlets) -> t_cluster_mesh {
+    let count = meshlets.length();
+    let stride = rounded_count(count);
+    
+    t_cluster_mesh clusters = { .mesh = mesh };
+    
+    clusters.storage = std::malloc(sizeof(t_meshlet) * count + sizeof(float) * bounds_arrays * stride + 16);
+    clusters.meshlets = { .ptr = static_cast<t_meshlet *>(clusters.storage), .len = count };
+    
+    // 16 byte aligned for the sse loads
+    let bounds_address = (reinterpret_cast<u64>(clusters.meshlets.ptr + count) + 15) & ~(u64) 15;
+    clusters.bounds = reinterpret_cast<float *>(bounds_address);
+    
+    std::vector<t_gpu_bounds> gpu_bounds(count);
+    std::vector<t_draw_command> commands(count);
+    
+    for (u64 i = 0; i < stride; i += 1) {
+        if (i >= count) {
+            for (int k = 0; k < bounds_arrays; k += 1) clusters.bounds[k * stride + i] = 0.f;
+            clusters.bounds[3 * stride + i] = never_visible;
+            continue;
+        }
+        
+        let meshlet = &clusters.meshlets[i];
+        *meshlet = meshlets[i];
+        
+        float const values[bounds_arrays] = {
+            meshlet->center.x, meshlet->center.y, meshlet->center.z, meshlet->radius,
+            meshlet->cone_axis.x, meshlet->cone_axis.y, meshlet->cone_axis.z, meshlet->cone_cutoff,
+        };
+        
+        for (int k = 0; k < bounds_arrays; k += 1) {
+            clusters.bounds[k * stride + i] = values[k];
+        }
+        
+        gpu_bounds[i] = { .sphere = { meshlet->center, meshlet->radius }, .cone = { meshlet->cone_axis, meshlet->cone_cutoff } };
+        commands[i] = { .count = meshlet->index_count, .instance_count = 1, .first_index = meshlet->first_index };
+    }
+    
+    glCreateBuffers(1, &clusters.bounds_buffer);
+    glNamedBufferStorage(clusters.bounds_buffer, sizeof(t_gpu_bounds) * count, gpu_bounds.data(), 0);
+    
+    glCreateBuffers(1, &clusters.command_buffer);
+    glNamedBufferStorage(clusters.command_buffer, sizeof(t_draw_command) * count, commands.data(), 0);
+    
+    return clusters;
+}
+
+function destroy_meshlets(t_cluster_mesh __in * clusters) -> void {
+    glDeleteBuffers(1, &clusters->bounds_buffer);
+    glDeleteBuffers(1, &clusters->command_buffer);
+    std::free(clusters->storage);
+    
+    *clusters = {};
+}
+
+function set_cluster_culling(t_cluster_culling mode) -> void {
+    culling = mode;
+}
+
+function cluster_culling() -> t_cluster_culling {
+    return culling;
+}
+
+function draw_clusters(t_cluster_mesh __in * clusters, mat4 model, mat4 mvp, vec3 camera_position) -> uint {
+    let count = clusters->meshlets.length();
+    
+    glBindVertexArray(clusters->mesh->vao);
+    
+    if (culling == t_cluster_culling::none) {
+        glDrawElements(GL_TRIANGLES, clusters->mesh->indices.length(), clusters->mesh->index_type, 0);
+        return (uint) count;
+    }
+    
+    vec4 planes[6];
+    frustum_planes(mvp, planes);
+    
+    // the bounds are in the mesh's space, the camera is brought into it
+    let camera = vec3 { glm::inverse(model) * vec4 { camera_position, 1.f } };
+    
+    if (culling == t_cluster_culling::gpu) {
+        cull_gpu(clusters, planes, camera);
+        
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, clusters->command_buffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, clusters->mesh->index_type, null, (int) count, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        
+        return (uint) count;
+    }
+    
+    draw_counts.clear();
+    draw_offsets.clear();
+    
+    cull_cpu(clusters, planes, camera);
+    
+    if (!draw_counts.empty()) {
+        glMultiDrawElements(GL_TRIANGLES, draw_counts.data(), clusters->mesh->index_type, draw_offsets.data(), (int) draw_counts.size());
+    }
+    
+    return (uint) draw_counts.size();
+}
+
+function release_cluster_culling() -> void {
+    if (cull_program) glDeleteProgram(cull_program);
+    cull_program = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef __learngl_meshlets__
+#define __learngl_meshlets__
+
+#include <vector>
+
+#include "common.hh"
+#include "render.hh"
+
+// meshes split into small clusters, each with a bounding sphere and a cone around its
+// triangles' normals, so that clusters outside the view or facing away are dropped before
+// drawing instead of whole nodes. a cluster is a run of the mesh's own index buffer, which
+// create_mesh left in vertex cache order, so the visible ones go out in one multi draw
+struct t_meshlet {
+    uint32 first_index;
+    uint32 index_count;
+    vec3 center; // in the mesh's own space
+    float radius;
+    vec3 cone_axis;
+    float cone_cutoff; // sine of the cone's half angle, 1 when it's too wide to ever cull
+};
+
+enum struct t_cluster_culling : int {
+    none,
+    cpu, // sse, four clusters at a time
+    gpu, // a compute shader turning the clusters' indirect draws on and off
+};
+
+struct t_cluster_mesh {
+    t_mesh * mesh;
+    t_slice<t_meshlet> meshlets;
+    float * bounds; // the spheres and cones as 8 arrays of the meshlet count rounded up to 4
+    
+    uint bounds_buffer; // for the compute culling
+    uint command_buffer;
+    
+    void * storage;
+};
+
+// the mesh must be indexed, and outlive the clusters
+function build_meshlets(t_mesh * mesh, uint max_vertices, uint max_triangles) -> t_cluster_mesh;
+
+// build_meshlets in steps: the split and the bounds need no gl, for tools like the mesh
+// file converter. the meshlets must be of the mesh's indices as they are, so create_mesh
+// mustn't have reordered them after the split
+function split_meshlets(t_slice<t_vertex> vertices, t_slice<uint32> indices, uint max_vertices, uint max_triangles) -> std::vector<t_meshlet>;
+function create_cluster_mesh(t_mesh * mesh, t_slice<t_meshlet const> meshlets) -> t_cluster_mesh;
+function destroy_meshlets(t_cluster_mesh __in * clusters) -> void;
+
+function set_cluster_culling(t_cluster_culling culling) -> void;
+function cluster_culling() -> t_cluster_culling;
+
+// with whatever program is bound. the matrices take the mesh's own space to the world
+// and to clip space. returns how many clusters were drawn, with gpu culling how many
+// were submitted since the count never comes back to the cpu
+function draw_clusters(t_cluster_mesh __in * clusters, mat4 model, mat4 mvp, vec3 camera_position) -> uint;
+
+function release_cluster_culling() -> void; // the compute program, on exit
+
+#endif // __learngl_meshlets__
@@ -0,0 +1,301 @@
+
+#include <cmath>
+#include <cstdlib>
+#include <immintrin.h>
+
+#include "cpu.hh"
+#include "jobs.hh"
+#include "mips.hh"
+
+namespace {
+    constexpr int max_taps = 6;
+    constexpr int encode_table_size = 16384;
+    
+    float srgb_to_linear[256];
+    u8 linear_to_srgb[encode_table_size];
+    
+    // the weights of one 2x decimation along one axis. output texel x reads the
+    // source texels 2x + offset ... 2x + offset + count - 1, wrapping at the edges
+    struct t_taps {
+        int count;
+        int offset;
+        float weights[max_taps];
+    };
+    
+    inline function bessel_i0(float x) -> float {
+        float sum = 1.f;
+        float term = 1.f;
+        
+        for (int k = 1; k < 16; k += 1) {
+            term *= (x * 0.5f / k) * (x * 0.5f / k);
+            sum += term;
+        }
+        
+        return sum;
+    }
+    
+    function make_taps(t_mip_filter filter, int source_size) -> t_taps {
+        if (source_size == 1) {
+            return { .count = 1, .offset = 0, .weights = { 1.f } };
+        }
+        
+        if (filter == t_mip_filter::box) {
+            return { .count = 2, .offset = 0, .weights = { 0.5f, 0.5f } };
+        }
+        
+        // sinc with the cutoff at the new nyquist frequency, windowed to a radius of three
+        // source texels. the output texel centre sits between source texels 2x and 2x + 1
+        t_taps taps = { .count = 6, .offset = -2 };
+        
+        float const radius = 3.f;
+        float const beta = 4.f;
+        float sum = 0.f;
+        
+        for (int i = 0; i < taps.count; i += 1) {
+            let distance = (float) (i + taps.offset) - 0.5f;
+            let t = distance / 2.f;
+            let sinc = std::fabsf(t) < epsilon ? 1.f : std::sinf(pi * t) / (pi * t);
+            let r = distance / radius;
+            let window = bessel_i0(beta * std::sqrtf(m_clamp(1.f - r * r, 0.f, 1.f))) / bessel_i0(beta);
+            
+            taps.weights[i] = sinc * window;
+            sum += taps.weights[i];
+        }
+        
+        for (int i = 0; i < taps.count; i += 1) {
+            taps.weights[i] /= sum;
+        }
+        
+        return taps;
+    }
+    
+    function init_tables() -> void {
+        for (int i = 0; i < 256; i += 1) {
+            let c = i / 255.f;
+            srgb_to_linear[i] = c <= 0.04045f ? c / 12.92f : std::powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        
+        for (int i = 0; i < encode_table_size; i += 1) {
+            let l = (float) i / (encode_table_size - 1);
+            let c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::powf(l, 1.f / 2.4f) - 0.055f;
+            linear_to_srgb[i] = (u8) m_clamp((int) (c * 255.f + 0.5f), 0, 255);
+        }
+    }
+    
+    inline function encode(float value, bool32 srgb) -> u8 {
+        let v = m_clamp(value, 0.f, 1.f);
+        
+        return srgb
+            ? linear_to_srgb[(int) (v * (encode_table_size - 1) + 0.5f)]
+            : (u8) (v * 255.f + 0.5f);
+    }
+    
+    // out = sum of weights[k] * rows[k], the hot loop of the vertical pass
+    function weighted_sum_scalar(float * out, float const * const * rows, float const * weights, int count, u64 length) -> void {
+        for (u64 i = 0; i < length; i += 1) {
+            float sum = 0.f;
+            
+            for (int k = 0; k < count; k += 1) {
+                sum += weights[k] * rows[k][i];
+            }
+            
+            out[i] = sum;
+        }
+    }
+    
+    m_target_avx2 function weighted_sum_avx2(float * out, float const * const * rows, float const * weights, int count, u64 length) -> void {
+        u64 i = 0;
+        
+        for (; i + 8 <= length; i += 8) {
+            let sum = _mm256_setzero_ps();
+            
+            for (int k = 0; k < count; k += 1) {
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+            }
+            
+            _mm256_storeu_ps(out + i, sum);
+        }
+        
+        if (i < length) {
+            float const * tail[max_taps];
+            for (int k = 0; k < count; k += 1) tail[k] = rows[k] + i;
+            weighted_sum_scalar(out + i, tail, weights, count, length - i);
+        }
+    }
+    
+    struct t_level_job {
+        float const * source; // linear, source_width * source_height * channels
+        float * horizontal; // source_height rows of width * channels
+        float * target; // linear, width * height * channels
+        u8 * pixels; // encoded result
+        
+        int source_width;
+        int source_height;
+        int width;
+        int height;
+        int channels;
+        bool32 srgb;
+        
+        t_taps taps_x;
+        t_taps taps_y;
+        
+        void (* weighted_sum)(float *, float const * const *, float const *, int, u64);
+    };
+    
+    function decode_row(void * data, u64 y) -> void {
+        let job = static_cast<t_level_job *>(data);
+        let row_length = (u64) job->width * job->channels;
+        let in = job->pixels + y * row_length;
+        let out = job->target + y * row_length;
+        
+        for (u64 i = 0; i < row_length; i += 1) {
+            out[i] = job->srgb ? srgb_to_linear[in[i]] : in[i] / 255.f;
+        }
+    }
+    
+    function filter_row_horizontal(void * data, u64 y) -> void {
+        let job = static_cast<t_level_job *>(data);
+        let n = job->channels;
+        let in = job->source + y * job->source_width * n;
+        let out = job->horizontal + y * job->width * n;
+        let taps = &job->taps_x;
+        
+        for (int x = 0; x < job->width; x += 1) {
+            for (int c = 0; c < n; c += 1) {
+                out[x * n + c] = 0.f;
+            }
+            
+            for (int k = 0; k < taps->count; k += 1) {
+                let sx = ((2 * x + taps->offset + k) % job->source_width + job->source_width) % job->source_width;
+                
+                for (int c = 0; c < n; c += 1) {
+                    out[x * n + c] += taps->weights[k] * in[sx * n + c];
+                }
+            }
+        }
+    }
+    
+    function filter_row_vertical(void * data, u64 y) -> void {
+        let job = static_cast<t_level_job *>(data);
+        let row_length = (u64) job->width * job->channels;
+        let taps = &job->taps_y;
+        
+        float const * rows[max_taps];
+        
+        for (int k = 0; k < taps->count; k += 1) {
+            let sy = ((2 * (int) y + taps->offset + k) % job->source_height + job->source_height) % job->source_height;
+            rows[k] = job->horizontal + sy * row_length;
+        }
+        
+        let out = job->target + y * row_length;
+        job->weighted_sum(out, rows, taps->weights, taps->count, row_length);
+        
+        let pixels = job->pixels + y * row_length;
+        
+        for (u64 i = 0; i < row_length; i += 1) {
+            pixels[i] = encode(out[i], job->srgb);
+        }
+    }
+}
+
+function generate_mips(t_image __in * image, t_mip_filter filter, bool32 srgb) -> t_mip_chain {
+    bool32 static const tables = (init_tables(), true);
+    (void) tables;
+    
+    t_mip_chain chain = { .level_count = 1 };
+    chain.levels[0] = *image;
+    
+    let n = image->channels;
+    u64 total = 0;
+    
+    while (chain.levels[chain.level_count - 1].width > 1 || chain.levels[chain.level_count - 1].height > 1) {
+        m_assert(chain.level_count < t_mip_chain::max_levels);
+        
+        let previous = &chain.levels[chain.level_count - 1];
+        
+        chain.levels[chain.level_count] = {
+            .pixels = null,
+            .width = previous->width > 1 ? previous->width / 2 : 1,
+            .height = previous->height > 1 ? previous->height / 2 : 1,
+            .channels = n,
+        };
+        
+        total += (u64) chain.levels[chain.level_count].width * chain.levels[chain.level_count].height * n;
+        chain.level_count += 1;
+    }
+    
+    chain.storage = std::malloc(total > 0 ? total : 1);
+    
+    let cursor = static_cast<u8 *>(chain.storage);
+    
+    for (uint i = 1; i < chain.level_count; i += 1) {
+        chain.levels[i].pixels = cursor;
+        cursor += (u64) chain.levels[i].width * chain.levels[i].height * n;
+    }
+    
+    if (chain.level_count == 1) return chain;
+    
+    // two linear float levels at a time: the one being read and the one being written.
+    // each level is filtered from the float result of the previous one, never from the rounded bytes
+    let level_size = [&] (int level) { return (u64) chain.levels[level].width * chain.levels[level].height * n; };
+    
+    let source = static_cast<float *>(std::malloc(level_size(0) * sizeof(float)));
+    let target = static_cast<float *>(std::malloc(level_size(1) * sizeof(float)));
+    let horizontal = static_cast<float *>(std::malloc((u64) chain.levels[1].width * image->height * n * sizeof(float)));
+    
+    let weighted_sum = cpu::has_avx2() ? weighted_sum_avx2 : weighted_sum_scalar;
+    
+    {
+        t_level_job decode = {
+            .target = source,
+            .pixels = image->pixels,
+            .width = image->width,
+            .height = image->height,
+            .channels = n,
+            .srgb = srgb,
+        };
+        
+        jobs::parallel_for(image->height, decode_row, &decode);
+    }
+    
+    for (uint i = 1; i < chain.level_count; i += 1) {
+        let from = &chain.levels[i - 1];
+        let to = &chain.levels[i];
+        
+        t_level_job job = {
+            .source = source,
+            .horizontal = horizontal,
+            .target = target,
+            .pixels = to->pixels,
+            .source_width = from->width,
+            .source_height = from->height,
+            .width = to->width,
+            .height = to->height,
+            .channels = n,
+            .srgb = srgb,
+            .taps_x = make_taps(filter, from->width),
+            .taps_y = make_taps(filter, from->height),
+            .weighted_sum = weighted_sum,
+        };
+        
+        jobs::parallel_for(from->height, filter_row_horizontal, &job);
+        jobs::parallel_for(to->height, filter_row_vertical, &job);
+        
+        // the level just written is the source of the next one, which is smaller
+        // than anything the old source buffer has held, so the buffers can swap
+        let swap = source;
+        source = target;
+        target = swap;
+    }
+    
+    std::free(source);
+    std::free(target);
+    std::free(horizontal);
+    
+    return chain;
+}
+
+function free_mips(t_mip_chain __in * chain) -> void {
+    std::free(chain->storage);
+    chain->storage = null;
+}
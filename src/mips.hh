@@ -0,0 +1,27 @@
+#ifndef __learngl_mips__
+#define __learngl_mips__
+
+#include "common.hh"
+#include "image.hh"
+
+// cpu mip chain generation. filtering happens on linear light floats, so sRGB
+// images don't darken towards the smaller levels like they do with glGenerateMipmap
+enum struct t_mip_filter {
+    box, // 2x2 average
+    kaiser, // 6x6 kaiser windowed sinc, keeps more detail without ringing much
+};
+
+struct t_mip_chain {
+    static constexpr uint max_levels = 16;
+    
+    uint level_count;
+    t_image levels[max_levels]; // levels[0] is the source image itself
+    
+    void * storage; // owns every level but the first
+};
+
+// rows are spread over the job workers, safe to call from inside a job
+function generate_mips(t_image __in * image, t_mip_filter filter = t_mip_filter::kaiser, bool32 srgb = true) -> t_mip_chain;
+function free_mips(t_mip_chain __in * chain) -> void;
+
+#endif // __learngl_mips__
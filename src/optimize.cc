@@ -0,0 +1,271 @@
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "optimize.hh"
+
+namespace {
+    // the lru cache forsyth's scores model. larger than most hardware's, which costs
+    // little since the order stays good for any smaller cache
+    constexpr int cache_size = 32;
+    constexpr int max_valence = 32; // scores for more live triangles than this are the same
+    
+    constexpr float cache_decay_power = 1.5f;
+    constexpr float last_triangle_score = 0.75f;
+    constexpr float valence_boost_scale = 2.f;
+    constexpr float valence_boost_power = 0.5f;
+    
+    struct t_scores {
+        float cache[cache_size];
+        float valence[max_valence + 1];
+    };
+    
+    // the vertices of the triangle just drawn score the same whatever their order, so
+    // that it isn't favoured to carry on from one of its edges. then the score decays
+    // towards the back of the cache. vertices with few triangles left score higher, to
+    // finish them off instead of leaving lone triangles to draw later
+    function score_tables() -> t_scores {
+        t_scores scores;
+        
+        for (int i = 0; i < cache_size; i += 1) {
+            scores.cache[i] = i < 3
+                ? last_triangle_score
+                : std::pow(1.f - (float) (i - 3) / (cache_size - 3), cache_decay_power);
+        }
+        
+        scores.valence[0] = 0.f;
+        
+        for (int i = 1; i <= max_valence; i += 1) {
+            scores.valence[i] = valence_boost_scale * std::pow((float) i, -valence_boost_power);
+        }
+        
+        return scores;
+    }
+    
+    struct t_cache_vertex {
+        int cache_position; // -1 when not in the cache
+        uint live; // triangles using it still to be drawn
+        uint first; // into the adjacency list
+        float score;
+    };
+    
+    inline function vertex_score(t_scores __in * scores, t_cache_vertex __in * vertex) -> float {
+        if (vertex->live == 0) return -1.f;
+        
+        let cache = vertex->cache_position >= 0 ? scores->cache[vertex->cache_position] : 0.f;
+        let valence = scores->valence[vertex->live < max_valence ? vertex->live : max_valence];
+        
+        return cache + valence;
+    }
+    
+    // fnv-1a over the vertex's bytes, which are compared as bytes too, so 0 and -0 stay apart
+    inline function vertex_hash(t_vertex __in * vertex) -> u64 {
+        let bytes = reinterpret_cast<u8 const *>(vertex);
+        u64 hash = 0xCBF29CE484222325ull;
+        
+        for (u64 i = 0; i < sizeof(t_vertex); i += 1) {
+            hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+        }
+        
+        return hash ^ hash >> 32;
+    }
+}
+
+function analyze_vertex_cache(t_slice<uint32> indices, u64 vertex_count, uint cache_size) -> t_vertex_cache_stats {
+    if (indices.length() == 0 || vertex_count == 0) return {};
+    
+    // a vertex is in the fifo if fewer than cache_size misses happened since it went in
+    std::vector<u64> inserted(vertex_count, ~0ull);
+    u64 misses = 0;
+    
+    for (u64 i = 0; i < indices.length(); i += 1) {
+        let vertex = indices[i];
+        
+        if (inserted[vertex] == ~0ull || misses - inserted[vertex] >= cache_size) {
+            inserted[vertex] = misses;
+            misses += 1;
+        }
+    }
+    
+    return {
+        .acmr = (float) misses / (float) (indices.length() / 3),
+        .atvr = (float) misses / (float) vertex_count,
+    };
+}
+
+function optimize_vertex_cache(t_slice<uint32> indices, u64 vertex_count) -> void {
+    let triangle_count = indices.length() / 3;
+    if (triangle_count == 0) return;
+    
+    let scores = score_tables();
+    
+    std::vector<t_cache_vertex> vertices(vertex_count);
+    std::vector<uint32> adjacency(triangle_count * 3);
+    std::vector<u8> emitted(triangle_count);
+    std::vector<uint32> output(indices.length());
+    
+    // every vertex's triangles, laid out one after the other
+    for (u64 i = 0; i < indices.length(); i += 1) {
+        vertices[indices[i]].live += 1;
+    }
+    
+    uint offset = 0;
+    
+    for (auto & vertex : vertices) {
+        vertex.cache_position = -1;
+        vertex.first = offset;
+        offset += vertex.live;
+        vertex.live = 0;
+    }
+    
+    for (u64 i = 0; i < indices.length(); i += 1) {
+        let vertex = &vertices[indices[i]];
+        adjacency[vertex->first + vertex->live] = (uint32) (i / 3);
+        vertex->live += 1;
+    }
+    
+    for (auto & vertex : vertices) {
+        vertex.score = vertex_score(&scores, &vertex);
+    }
+    
+    // the vertices of the triangle drawn go to the front, the rest shift back by up to three
+    int cache[cache_size + 3];
+    int cached = 0;
+    
+    u64 best = 0;
+    u64 cursor = 0; // no triangle before it is left to draw
+    
+    for (u64 drawn = 0; drawn < triangle_count; drawn += 1) {
+        // the cache held nothing worth drawing, take the next triangle in the input order
+        if (best == ~0ull) {
+            while (emitted[cursor]) cursor += 1;
+            best = cursor;
+        }
+        
+        let triangle = indices.ptr + best * 3;
+        std::memcpy(&output[drawn * 3], triangle, sizeof(uint32) * 3);
+        emitted[best] = true;
+        
+        int next[cache_size + 3];
+        int next_count = 0;
+        
+        for (int i = 0; i < 3; i += 1) {
+            let vertex = &vertices[triangle[i]];
+            
+            // off its own adjacency list
+            let list = &adjacency[vertex->first];
+            for (uint j = 0; j < vertex->live; j += 1) {
+                if (list[j] == best) {
+                    list[j] = list[vertex->live - 1];
+                    break;
+                }
+            }
+            
+            vertex->live -= 1;
+            next[next_count] = (int) triangle[i];
+            next_count += 1;
+        }
+        
+        for (int i = 0; i < cached; i += 1) {
+            let vertex = cache[i];
+            if (vertex != (int) triangle[0] && vertex != (int) triangle[1] && vertex != (int) triangle[2]) {
+                next[next_count] = vertex;
+                next_count += 1;
+            }
+        }
+        
+        // the ones pushed out lose their cache score
+        for (int i = cache_size; i < next_count; i += 1) {
+            let vertex = &vertices[next[i]];
+            vertex->cache_position = -1;
+            vertex->score = vertex_score(&scores, vertex);
+        }
+        
+        cached = next_count < cache_size ? next_count : cache_size;
+        std::memcpy(cache, next, sizeof(int) * cached);
+        
+        for (int i = 0; i < cached; i += 1) {
+            let vertex = &vertices[cache[i]];
+            vertex->cache_position = i;
+            vertex->score = vertex_score(&scores, vertex);
+        }
+        
+        // only triangles touching the cache changed, the best of them goes next
+        best = ~0ull;
+        float best_score = 0.f;
+        
+        for (int i = 0; i < next_count; i += 1) {
+            let vertex = &vertices[next[i]];
+            
+            for (uint j = 0; j < vertex->live; j += 1) {
+                let t = adjacency[vertex->first + j];
+                let corners = indices.ptr + (u64) t * 3;
+                let score = vertices[corners[0]].score + vertices[corners[1]].score + vertices[corners[2]].score;
+                
+                if (score > best_score) {
+                    best = t;
+                    best_score = score;
+                }
+            }
+        }
+    }
+    
+    std::memcpy(indices.ptr, output.data(), sizeof(uint32) * indices.length());
+}
+
+function weld_vertices(t_slice<t_vertex> vertices, t_slice<uint32> indices) -> u64 {
+    static_assert(sizeof(t_vertex) == sizeof(float) * 5); // compared as bytes, there must be no padding
+    m_assert(indices.length() == vertices.length());
+    
+    constexpr uint32 empty = ~0u;
+    
+    // open addressing, at most half full
+    u64 table_size = 16;
+    while (table_size < vertices.length() * 2) table_size *= 2;
+    
+    std::vector<uint32> table(table_size, empty);
+    u64 count = 0;
+    
+    for (u64 i = 0; i < vertices.length(); i += 1) {
+        let vertex = vertices[i];
+        let slot = vertex_hash(&vertex) & (table_size - 1);
+        
+        while (table[slot] != empty && std::memcmp(&vertices[table[slot]], &vertex, sizeof(t_vertex)) != 0) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        
+        // new, it moves down to the next free place. the ones kept are all below i
+        if (table[slot] == empty) {
+            vertices[count] = vertex;
+            table[slot] = (uint32) count;
+            count += 1;
+        }
+        
+        indices[i] = table[slot];
+    }
+    
+    return count;
+}
+
+function optimize_vertex_fetch(t_slice<t_vertex> vertices, t_slice<uint32> indices) -> u64 {
+    constexpr uint32 unused = ~0u;
+    
+    std::vector<uint32> remap(vertices.length(), unused);
+    std::vector<t_vertex> source(vertices.ptr, vertices.ptr + vertices.length());
+    uint32 count = 0;
+    
+    for (u64 i = 0; i < indices.length(); i += 1) {
+        let index = &indices[i];
+        
+        if (remap[*index] == unused) {
+            vertices[count] = source[*index];
+            remap[*index] = count;
+            count += 1;
+        }
+        
+        *index = remap[*index];
+    }
+    
+    return count;
+}
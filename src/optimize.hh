@@ -0,0 +1,29 @@
+#ifndef __learngl_optimize__
+#define __learngl_optimize__
+
+#include "common.hh"
+#include "render.hh"
+
+// how well drawing the indices in order reuses the post transform vertex cache, simulated
+// as a fifo of cache_size vertices. acmr is vertices shaded per triangle: 3 at worst, about
+// 0.5 at best on a regular grid. atvr is per vertex of the mesh, 1 at best
+struct t_vertex_cache_stats {
+    float acmr;
+    float atvr;
+};
+
+function analyze_vertex_cache(t_slice<uint32> indices, u64 vertex_count, uint cache_size) -> t_vertex_cache_stats;
+
+// reorders the triangles, in place, with forsyth's linear speed vertex cache optimisation
+function optimize_vertex_cache(t_slice<uint32> indices, u64 vertex_count) -> void;
+
+// indexes a mesh that came without indices: vertices with the same bytes are merged,
+// in place, and indices, as long as vertices, gets which one each was. returns how many
+// are left
+function weld_vertices(t_slice<t_vertex> vertices, t_slice<uint32> indices) -> u64;
+
+// renumbers the vertices in the order the indices first use them, so that fetching walks
+// memory forwards. vertices nothing uses are dropped, returns how many are left
+function optimize_vertex_fetch(t_slice<t_vertex> vertices, t_slice<uint32> indices) -> u64;
+
+#endif // __learngl_optimize__
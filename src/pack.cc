@@ -0,0 +1,190 @@
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "mapping.hh"
+#include "pack.hh"
+
+namespace {
+    // header, then the table of contents sorted by name hash, then the names,
+    // then the payloads, each starting on a payload_alignment boundary
+    u8 const file_magic[8] = { 0xAB, 'L', 'P', 'K', ' ', '1', 0xBB, '\n' };
+    constexpr u64 payload_alignment = 64;
+    
+    struct t_file_header {
+        u8 magic[8];
+        uint32 entry_count;
+        uint32 reserved;
+    };
+    
+    struct t_file_entry {
+        u64 hash;
+        u64 offset;
+        u64 size;
+        uint32 name_offset;
+        uint32 name_length;
+    };
+    
+    t_mapping mapping = {};
+    t_file_entry const * entries = null;
+    uint32 entry_count = 0;
+    
+    inline function align(u64 value, u64 alignment) -> u64 {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+    
+    inline function file_name(char const * path) -> char const * {
+        let name = path;
+        
+        for (let c = path; *c; c += 1) {
+            if (*c == '/' || *c == '\\') name = c + 1;
+        }
+        
+        return name;
+    }
+    
+    // fnv-1a
+    inline function hash(char const * name) -> u64 {
+        u64 h = 0xcbf29ce484222325;
+        
+        for (let c = name; *c; c += 1) {
+            h = (h ^ (u8) *c) * 0x100000001b3;
+        }
+        
+        return h;
+    }
+}
+
+function pack::open(char const * path) -> bool32 {
+    m_assert(!mapping.data);
+    
+    mapping = map_file(path);
+    if (!mapping.data) return false;
+    
+    t_file_header header;
+    
+    let ok = mapping.size >= sizeof(header);
+    if (ok) std::memcpy(&header, mapping.data, sizeof(header));
+    
+    ok = ok && std::memcmp(header.magic, file_magic, sizeof(file_magic)) == 0;
+    ok = ok && mapping.size >= sizeof(header) + sizeof(t_file_entry) * header.entry_count;
+    
+    if (ok) {
+        entries = reinterpret_cast<t_file_entry const *>(mapping.data + sizeof(header));
+        entry_count = header.entry_count;
+        
+        for (uint32 i = 0; ok && i < entry_count; i += 1) {
+            ok = entries[i].offset <= mapping.size && entries[i].size <= mapping.size - entries[i].offset;
+            ok = ok && (u64) entries[i].name_offset + entries[i].name_length <= mapping.size;
+        }
+    }
+    
+    if (!ok) close();
+    
+    return ok;
+}
+
+function pack::find(char const * path) -> t_slice<u8 const> {
+    if (!mapping.data) return {};
+    
+    let name = file_name(path);
+    let length = std::strlen(name);
+    let key = hash(name);
+    
+    let first = std::lower_bound(entries, entries + entry_count, key, [] (t_file_entry const & entry, u64 key) {
+        return entry.hash < key;
+    });
+    
+    for (let entry = first; entry != entries + entry_count && entry->hash == key; entry += 1) {
+        if (entry->name_length == length && std::memcmp(mapping.data + entry->name_offset, name, length) == 0) {
+            return { .ptr = mapping.data + entry->offset, .len = entry->size };
+        }
+    }
+    
+    return {};
+}
+
+function pack::close() -> void {
+    unmap_file(&mapping);
+    entries = null;
+    entry_count = 0;
+}
+
+function pack::build(char const * output, t_slice<char const *> inputs) -> bool32 {
+    struct t_input {
+        char const * path;
+        char const * name;
+        t_file_entry entry;
+    };
+    
+    std::vector<t_input> files;
+    
+    for (u64 i = 0; i < inputs.length(); i += 1) {
+        let name = file_name(inputs[i]);
+        files.push_back({ .path = inputs[i], .name = name, .entry = { .hash = hash(name) } });
+    }
+    
+    std::sort(files.begin(), files.end(), [] (t_input const & a, t_input const & b) {
+        return a.entry.hash < b.entry.hash;
+    });
+    
+    // lay out the names right after the table, then the aligned payloads
+    u64 offset = sizeof(t_file_header) + sizeof(t_file_entry) * files.size();
+    
+    for (auto & file : files) {
+        file.entry.name_offset = (uint32) offset;
+        file.entry.name_length = (uint32) std::strlen(file.name);
+        offset += file.entry.name_length;
+    }
+    
+    for (auto & file : files) {
+        let in = std::fopen(file.path, "rb");
+        if (!in) return false;
+        
+        std::fseek(in, 0, SEEK_END);
+        file.entry.size = (u64) std::ftell(in);
+        std::fclose(in);
+        
+        offset = align(offset, payload_alignment);
+        file.entry.offset = offset;
+        offset += file.entry.size;
+    }
+    
+    let out = std::fopen(output, "wb");
+    if (!out) return false;
+    
+    t_file_header header = { .entry_count = (uint32) files.size() };
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    
+    bool32 ok = std::fwrite(&header, sizeof(header), 1, out) == 1;
+    
+    for (let & file : files) {
+        ok = ok && std::fwrite(&file.entry, sizeof(file.entry), 1, out) == 1;
+    }
+    
+    for (let & file : files) {
+        ok = ok && std::fwrite(file.name, 1, file.entry.name_length, out) == file.entry.name_length;
+    }
+    
+    for (let & file : files) {
+        while (ok && (u64) std::ftell(out) < file.entry.offset) {
+            ok = std::fputc(0, out) != EOF;
+        }
+        
+        let in = std::fopen(file.path, "rb");
+        let data = static_cast<u8 *>(std::malloc(file.entry.size));
+        
+        ok = ok && in && std::fread(data, 1, file.entry.size, in) == file.entry.size;
+        ok = ok && std::fwrite(data, 1, file.entry.size, out) == file.entry.size;
+        
+        std::free(data);
+        if (in) std::fclose(in);
+    }
+    
+    std::fclose(out);
+    
+    return ok;
+}
@@ -0,0 +1,17 @@
+#ifndef __learngl_pack__
+#define __learngl_pack__
+
+#include "common.hh"
+
+// a read-only archive of every asset, mapped into memory once at startup.
+// payloads are aligned and used in place, lookups hand out views into the mapping.
+// assets are found by file name, so "..\\resources\\tile.jpg" finds "tile.jpg"
+namespace pack {
+    function open(char const * path) -> bool32;
+    function find(char const * path) -> t_slice<u8 const>; // empty if not packed
+    function close() -> void;
+    
+    function build(char const * output, t_slice<char const *> inputs) -> bool32;
+};
+
+#endif // __learngl_pack__
@@ -0,0 +1,186 @@
+
+#include <string>
+
+#include <glad/glad.h>
+
+#include "permutations.hh"
+#include "registry.hh"
+
+namespace {
+    // in the order of the feature bits
+    char const * const defines[t_shader_features::count] = {
+        "#define INSTANCING\n",
+        "#define TEXTURE_ARRAY\n",
+        "#define LIGHTING\n",
+        "#define ALPHA_TEST\n",
+    };
+    
+    char const * basic_vertex = R"(
+        layout (location = 0) in vec3 v_pos;
+        layout (location = 1) in vec2 v_tex;
+        
+        // packed meshes' positions come in as 0 to 1 across their bounds, see quantize.hh
+        uniform vec3 position_offset;
+        uniform vec3 position_scale;
+        
+        #ifdef INSTANCING
+        layout (location = 2) in mat4 v_model;
+        layout (location = 6) in float v_layer;
+        
+        uniform mat4 view_projection;
+        #else
+        uniform mat4 mvp;
+        uniform mat4 model;
+        uniform float layer;
+        #endif
+        
+        out vec2 f_tex;
+        out vec3 f_world;
+        flat out float f_layer;
+        
+        void main() {
+            vec3 position = position_offset + position_scale * v_pos;
+            
+            #ifdef INSTANCING
+            vec4 world = v_model * vec4(position, 1.0);
+            gl_Position = view_projection * world;
+            f_layer = v_layer;
+            #else
+            vec4 world = model * vec4(position, 1.0);
+            gl_Position = mvp * vec4(position, 1.0);
+            f_layer = layer;
+            #endif
+            
+            f_world = world.xyz;
+            f_tex = v_tex;
+        }
+    )";
+    
+    char const * basic_fragment = R"(
+        in vec2 f_tex;
+        in vec3 f_world;
+        flat in float f_layer;
+        
+        out vec4 color;
+        
+        #ifdef TEXTURE_ARRAY
+        uniform sampler2DArray f_texture;
+        #else
+        uniform sampler2D f_texture;
+        #endif
+        
+        #ifdef LIGHTING
+        uniform vec3 light_direction; // towards the light
+        uniform float ambient;
+        #endif
+        
+        #ifdef ALPHA_TEST
+        uniform float alpha_cutoff;
+        #endif
+        
+        void main() {
+            #ifdef TEXTURE_ARRAY
+            color = texture(f_texture, vec3(f_tex, f_layer));
+            #else
+            color = texture(f_texture, f_tex);
+            #endif
+            
+            #ifdef ALPHA_TEST
+            if (color.a < alpha_cutoff) discard;
+            #endif
+            
+            #ifdef LIGHTING
+            // the meshes carry no normals, the faces' own are used
+            vec3 normal = normalize(cross(dFdx(f_world), dFdy(f_world)));
+            color.rgb *= ambient + (1.0 - ambient) * max(dot(normal, light_direction), 0.0);
+            #endif
+        }
+    )";
+    
+    function source(char const * body, uint features) -> std::string {
+        std::string result = "#version 450 core\n";
+        
+        for (uint i = 0; i < t_shader_features::count; i += 1) {
+            if (features & 1 << i) result += defines[i];
+        }
+        
+        result += body;
+        
+        return result;
+    }
+    
+    // uniforms that would otherwise start at zero and give nonsense
+    function set_defaults(t_shader program, uint features) -> void {
+        glUseProgram(program);
+        
+        glUniform3f(glGetUniformLocation(program, "position_scale"), 1.f, 1.f, 1.f);
+        
+        if (features & t_shader_features::lighting) {
+            let direction = glm::normalize(vec3 { 0.4f, 0.3f, 0.85f });
+            
+            glUniform3f(glGetUniformLocation(program, "light_direction"), direction.x, direction.y, direction.z);
+            glUniform1f(glGetUniformLocation(program, "ambient"), 0.25f);
+        }
+        
+        if (features & t_shader_features::alpha_test) {
+            glUniform1f(glGetUniformLocation(program, "alpha_cutoff"), 0.5f);
+        }
+    }
+}
+
+function t_shader_permutations::prepare(uint features) -> void {
+    m_assert(features < permutation_count);
+    
+    if (programs[features] || builds[features].program) return;
+    
+    let vertex_source = source(vertex, features);
+    let fragment_source = source(fragment, features);
+    
+    keys[features] = registry::shader_key(vertex_source.c_str(), fragment_source.c_str());
+    programs[features] = registry::find_shader(keys[features]);
+    
+    if (!programs[features]) {
+        builds[features] = begin_shader(vertex_source.c_str(), fragment_source.c_str());
+    }
+}
+
+function t_shader_permutations::ready(uint features) -> bool32 {
+    return programs[features] || (builds[features].program && shader_ready(&builds[features]));
+}
+
+function t_shader_permutations::get(uint features) -> t_shader {
+    if (programs[features]) return programs[features];
+    
+    prepare(features);
+    
+    if (!programs[features]) {
+        let program = finish_shader(&builds[features]);
+        set_defaults(program, features);
+        
+        programs[features] = registry::add_shader(keys[features], program);
+    }
+    
+    return programs[features];
+}
+
+function t_shader_permutations::destroy() -> void {
+    for (uint i = 0; i < permutation_count; i += 1) {
+        if (programs[i]) registry::release_shader(programs[i]);
+        
+        // nothing refers to a program still compiling yet
+        if (builds[i].program) {
+            let program = finish_shader(&builds[i]);
+            glDeleteProgram(program);
+        }
+    }
+    
+    *this = {};
+}
+
+function create_shader_permutations(char const * vertex, char const * fragment) -> t_shader_permutations {
+    return { .vertex = vertex, .fragment = fragment };
+}
+
+function create_basic_permutations() -> t_shader_permutations {
+    return create_shader_permutations(basic_vertex, basic_fragment);
+}
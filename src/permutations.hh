@@ -0,0 +1,42 @@
+#ifndef __learngl_permutations__
+#define __learngl_permutations__
+
+#include "common.hh"
+#include "render.hh"
+
+// features a shader permutation is compiled with, or'ed together into a mask. each is
+// a #define put in front of the sources, which #ifdef their parts in and out
+struct t_shader_features {
+    static constexpr uint instancing = 1 << 0; // INSTANCING, a model matrix per instance in attributes 2 to 5, and a layer in 6
+    static constexpr uint texture_array = 1 << 1; // TEXTURE_ARRAY, f_texture is a sampler2DArray
+    static constexpr uint lighting = 1 << 2; // LIGHTING, lambert from light_direction with face normals
+    static constexpr uint alpha_test = 1 << 3; // ALPHA_TEST, discards below alpha_cutoff
+    
+    static constexpr uint count = 4;
+};
+
+// every permutation of one pair of sources, indexed by feature mask. none are compiled
+// until they're first asked for, and programs with the same final sources are shared
+// through the registry
+struct t_shader_permutations {
+    static constexpr uint permutation_count = 1 << t_shader_features::count;
+    
+    function prepare(uint features) -> void; // starts compiling without waiting on it, see begin_shader
+    function ready(uint features) -> bool32; // whether get would return without blocking
+    function get(uint features) -> t_shader; // compiles it first if it must
+    function destroy() -> void;
+    
+    char const * vertex; // without a #version, which goes in front of the defines
+    char const * fragment;
+    
+    t_shader programs[permutation_count]; // 0 until built
+    t_shader_build builds[permutation_count]; // the ones compiling
+    u64 keys[permutation_count];
+};
+
+function create_shader_permutations(char const * vertex, char const * fragment) -> t_shader_permutations;
+
+// the scene's shader: a texture, optionally lit, instanced, from an array or alpha tested
+function create_basic_permutations() -> t_shader_permutations;
+
+#endif // __learngl_permutations__
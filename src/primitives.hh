@@ -0,0 +1,555 @@
+#ifndef __learngl_primitives__
+#define __learngl_primitives__
+
+#include "common.hh"
+#include "geometry.hh"
+
+// the generators of geometry.hh for sizes known when compiling, evaluated by the compiler
+// into read only data. creating their meshes is only create_mesh's copy and upload
+template <u64 vertex_count, u64 index_count>
+struct t_primitive {
+    t_vertex vertices[vertex_count];
+    uint32 indices[index_count];
+};
+
+// a view of it for create_mesh, which only reads it. free_geometry does nothing with it
+template <u64 vertex_count, u64 index_count>
+inline function geometry(t_primitive<vertex_count, index_count> const & primitive) -> t_geometry {
+    return {
+        .vertices = { .ptr = const_cast<t_vertex *>(primitive.vertices), .len = vertex_count },
+        .indices = { .ptr = const_cast<uint32 *>(primitive.indices), .len = index_count },
+        .storage = null,
+    };
+}
+
+namespace primitives {
+    // std's maths isn't constexpr until c++26. in doubles, to lose nothing before the floats
+    constexpr double half_pi = 1.5707963267948966;
+    constexpr double full_pi = 3.1415926535897932;
+    constexpr double full_tau = 6.2831853071795865;
+    
+    constexpr function absolute(double x) -> double {
+        return x < 0.0 ? -x : x;
+    }
+    
+    constexpr function sqrt(double x) -> double {
+        if (x <= 0.0) return 0.0;
+        
+        double root = x > 1.0 ? x : 1.0;
+        
+        for (int i = 0; i < 64; i += 1) {
+            let next = 0.5 * (root + x / root);
+            if (next >= root) break;
+            root = next;
+        }
+        
+        return root;
+    }
+    
+    constexpr function sin(double x) -> double {
+        // into -pi to pi, then -pi/2 to pi/2 where the series is quick
+        let turns = x / full_tau;
+        x -= full_tau * (double) (long long) (turns + (turns < 0.0 ? -0.5 : 0.5));
+        
+        if (x > half_pi) x = full_pi - x;
+        if (x < -half_pi) x = -full_pi - x;
+        
+        double term = x;
+        double sum = x;
+        
+        for (int n = 1; n < 12; n += 1) {
+            term *= -x * x / ((2 * n) * (2 * n + 1));
+            sum += term;
+        }
+        
+        return sum;
+    }
+    
+    constexpr function cos(double x) -> double {
+        return sin(x + half_pi);
+    }
+    
+    constexpr function atan(double x) -> double {
+        if (x < 0.0) return -atan(-x);
+        if (x > 1.0) return half_pi - atan(1.0 / x);
+        
+        // halving the angle twice takes it under pi/16, where the series is quick
+        for (int i = 0; i < 2; i += 1) {
+            x = x / (1.0 + sqrt(1.0 + x * x));
+        }
+        
+        double term = x;
+        double sum = x;
+        
+        for (int n = 1; n < 20; n += 1) {
+            term *= -x * x;
+            sum += term / (2 * n + 1);
+        }
+        
+        return 4.0 * sum;
+    }
+    
+    constexpr function atan2(double y, double x) -> double {
+        if (x > 0.0) return atan(y / x);
+        if (x < 0.0) return atan(y / x) + (y < 0.0 ? -full_pi : full_pi);
+        return y > 0.0 ? half_pi : y < 0.0 ? -half_pi : 0.0;
+    }
+    
+    constexpr function acos(double x) -> double {
+        return atan2(sqrt(1.0 - x * x), x);
+    }
+    
+    constexpr function normalize(vec3 v) -> vec3 {
+        let length = sqrt((double) v.x * v.x + (double) v.y * v.y + (double) v.z * v.z);
+        return { (float) (v.x / length), (float) (v.y / length), (float) (v.z / length) };
+    }
+    
+    // the cube's faces as a corner and two edges, counter clockwise from outside. the uvs
+    // put the top of the texture towards the second edge
+    constexpr function make_box() -> t_primitive<24, 36> {
+        struct t_face {
+            vec3 corner;
+            vec3 across;
+            vec3 up;
+        };
+        
+        t_face const faces[6] = {
+            { { 0.5f, -0.5f, -0.5f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f, 1.f } },
+            { { -0.5f, 0.5f, -0.5f }, { 0.f, -1.f, 0.f }, { 0.f, 0.f, 1.f } },
+            { { 0.5f, 0.5f, -0.5f }, { -1.f, 0.f, 0.f }, { 0.f, 0.f, 1.f } },
+            { { -0.5f, -0.5f, -0.5f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f, 1.f } },
+            { { -0.5f, -0.5f, 0.5f }, { 1.f, 0.f, 0.f }, { 0.f, 1.f, 0.f } },
+            { { 0.5f, -0.5f, -0.5f }, { -1.f, 0.f, 0.f }, { 0.f, 1.f, 0.f } },
+        };
+        
+        t_primitive<24, 36> box = {};
+        
+        for (uint f = 0; f < 6; f += 1) {
+            let face = faces[f];
+            
+            vec2 const uvs[4] = { { 0.f, 1.f }, { 1.f, 1.f }, { 1.f, 0.f }, { 0.f, 0.f } };
+            float const steps[4][2] = { { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f }, { 0.f, 1.f } };
+            
+            for (uint k = 0; k < 4; k += 1) {
+                let vertex = &box.vertices[f * 4 + k];
+                
+                vertex->position = {
+                    face.corner.x + face.across.x * steps[k][0] + face.up.x * steps[k][1],
+                    face.corner.y + face.across.y * steps[k][0] + face.up.y * steps[k][1],
+                    face.corner.z + face.across.z * steps[k][0] + face.up.z * steps[k][1],
+                };
+                
+                vertex->uv = uvs[k];
+            }
+            
+            uint32 const quad[6] = { 0, 1, 2, 0, 2, 3 };
+            
+            for (uint k = 0; k < 6; k += 1) {
+                box.indices[f * 6 + k] = f * 4 + quad[k];
+            }
+        }
+        
+        return box;
+    }
+    
+    // as generate_plane(1, 1)
+    constexpr function make_quad() -> t_primitive<4, 6> {
+        return {
+            .vertices = {
+                { { -0.5f, 0.5f, 0.f }, { 0.f, 0.f } },
+                { { 0.5f, 0.5f, 0.f }, { 1.f, 0.f } },
+                { { -0.5f, -0.5f, 0.f }, { 0.f, 1.f } },
+                { { 0.5f, -0.5f, 0.f }, { 1.f, 1.f } },
+            },
+            .indices = { 2, 1, 0, 2, 3, 1 },
+        };
+    }
+    
+    // as generate_sphere
+    template <uint longitude_segments, uint latitude_segments>
+    constexpr function make_sphere() {
+        static_assert(longitude_segments >= 3 && latitude_segments >= 2);
+        
+        constexpr u64 columns = longitude_segments + 1;
+        
+        t_primitive<columns * (latitude_segments + 1), 6 * longitude_segments * (latitude_segments - 1)> sphere = {};
+        
+        u64 vertex = 0;
+        u64 index = 0;
+        
+        for (uint y = 0; y <= latitude_segments; y += 1) {
+            let latitude = full_pi * y / latitude_segments;
+            
+            // the poles exactly on the axis
+            let ring = y == 0 || y == latitude_segments ? 0.0 : sin(latitude);
+            
+            for (uint x = 0; x <= longitude_segments; x += 1) {
+                let longitude = x == longitude_segments ? 0.0 : full_tau * x / longitude_segments;
+                
+                sphere.vertices[vertex] = {
+                    .position = { (float) (cos(longitude) * ring), (float) (sin(longitude) * ring), (float) cos(latitude) },
+                    .uv = { (float) x / (float) longitude_segments, (float) y / (float) latitude_segments },
+                };
+                
+                vertex += 1;
+            }
+        }
+        
+        for (uint y = 0; y < latitude_segments; y += 1) {
+            for (uint x = 0; x < longitude_segments; x += 1) {
+                let top = (uint32) (y * columns + x);
+                let bottom = (uint32) (top + columns);
+                
+                if (y != 0) {
+                    sphere.indices[index++] = bottom;
+                    sphere.indices[index++] = top + 1;
+                    sphere.indices[index++] = top;
+                }
+                
+                if (y != latitude_segments - 1) {
+                    sphere.indices[index++] = bottom;
+                    sphere.indices[index++] = bottom + 1;
+                    sphere.indices[index++] = top + 1;
+                }
+            }
+        }
+        
+        return sphere;
+    }
+    
+    // as generate_icosphere. the seam and the poles add vertices the subdivision doesn't
+    // say the count of, so it runs twice: first with null outputs to count them
+    template <uint subdivisions>
+    constexpr function build_icosphere(t_vertex __out * vertices, uint32 __out * indices) -> u64 {
+        constexpr u64 vertex_count = 10 * (1ull << 2 * subdivisions) + 2;
+        constexpr u64 index_count = 60 * (1ull << 2 * subdivisions);
+        constexpr uint max_neighbours = 6;
+        constexpr float phi = 1.618033988f;
+        constexpr float pole = -1.f;
+        
+        vec3 positions[vertex_count] = {
+            { -1.f, phi, 0.f }, { 1.f, phi, 0.f }, { -1.f, -phi, 0.f }, { 1.f, -phi, 0.f },
+            { 0.f, -1.f, phi }, { 0.f, 1.f, phi }, { 0.f, -1.f, -phi }, { 0.f, 1.f, -phi },
+            { phi, 0.f, -1.f }, { phi, 0.f, 1.f }, { -phi, 0.f, -1.f }, { -phi, 0.f, 1.f },
+        };
+        
+        uint32 triangles[index_count] = {
+            0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+            1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+            3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+            4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1,
+        };
+        
+        u64 position_count = 12;
+        u64 triangle_index_count = 60;
+        
+        for (u64 i = 0; i < position_count; i += 1) positions[i] = primitives::normalize(positions[i]);
+        
+        for (uint level = 0; level < subdivisions; level += 1) {
+            uint32 neighbours[vertex_count * max_neighbours] = {};
+            uint32 midpoints[vertex_count * max_neighbours] = {};
+            u8 counts[vertex_count] = {};
+            uint32 split[index_count] = {};
+            
+            let find = [&] (uint32 a, uint32 b) -> uint32 {
+                let low = a < b ? a : b;
+                let high = a < b ? b : a;
+                
+                for (uint i = 0; i < counts[low]; i += 1) {
+                    if (neighbours[low * max_neighbours + i] == high) return midpoints[low * max_neighbours + i];
+                }
+                
+                let midpoint = (uint32) position_count;
+                positions[position_count] = primitives::normalize({
+                    positions[a].x + positions[b].x,
+                    positions[a].y + positions[b].y,
+                    positions[a].z + positions[b].z,
+                });
+                position_count += 1;
+                
+                neighbours[low * max_neighbours + counts[low]] = high;
+                midpoints[low * max_neighbours + counts[low]] = midpoint;
+                counts[low] += 1;
+                
+                return midpoint;
+            };
+            
+            for (u64 i = 0; i < triangle_index_count; i += 3) {
+                let a = triangles[i];
+                let b = triangles[i + 1];
+                let c = triangles[i + 2];
+                
+                let ab = find(a, b);
+                let bc = find(b, c);
+                let ca = find(c, a);
+                
+                uint32 const four[] = { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca };
+                for (uint k = 0; k < 12; k += 1) split[i * 4 + k] = four[k];
+            }
+            
+            triangle_index_count *= 4;
+            for (u64 i = 0; i < triangle_index_count; i += 1) triangles[i] = split[i];
+        }
+        
+        float us[vertex_count] = {};
+        
+        for (u64 i = 0; i < vertex_count; i += 1) {
+            let at_pole = absolute(positions[i].x) < 1e-6 && absolute(positions[i].y) < 1e-6;
+            let u = atan2(positions[i].y, positions[i].x) / full_tau;
+            
+            us[i] = at_pole ? pole : (float) (u < 0.0 ? u + 1.0 : u);
+        }
+        
+        struct t_copy {
+            uint32 vertex;
+            float u;
+        };
+        
+        t_copy copies[index_count] = {};
+        uint32 wrapped[vertex_count] = {};
+        u64 copy_count = 0;
+        
+        for (u64 i = 0; i < vertex_count; i += 1) wrapped[i] = ~0u;
+        
+        for (u64 i = 0; i < index_count; i += 3) {
+            let corners = &triangles[i];
+            
+            float low = 1.f;
+            float high = 0.f;
+            
+            for (int k = 0; k < 3; k += 1) {
+                let u = us[corners[k]];
+                if (u == pole) continue;
+                
+                low = u < low ? u : low;
+                high = u > high ? u : high;
+            }
+            
+            float corner_us[3] = {};
+            
+            for (int k = 0; k < 3; k += 1) {
+                let corner = corners[k];
+                corner_us[k] = us[corner];
+                
+                if (high - low <= 0.5f || corner_us[k] == pole || corner_us[k] >= 0.5f) continue;
+                
+                if (wrapped[corner] == ~0u) {
+                    wrapped[corner] = (uint32) (vertex_count + copy_count);
+                    copies[copy_count] = { corner, corner_us[k] + 1.f };
+                    copy_count += 1;
+                }
+                
+                corners[k] = wrapped[corner];
+                corner_us[k] += 1.f;
+            }
+            
+            for (int k = 0; k < 3; k += 1) {
+                if (corner_us[k] != pole) continue;
+                
+                copies[copy_count] = { corners[k], (corner_us[(k + 1) % 3] + corner_us[(k + 2) % 3]) * 0.5f };
+                corners[k] = (uint32) (vertex_count + copy_count);
+                copy_count += 1;
+            }
+        }
+        
+        if (vertices) {
+            for (u64 i = 0; i < vertex_count; i += 1) {
+                vertices[i] = {
+                    .position = positions[i],
+                    .uv = { us[i] == pole ? 0.f : us[i], (float) (acos(positions[i].z) / full_pi) },
+                };
+            }
+            
+            for (u64 i = 0; i < copy_count; i += 1) {
+                vertices[vertex_count + i] = vertices[copies[i].vertex];
+                vertices[vertex_count + i].uv.x = copies[i].u;
+            }
+            
+            for (u64 i = 0; i < index_count; i += 1) indices[i] = triangles[i];
+        }
+        
+        return vertex_count + copy_count;
+    }
+    
+    template <uint subdivisions>
+    constexpr function make_icosphere() {
+        // every step of the build counts against the compiler's constexpr limits
+        static_assert(subdivisions <= 3);
+        
+        constexpr u64 vertex_count = build_icosphere<subdivisions>(null, null);
+        
+        t_primitive<vertex_count, 60 * (1ull << 2 * subdivisions)> sphere = {};
+        build_icosphere<subdivisions>(sphere.vertices, sphere.indices);
+        
+        return sphere;
+    }
+    
+    // as optimize_vertex_cache and then optimize_vertex_fetch, with the same scores, so
+    // that create_mesh can take the primitives as they are
+    template <u64 vertex_count, u64 index_count>
+    constexpr function reorder(t_primitive<vertex_count, index_count> const & source) -> t_primitive<vertex_count, index_count> {
+        constexpr int cache_size = 32;
+        constexpr uint max_valence = 32;
+        constexpr u64 triangle_count = index_count / 3;
+        
+        float cache_scores[cache_size] = {};
+        float valence_scores[max_valence + 1] = {};
+        
+        for (int i = 3; i < cache_size; i += 1) {
+            let decay = (double) (1.f - (float) (i - 3) / (cache_size - 3));
+            cache_scores[i] = (float) (decay * sqrt(decay));
+        }
+        
+        cache_scores[0] = cache_scores[1] = cache_scores[2] = 0.75f;
+        
+        for (uint i = 1; i <= max_valence; i += 1) {
+            valence_scores[i] = 2.f * (float) (1.0 / sqrt((double) i));
+        }
+        
+        int cache_positions[vertex_count] = {};
+        uint live[vertex_count] = {};
+        uint first[vertex_count] = {};
+        float scores[vertex_count] = {};
+        uint32 adjacency[index_count] = {};
+        bool emitted[triangle_count] = {};
+        
+        let score = [&] (uint32 vertex) -> float {
+            if (live[vertex] == 0) return -1.f;
+            
+            let cache = cache_positions[vertex] >= 0 ? cache_scores[cache_positions[vertex]] : 0.f;
+            return cache + valence_scores[live[vertex] < max_valence ? live[vertex] : max_valence];
+        };
+        
+        for (u64 i = 0; i < index_count; i += 1) live[source.indices[i]] += 1;
+        
+        uint offset = 0;
+        
+        for (u64 i = 0; i < vertex_count; i += 1) {
+            cache_positions[i] = -1;
+            first[i] = offset;
+            offset += live[i];
+            live[i] = 0;
+        }
+        
+        for (u64 i = 0; i < index_count; i += 1) {
+            let vertex = source.indices[i];
+            adjacency[first[vertex] + live[vertex]] = (uint32) (i / 3);
+            live[vertex] += 1;
+        }
+        
+        for (uint32 i = 0; i < vertex_count; i += 1) scores[i] = score(i);
+        
+        t_primitive<vertex_count, index_count> result = {};
+        
+        int cache[cache_size + 3] = {};
+        int cached = 0;
+        
+        u64 best = 0;
+        u64 cursor = 0;
+        
+        for (u64 drawn = 0; drawn < triangle_count; drawn += 1) {
+            if (best == ~0ull) {
+                while (emitted[cursor]) cursor += 1;
+                best = cursor;
+            }
+            
+            let triangle = source.indices + best * 3;
+            for (int i = 0; i < 3; i += 1) result.indices[drawn * 3 + i] = triangle[i];
+            emitted[best] = true;
+            
+            int next[cache_size + 3] = {};
+            int next_count = 0;
+            
+            for (int i = 0; i < 3; i += 1) {
+                let vertex = triangle[i];
+                let list = adjacency + first[vertex];
+                
+                for (uint j = 0; j < live[vertex]; j += 1) {
+                    if (list[j] == best) {
+                        list[j] = list[live[vertex] - 1];
+                        break;
+                    }
+                }
+                
+                live[vertex] -= 1;
+                next[next_count] = (int) vertex;
+                next_count += 1;
+            }
+            
+            for (int i = 0; i < cached; i += 1) {
+                let vertex = cache[i];
+                if (vertex != (int) triangle[0] && vertex != (int) triangle[1] && vertex != (int) triangle[2]) {
+                    next[next_count] = vertex;
+                    next_count += 1;
+                }
+            }
+            
+            for (int i = cache_size; i < next_count; i += 1) {
+                cache_positions[next[i]] = -1;
+                scores[next[i]] = score(next[i]);
+            }
+            
+            cached = next_count < cache_size ? next_count : cache_size;
+            
+            for (int i = 0; i < cached; i += 1) {
+                cache[i] = next[i];
+                cache_positions[cache[i]] = i;
+                scores[cache[i]] = score(cache[i]);
+            }
+            
+            best = ~0ull;
+            float best_score = 0.f;
+            
+            for (int i = 0; i < next_count; i += 1) {
+                let vertex = next[i];
+                
+                for (uint j = 0; j < live[vertex]; j += 1) {
+                    let t = adjacency[first[vertex] + j];
+                    let corners = source.indices + (u64) t * 3;
+                    let triangle_score = scores[corners[0]] + scores[corners[1]] + scores[corners[2]];
+                    
+                    if (triangle_score > best_score) {
+                        best = t;
+                        best_score = triangle_score;
+                    }
+                }
+            }
+        }
+        
+        // then the vertices in the order the indices first use them. every vertex of the
+        // primitives is used, none are dropped
+        constexpr uint32 unused = ~0u;
+        
+        uint32 remap[vertex_count] = {};
+        uint32 count = 0;
+        
+        for (u64 i = 0; i < vertex_count; i += 1) remap[i] = unused;
+        
+        for (u64 i = 0; i < index_count; i += 1) {
+            let index = &result.indices[i];
+            
+            if (remap[*index] == unused) {
+                result.vertices[count] = source.vertices[*index];
+                remap[*index] = count;
+                count += 1;
+            }
+            
+            *index = remap[*index];
+        }
+        
+        return result;
+    }
+    
+    // what the app draws, reordered already. the make_ functions match geometry.hh's
+    // generators index for index
+    inline constexpr auto box = reorder(make_box());
+    inline constexpr auto quad = reorder(make_quad());
+    
+    template <uint longitude_segments, uint latitude_segments>
+    inline constexpr auto sphere = reorder(make_sphere<longitude_segments, latitude_segments>());
+    
+    template <uint subdivisions>
+    inline constexpr auto icosphere = reorder(make_icosphere<subdivisions>());
+};
+
+#endif // __learngl_primitives__
@@ -0,0 +1,107 @@
+
+#include <cmath>
+#include <cstring>
+
+#include "quantize.hh"
+
+function half_from_float(float value) -> u16 {
+    uint32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    
+    let sign = (uint32) (bits >> 16 & 0x8000);
+    let biased = (int) (bits >> 23 & 0xFF);
+    let mantissa = bits & 0x7FFFFF;
+    
+    if (biased == 0xFF) return (u16) (sign | 0x7C00 | (mantissa ? 0x200 : 0)); // infinity, nan
+    
+    let exponent = biased - 127 + 15;
+    if (exponent >= 31) return (u16) (sign | 0x7C00);
+    
+    // what's shifted out decides the rounding, ties to the even result. a carry out of
+    // the mantissa bumps the exponent, which is the right answer too
+    uint32 half;
+    uint32 rest;
+    uint32 halfway;
+    
+    if (exponent <= 0) {
+        // subnormal, in units of 2^-24
+        if (exponent < -10) return (u16) sign;
+        
+        let shift = (uint32) (14 - exponent);
+        let full = mantissa | 0x800000;
+        
+        half = full >> shift;
+        rest = full & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    } else {
+        half = (uint32) exponent << 10 | mantissa >> 13;
+        rest = mantissa & 0x1FFF;
+        halfway = 0x1000;
+    }
+    
+    if (rest > halfway || (rest == halfway && (half & 1))) half += 1;
+    
+    return (u16) (sign | half);
+}
+
+function float_from_half(u16 half) -> float {
+    let sign = (uint32) (half & 0x8000) << 16;
+    let exponent = (uint32) (half >> 10 & 0x1F);
+    let mantissa = (uint32) (half & 0x3FF);
+    
+    if (exponent == 0) {
+        let value = std::ldexp((float) mantissa, -24);
+        return sign ? -value : value;
+    }
+    
+    let bits = exponent == 0x1F
+        ? sign | 0x7F800000 | mantissa << 13
+        : sign | (exponent + 127 - 15) << 23 | mantissa << 13;
+    
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    
+    return value;
+}
+
+function quantize_vertices(t_slice<t_vertex> vertices, t_packed_vertex __out * packed) -> t_quantization {
+    if (vertices.length() == 0) return { .scale = { 1.f, 1.f, 1.f } };
+    
+    vec3 low = vertices[0].position;
+    vec3 high = low;
+    
+    for (u64 i = 0; i < vertices.length(); i += 1) {
+        low = glm::min(low, vertices[i].position);
+        high = glm::max(high, vertices[i].position);
+    }
+    
+    t_quantization quantization = { .offset = low, .scale = high - low, .uv_error = 0.f, .position_error = 0.f };
+    
+    let extent = std::fmax(std::fmax(quantization.scale.x, quantization.scale.y), quantization.scale.z);
+    
+    for (u64 i = 0; i < vertices.length(); i += 1) {
+        let vertex = &vertices[i];
+        let out = &packed[i];
+        
+        for (int k = 0; k < 3; k += 1) {
+            // flat along this axis, every vertex sits on the offset
+            let unit = quantization.scale[k] > 0.f ? (vertex->position[k] - low[k]) / quantization.scale[k] : 0.f;
+            out->position[k] = (u16) std::lround(m_clamp(unit, 0.f, 1.f) * 65535.f);
+            
+            // as the vertex shader puts it back together
+            let decoded = low[k] + quantization.scale[k] * (out->position[k] / 65535.f);
+            quantization.position_error = std::fmax(quantization.position_error, std::fabs(decoded - vertex->position[k]));
+        }
+        
+        out->padding = 0;
+        
+        for (int k = 0; k < 2; k += 1) {
+            out->uv[k] = half_from_float(vertex->uv[k]);
+            quantization.uv_error = std::fmax(quantization.uv_error, std::fabs(float_from_half(out->uv[k]) - vertex->uv[k]));
+        }
+    }
+    
+    if (extent > 0.f) quantization.position_error /= extent;
+    
+    return quantization;
+}
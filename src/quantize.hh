@@ -0,0 +1,37 @@
+#ifndef __learngl_quantize__
+#define __learngl_quantize__
+
+#include "common.hh"
+#include "render.hh"
+
+// what create_mesh uploads instead of t_vertex when the uvs survive it: 12 bytes a vertex
+// against 20. the positions are normalized unsigned shorts across the mesh's bounds,
+// which the shaders scale back with position_offset and position_scale
+struct t_packed_vertex {
+    u16 position[3];
+    u16 padding; // keeps the uvs 4 byte aligned
+    u16 uv[2]; // half floats
+};
+
+struct t_quantization {
+    vec3 offset; // the bounds' low corner
+    vec3 scale; // and their size, a position is offset + scale * unorm
+    float uv_error; // the most halving moved any uv
+    float position_error; // the most any position moved, over the bounds' largest side
+};
+
+// half a texel of a 2048 texture, which is what 0 to 1 uvs lose at worst
+constexpr float max_uv_error = 1.f / 4096.f;
+
+// a whole 16 bit step, twice what rounding costs. positions only lose more far off the
+// origin, where offset + scale * unorm runs out of float precision
+constexpr float max_position_error = 1.f / 65535.f;
+
+// round to nearest even, out of range values go to infinity
+function half_from_float(float value) -> u16;
+function float_from_half(u16 half) -> float;
+
+// packed must hold as many vertices
+function quantize_vertices(t_slice<t_vertex> vertices, t_packed_vertex __out * packed) -> t_quantization;
+
+#endif // __learngl_quantize__
@@ -0,0 +1,337 @@
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include <glad/glad.h>
+
+#include "pack.hh"
+#include "registry.hh"
+#include "residency.hh"
+
+namespace {
+    enum struct t_kind : int {
+        texture,
+        mesh,
+        shader,
+    };
+    
+    struct t_entry {
+        t_kind kind;
+        uint references;
+        uint name; // the texture, a gl name or a residency handle, or the shader program
+        t_mesh * mesh;
+    };
+    
+    // by content key. every kind hashes from its own seed, so they don't share keys
+    std::unordered_map<u64, t_entry> entries;
+    
+    // back from the objects handed out to their keys, for release
+    std::unordered_map<t_texture, u64> texture_keys;
+    std::unordered_map<t_shader, u64> shader_keys;
+    std::unordered_map<t_mesh *, u64> mesh_keys;
+    
+    // files already hashed, acquiring the same path again doesn't read it
+    std::unordered_map<std::string, u64> path_keys;
+    
+    u64 hits = 0;
+    u64 misses = 0;
+    u64 released = 0;
+    
+    inline function seed(t_kind kind) -> u64 {
+        return 0xcbf29ce484222325 + (u64) kind;
+    }
+    
+    // the file's bytes, straight from the pack when it's there. owned is set when they
+    // were read from disk and have to be freed
+    function read_file(char const * path, bool32 __out * owned) -> t_slice<u8 const> {
+        *owned = false;
+        
+        let packed = pack::find(path);
+        if (packed.ptr) return packed;
+        
+        let file = std::fopen(path, "rb");
+        if (!file) return {};
+        
+        std::fseek(file, 0, SEEK_END);
+        let size = (u64) std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        
+        let data = static_cast<u8 *>(std::malloc(size));
+        let ok = std::fread(data, 1, size, file) == size;
+        std::fclose(file);
+        
+        if (!ok) {
+            std::free(data);
+            return {};
+        }
+        
+        *owned = true;
+        
+        return { .ptr = data, .len = size };
+    }
+    
+    function load_texture(t_slice<u8 const> file) -> t_texture {
+        let compressed = load_compressed_texture(file);
+        
+        if (compressed.level_count) {
+            let texture = create_texture(&compressed);
+            free_compressed_texture(&compressed);
+            
+            return texture;
+        }
+        
+        let image = load_image(file);
+        if (!image.pixels) return 0;
+        
+        let texture = create_texture(&image);
+        free_image(&image);
+        
+        return texture;
+    }
+    
+    // a new reference to what's registered under the key, null if nothing is
+    function reference(u64 key) -> t_entry * {
+        let found = entries.find(key);
+        if (found == entries.end()) return null;
+        
+        found->second.references += 1;
+        hits += 1;
+        
+        return &found->second;
+    }
+    
+    function insert(u64 key, t_entry entry) -> void {
+        entries[key] = entry;
+        misses += 1;
+        
+        switch (entry.kind) {
+            case t_kind::texture: texture_keys[entry.name] = key; break;
+            case t_kind::mesh: mesh_keys[entry.mesh] = key; break;
+            case t_kind::shader: shader_keys[entry.name] = key; break;
+        }
+    }
+    
+    function release(u64 key) -> void {
+        let found = entries.find(key);
+        m_assert(found != entries.end() && found->second.references > 0);
+        
+        found->second.references -= 1;
+    }
+    
+    function destroy(t_entry * entry) -> void {
+        switch (entry->kind) {
+            case t_kind::texture: {
+                residency::remove(entry->name);
+                texture_keys.erase(entry->name);
+            } break;
+            
+            case t_kind::mesh: {
+                destroy_mesh(entry->mesh);
+                mesh_keys.erase(entry->mesh);
+                delete entry->mesh;
+            } break;
+            
+            case t_kind::shader: {
+                glDeleteProgram(entry->name);
+                shader_keys.erase(entry->name);
+            } break;
+        }
+    }
+}
+
+// fnv style over 8 byte words, folding the high bits back down after every
+// multiply, then murmur's finish. fast, not meant to resist crafted collisions
+function registry::hash(t_slice<u8 const> bytes, u64 h) -> u64 {
+    constexpr u64 k = 0x9e3779b97f4a7c15;
+    
+    u64 i = 0;
+    
+    for (; i + 8 <= bytes.length(); i += 8) {
+        u64 word;
+        std::memcpy(&word, bytes.ptr + i, 8);
+        
+        h = (h ^ word) * k;
+        h ^= h >> 32;
+    }
+    
+    for (; i < bytes.length(); i += 1) {
+        h = (h ^ bytes[i]) * k;
+        h ^= h >> 32;
+    }
+    
+    h ^= bytes.length();
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53;
+    h ^= h >> 33;
+    
+    // 0 stands for no key
+    return h ? h : 1;
+}
+
+function registry::texture_key(char const * path) -> u64 {
+    bool32 owned;
+    let file = read_file(path, &owned);
+    if (!file.ptr) return 0;
+    
+    let key = texture_key(file);
+    if (owned) std::free(const_cast<u8 *>(file.ptr));
+    
+    return key;
+}
+
+function registry::texture_key(t_slice<u8 const> file) -> u64 {
+    return hash(file, seed(t_kind::texture));
+}
+
+function registry::acquire_texture(char const * path) -> t_texture {
+    let known = path_keys.find(path);
+    
+    if (known != path_keys.end()) {
+        if (let entry = reference(known->second)) return entry->name;
+    }
+    
+    bool32 owned;
+    let file = read_file(path, &owned);
+    if (!file.ptr) return 0;
+    
+    let key = hash(file, seed(t_kind::texture));
+    path_keys[path] = key;
+    
+    // the same contents under another path
+    let entry = reference(key);
+    let texture = entry ? entry->name : load_texture(file);
+    
+    if (!entry && texture) {
+        insert(key, { .kind = t_kind::texture, .references = 1, .name = texture });
+    }
+    
+    if (owned) std::free(const_cast<u8 *>(file.ptr));
+    
+    return texture;
+}
+
+function registry::acquire_mesh(t_slice<t_vertex> vertices, t_slice<uint32> indices, bool32 reordered, t_slice<t_mesh_lod const> lods) -> t_mesh * {
+    let key = hash(
+        { .ptr = reinterpret_cast<u8 const *>(indices.ptr), .len = sizeof(uint32) * indices.length() },
+        hash({ .ptr = reinterpret_cast<u8 const *>(vertices.ptr), .len = sizeof(t_vertex) * vertices.length() }, seed(t_kind::mesh))
+    );
+    
+    if (let entry = reference(key)) return entry->mesh;
+    
+    let mesh = new t_mesh(create_mesh(vertices, indices, reordered, lods));
+    insert(key, { .kind = t_kind::mesh, .references = 1, .mesh = mesh });
+    
+    return mesh;
+}
+
+function registry::acquire_shader(char const * vertex, char const * fragment) -> t_shader {
+    let key = shader_key(vertex, fragment);
+    
+    if (let entry = reference(key)) return entry->name;
+    
+    return add_shader(key, create_shader(vertex, fragment));
+}
+
+function registry::shader_key(char const * vertex, char const * fragment) -> u64 {
+    return hash(
+        { .ptr = reinterpret_cast<u8 const *>(fragment), .len = std::strlen(fragment) },
+        hash({ .ptr = reinterpret_cast<u8 const *>(vertex), .len = std::strlen(vertex) }, seed(t_kind::shader))
+    );
+}
+
+function registry::find_texture(u64 key) -> t_texture {
+    let entry = key ? reference(key) : null;
+    return entry ? entry->name : 0;
+}
+
+function registry::add_texture(u64 key, t_texture texture) -> t_texture {
+    // texture_key couldn't read the file, nothing else has it to share
+    if (!key) return texture;
+    
+    if (let entry = reference(key)) {
+        residency::remove(texture);
+        return entry->name;
+    }
+    
+    insert(key, { .kind = t_kind::texture, .references = 1, .name = texture });
+    
+    return texture;
+}
+
+function registry::find_shader(u64 key) -> t_shader {
+    let entry = reference(key);
+    return entry ? entry->name : 0;
+}
+
+function registry::add_shader(u64 key, t_shader shader) -> t_shader {
+    if (let entry = reference(key)) {
+        glDeleteProgram(shader);
+        return entry->name;
+    }
+    
+    insert(key, { .kind = t_kind::shader, .references = 1, .name = shader });
+    
+    return shader;
+}
+
+function registry::release_texture(t_texture texture) -> void {
+    let found = texture_keys.find(texture);
+    m_assert(found != texture_keys.end());
+    
+    release(found->second);
+}
+
+function registry::release_mesh(t_mesh * mesh) -> void {
+    let found = mesh_keys.find(mesh);
+    m_assert(found != mesh_keys.end());
+    
+    release(found->second);
+}
+
+function registry::release_shader(t_shader shader) -> void {
+    let found = shader_keys.find(shader);
+    m_assert(found != shader_keys.end());
+    
+    release(found->second);
+}
+
+function registry::collect() -> void {
+    for (let i = entries.begin(); i != entries.end();) {
+        if (i->second.references > 0) {
+            ++i;
+            continue;
+        }
+        
+        destroy(&i->second);
+        i = entries.erase(i);
+        released += 1;
+    }
+}
+
+function registry::stats() -> t_stats {
+    t_stats result = { .hits = hits, .misses = misses, .released = released };
+    
+    for (let & [key, entry] : entries) {
+        switch (entry.kind) {
+            case t_kind::texture: result.textures += 1; break;
+            case t_kind::mesh: result.meshes += 1; break;
+            case t_kind::shader: result.shaders += 1; break;
+        }
+    }
+    
+    return result;
+}
+
+function registry::terminate() -> void {
+    for (let & [key, entry] : entries) {
+        destroy(&entry);
+    }
+    
+    entries.clear();
+    path_keys.clear();
+}
@@ -0,0 +1,55 @@
+#ifndef __learngl_registry__
+#define __learngl_registry__
+
+#include "common.hh"
+#include "render.hh"
+
+// shared assets, keyed by a hash of their contents: a texture file, a mesh's vertices
+// and indices or a shader's sources that were loaded before hand back the same gl
+// objects instead of a second copy. every acquire takes a reference and every release
+// drops one, assets left without any are deleted by the next collect. all of it runs
+// on the gl thread, except for texture_key
+namespace registry {
+    struct t_stats {
+        uint textures;
+        uint meshes;
+        uint shaders;
+        u64 hits; // acquires that shared an asset already loaded
+        u64 misses; // acquires that loaded it
+        u64 released; // assets deleted once nothing referred to them
+    };
+    
+    // what assets are keyed by. chained through seed to cover several buffers
+    function hash(t_slice<u8 const> bytes, u64 seed) -> u64;
+    
+    // the hash of the file's contents, 0 if it can't be read. paths are looked up in the pack first
+    function texture_key(char const * path) -> u64;
+    function texture_key(t_slice<u8 const> file) -> u64;
+    
+    function acquire_texture(char const * path) -> t_texture; // 0 if it can't be loaded
+    function acquire_mesh(t_slice<t_vertex> vertices, t_slice<uint32> indices, bool32 reordered = false, t_slice<t_mesh_lod const> lods = {}) -> t_mesh *; // see create_mesh
+    function acquire_shader(char const * vertex, char const * fragment) -> t_shader;
+    
+    // for textures decoded elsewhere, e.g. on the job workers. find returns a new reference,
+    // or 0 when nothing is registered under the key. add takes ownership of the texture, a
+    // plain gl name or a residency handle, and if another one got the key in the meantime
+    // deletes it and returns that one instead. a key of 0, an unreadable file, is never
+    // registered and the texture stays the caller's
+    function find_texture(u64 key) -> t_texture;
+    function add_texture(u64 key, t_texture texture) -> t_texture;
+    
+    // the same for shaders built in steps, see begin_shader
+    function shader_key(char const * vertex, char const * fragment) -> u64;
+    function find_shader(u64 key) -> t_shader;
+    function add_shader(u64 key, t_shader shader) -> t_shader;
+    
+    function release_texture(t_texture texture) -> void;
+    function release_mesh(t_mesh * mesh) -> void;
+    function release_shader(t_shader shader) -> void;
+    
+    function collect() -> void; // once per frame, deletes what is no longer referred to
+    function stats() -> t_stats;
+    function terminate() -> void; // deletes everything, referred to or not
+};
+
+#endif // __learngl_registry__
@@ -1,43 +1,201 @@
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
 #include <glad/glad.h>
 #include <glfw/glfw3.h>
-#include <stb/stb_image.h>
 
+#include "meshlets.hh"
+#include "optimize.hh"
+#include "quantize.hh"
+#include "registry.hh"
 #include "render.hh"
+#include "residency.hh"
+#include "shader_cache.hh"
+#include "stream.hh"
+#include "virtual_texture.hh"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0 // EXT_texture_compression_s3tc, not in our glad
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1 // KHR_parallel_shader_compile, not in our glad
+#endif
+
+namespace {
+    // what the scene being rendered last bound, so that nodes sharing a texture (an
+    // atlas, see atlas.hh) or a shader don't rebind it. only trusted inside t_scene::render
+    constexpr uint unknown = ~0u;
+    
+    bool32 batching = false;
+    t_texture bound_texture = unknown;
+    t_shader bound_shader = unknown;
+    
+    // how far a lod may be off, in pixels
+    constexpr float max_lod_error = 1.f;
+    
+    // whether the driver compiles and links on threads of its own, asked once. it is
+    // told to use as many as it likes, by default it may keep to one
+    function parallel_compile() -> bool32 {
+        int static supported = -1;
+        
+        if (supported < 0) {
+            let khr = glfwExtensionSupported("GL_KHR_parallel_shader_compile");
+            let arb = glfwExtensionSupported("GL_ARB_parallel_shader_compile");
+            
+            using t_max_threads = void (APIENTRYP)(GLuint count);
+            let max_threads = khr ? (t_max_threads) glfwGetProcAddress("glMaxShaderCompilerThreadsKHR")
+                : arb ? (t_max_threads) glfwGetProcAddress("glMaxShaderCompilerThreadsARB")
+                : null;
+            
+            if (max_threads) max_threads(0xFFFFFFFF);
+            
+            supported = khr || arb;
+        }
+        
+        return supported;
+    }
+    
+    // the coarsest lod whose error, seen from the nearest the mesh can be to the camera,
+    // stays under max_lod_error. the whole mesh when it has no lods
+    function choose_lod(t_node __in * node, t_camera __in * camera) -> t_mesh_lod {
+        let mesh = node->mesh;
+        let whole = t_mesh_lod { .first_index = 0, .index_count = (uint32) mesh->indices.length() };
+        
+        if (mesh->lods.length() < 2) return whole;
+        
+        let distance = glm::length(camera->position - node->position) - mesh->radius;
+        if (distance <= 0.f) return whole;
+        
+        int viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        
+        // pixels per unit at that distance
+        let scale = camera->projection[1][1] * viewport[3] * 0.5f / distance;
+        
+        for (u64 i = mesh->lods.length() - 1; i > 0; i -= 1) {
+            if (mesh->lods[i].error * scale <= max_lod_error) return mesh->lods[i];
+        }
+        
+        return whole;
+    }
+    
+    function draw(t_node __in * node, t_camera __in * camera, t_shader program) -> void {
+        let model = glm::translate(glm::identity<mat4>(), node->position) * glm::mat4_cast(node->orientation);
+        
+        let mvp = camera->projection * camera->view * model;
+        
+        glUniformMatrix4fv(glGetUniformLocation(program, "mvp"), 1, GL_FALSE, glm::value_ptr(mvp));
+        
+        // only lit shaders have it, for the others the location is -1 and this does nothing
+        glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, glm::value_ptr(model));
+        
+        glUniform3fv(glGetUniformLocation(program, "position_offset"), 1, glm::value_ptr(node->mesh->position_offset));
+        glUniform3fv(glGetUniformLocation(program, "position_scale"), 1, glm::value_ptr(node->mesh->position_scale));
+        
+        let lod = choose_lod(node, camera);
+        
+        // clusters are lod 0's, a coarser lod is drawn whole
+        if (node->clusters && lod.first_index == 0) {
+            draw_clusters(node->clusters, model, mvp, camera->position);
+            return;
+        }
+        
+        glBindVertexArray(node->mesh->vao);
+        
+        if (node->mesh->indices.ptr) {
+            let index_size = node->mesh->index_type == GL_UNSIGNED_SHORT ? sizeof(u16) : sizeof(uint32);
+            glDrawElements(GL_TRIANGLES, lod.index_count, node->mesh->index_type, (void *) (index_size * lod.first_index));
+        } else {
+            glDrawArrays(GL_TRIANGLES, 0, node->mesh->vertices.length());
+        }
+    }
+}
 
 function t_node::render(t_camera __in * camera) -> void {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glUseProgram(shader);
-    
-    glUniformMatrix4fv(
-        glGetUniformLocation(shader, "mvp"),
-        1,
-        GL_FALSE,
-        glm::value_ptr(
-            camera->projection *
-            camera->view *
-            glm::translate(glm::identity<mat4>(), position) *
-            glm::mat4_cast(orientation)
-        )
-    );
+    if (virtual_texture) {
+        draw(this, camera, virtual_texture->use(false));
+        
+        // it binds its own program and textures
+        bound_texture = unknown;
+        bound_shader = unknown;
+        return;
+    }
     
-    glBindVertexArray(mesh->vao);
+    let resolved = texture_stream::resolve(residency::use(texture));
     
-    if (mesh->indices.ptr) {
-        glDrawElements(GL_TRIANGLES, mesh->indices.length(), GL_UNSIGNED_INT, 0);
-    } else {
-        glDrawArrays(GL_TRIANGLES, 0, mesh->vertices.length());
+    if (!batching || resolved != bound_texture) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, resolved);
     }
+    
+    if (!batching || shader != bound_shader) {
+        glUseProgram(shader);
+    }
+    
+    bound_texture = resolved;
+    bound_shader = shader;
+    
+    draw(this, camera, shader);
+}
+
+function t_node::render_feedback(t_camera __in * camera) -> void {
+    if (virtual_texture) draw(this, camera, virtual_texture->use(true));
 }
 
 function t_scene::render(t_camera __in * camera) -> void {
+    batching = true;
+    bound_texture = unknown;
+    bound_shader = unknown;
+    
     for (int i = 0; i < nodes.length(); i += 1) {
         nodes[i].render(camera);
     }
+    
+    batching = false;
+}
+
+function t_scene::render_feedback(t_camera __in * camera) -> void {
+    for (u64 i = 0; i < nodes.length(); i += 1) {
+        nodes[i].render_feedback(camera);
+    }
+}
+
+function create_texture(char const * path) -> t_texture {
+    if (is_compressed_texture_file(path)) {
+        let compressed = load_compressed_texture(path);
+        m_assert(compressed.level_count);
+        
+        let texture = create_texture(&compressed);
+        free_compressed_texture(&compressed);
+        
+        return texture;
+    }
+    
+    let image = load_image(path);
+    m_assert(image.pixels);
+    
+    let texture = create_texture(&image);
+    free_image(&image);
+    
+    return texture;
 }
 
-function create_texture(char const * path) -> uint {
+function create_texture(t_image __in * image) -> t_texture {
+    let mips = generate_mips(image);
+    let texture = create_texture(&mips);
+    free_mips(&mips);
+    
+    return texture;
+}
+
+function create_texture(t_mip_chain __in * mips) -> t_texture {
+    m_assert(mips->levels[0].channels == 3);
+    
     uint texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
@@ -46,101 +204,175 @@ function create_texture(char const * path) -> uint {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mips->level_count - 1);
     
-    int width, height, n_channels;
-    let data = stbi_load(path, &width, &height, &n_channels, 0);
-    m_assert(data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    for (uint i = 0; i < mips->level_count; i += 1) {
+        let level = &mips->levels[i];
+        glTexImage2D(GL_TEXTURE_2D, i, GL_RGB, level->width, level->height, 0, GL_RGB, GL_UNSIGNED_BYTE, level->pixels);
+    }
     
-    stbi_image_free(data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     
     return texture;
 }
 
-function create_shader(char const * vertex, char const * fragment) -> t_shader {
-    let vertex_shader = [=] {
-        let vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex_shader, 1, &vertex, null);
-        glCompileShader(vertex_shader);
-        
-        int ok = 0;
-        glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &ok);
-        m_assert(ok);
-        
-        return vertex_shader;
-    } ();
+function create_texture(t_compressed_texture __in * compressed) -> t_texture {
+    let format = compressed->format == t_block_format::bc1
+        ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+        : GL_COMPRESSED_RGBA_BPTC_UNORM;
     
-    let fragment_shader = [=] {
-        let fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment_shader, 1, &fragment, null);
-        glCompileShader(fragment_shader);
-        
-        int ok = 0;
-        glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &ok);
-        m_assert(ok);
-        
-        return fragment_shader;
-    } ();
-    
-    let shader_program = [=] {
-        let shader_program = glCreateProgram();
-        glAttachShader(shader_program, vertex_shader);
-        glAttachShader(shader_program, fragment_shader);
-        glLinkProgram(shader_program);
-        
-        int ok = 0;
-        glGetProgramiv(shader_program, GL_LINK_STATUS, &ok);
-        m_assert(ok);
-        
-        return shader_program;
-    } ();
+    uint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
     
-    glUseProgram(shader_program);
-    glUniform1i(glGetUniformLocation(shader_program, "f_texture"), 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, compressed->level_count - 1);
     
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
+    // every level is in the file, nothing to generate
+    for (uint i = 0; i < compressed->level_count; i += 1) {
+        let level = &compressed->levels[i];
+        glCompressedTexImage2D(GL_TEXTURE_2D, i, format, level->width, level->height, 0, (int) level->size, level->data);
+    }
     
-    return shader_program;
+    return texture;
 }
 
-function create_basic_shader() -> uint {
-    char static const * vertex = R"(
-        #version 450 core
-        
-        layout (location = 0) in vec3 v_pos;
-        layout (location = 1) in vec2 v_tex;
-        
-        out vec2 f_tex;
-        
-        uniform mat4 mvp;
+function begin_shader(char const * vertex, char const * fragment) -> t_shader_build {
+    let key = registry::hash(
+        { .ptr = reinterpret_cast<u8 const *>(fragment), .len = std::strlen(fragment) },
+        registry::hash({ .ptr = reinterpret_cast<u8 const *>(vertex), .len = std::strlen(vertex) }, 0)
+    );
+    
+    // a binary loads synchronously, there's nothing left to wait for
+    if (let cached = shader_cache::load(key)) {
+        return { .program = cached, .key = key };
+    }
+    
+    parallel_compile();
+    
+    let compile = [] (GLenum type, char const * source) {
+        let shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, null);
+        glCompileShader(shader);
         
-        void main() {
-            gl_Position = mvp * vec4(v_pos, 1.0);
-            f_tex = v_tex;
-        }
-    )";
+        return shader;
+    };
+    
+    t_shader_build build = {
+        .program = glCreateProgram(),
+        .vertex = compile(GL_VERTEX_SHADER, vertex),
+        .fragment = compile(GL_FRAGMENT_SHADER, fragment),
+        .key = key,
+    };
+    
+    // linking right away is fine, the driver orders it after the compiles. any
+    // errors are only looked at in finish_shader
+    glAttachShader(build.program, build.vertex);
+    glAttachShader(build.program, build.fragment);
+    glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(build.program);
     
-    char static const * fragment = R"(
-        #version 450 core
+    return build;
+}
+
+function shader_ready(t_shader_build __in * build) -> bool32 {
+    if (!build->vertex || !parallel_compile()) return true;
+    
+    int done = 0;
+    glGetProgramiv(build->program, GL_COMPLETION_STATUS_KHR, &done);
+    
+    return done;
+}
+
+function finish_shader(t_shader_build __in * build) -> t_shader {
+    let program = build->program;
+    
+    if (build->vertex) {
+        int ok = 0;
         
-        in vec2 f_tex;
+        glGetShaderiv(build->vertex, GL_COMPILE_STATUS, &ok);
+        m_assert(ok);
         
-        out vec4 color;
+        glGetShaderiv(build->fragment, GL_COMPILE_STATUS, &ok);
+        m_assert(ok);
         
-        uniform sampler2D f_texture;
+        glGetProgramiv(program, GL_LINK_STATUS, &ok);
+        m_assert(ok);
         
-        void main() {
-            color = texture(f_texture, f_tex);
-        }
-    )";
+        glDeleteShader(build->vertex);
+        glDeleteShader(build->fragment);
+        
+        shader_cache::store(build->key, program);
+    }
     
-    return create_shader(vertex, fragment);
+    // a binary's uniforms start over from zero too, like after a link
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "f_texture"), 0);
+    
+    *build = {};
+    
+    return program;
 }
 
-function create_mesh(t_slice<t_vertex> vertices, t_slice<uint32> indices) -> t_mesh {
+function create_shader(char const * vertex, char const * fragment) -> t_shader {
+    let build = begin_shader(vertex, fragment);
+    return finish_shader(&build);
+}
+
+function create_mesh(t_slice<t_vertex> source_vertices, t_slice<uint32> source_indices, bool32 reordered, t_slice<t_mesh_lod const> source_lods) -> t_mesh {
+    m_assert(!reordered || source_indices.length());
+    m_assert(!source_lods.length() || (reordered && source_lods[0].first_index == 0));
+    
+    // without indices, one for each vertex until they're welded
+    let index_count = source_indices.length() ? source_indices.length() : source_vertices.length();
+    
+    // one allocation, the indices after the vertices and the lods after them
+    let storage = std::malloc(sizeof(t_vertex) * source_vertices.length() + sizeof(uint32) * index_count + sizeof(t_mesh_lod) * source_lods.length());
+    
+    t_slice<t_vertex> vertices = { .ptr = static_cast<t_vertex *>(storage), .len = source_vertices.length() };
+    t_slice<uint32> indices = { .ptr = reinterpret_cast<uint32 *>(vertices.ptr + vertices.length()), .len = index_count };
+    t_slice<t_mesh_lod> lods = { .ptr = reinterpret_cast<t_mesh_lod *>(indices.ptr + indices.length()), .len = source_lods.length() };
+    
+    std::memcpy(vertices.ptr, source_vertices.ptr, sizeof(t_vertex) * vertices.length());
+    std::memcpy(lods.ptr, source_lods.ptr, sizeof(t_mesh_lod) * lods.length());
+    
+    float radius = 0.f;
+    for (u64 i = 0; i < vertices.length(); i += 1) radius = std::max(radius, glm::length(vertices[i].position));
+    
+    if (source_indices.length()) {
+        // anything out of range would read past the vertices, or once narrowed to 16 bits
+        // quietly pick the wrong one. files are checked when they're loaded
+        uint32 highest = 0;
+        for (u64 i = 0; i < source_indices.length(); i += 1) highest = std::max(highest, source_indices[i]);
+        m_assert(highest < source_vertices.length());
+        
+        std::memcpy(indices.ptr, source_indices.ptr, sizeof(uint32) * indices.length());
+    } else {
+        vertices.len = weld_vertices(vertices, indices);
+    }
+    
+    if (indices.length() && !reordered) {
+        optimize_vertex_cache(indices, vertices.length());
+        vertices.len = optimize_vertex_fetch(vertices, indices);
+    }
+    
+    // what the gpu gets, which create_mesh doesn't keep
+    std::vector<t_packed_vertex> quantized(vertices.length());
+    let quantization = quantize_vertices(vertices, quantized.data());
+    let packed = quantization.uv_error <= max_uv_error && quantization.position_error <= max_position_error;
+    
+    let short_indices = vertices.length() <= 0x10000;
+    std::vector<u16> narrowed(short_indices ? indices.length() : 0);
+    
+    for (u64 i = 0; i < narrowed.size(); i += 1) {
+        narrowed[i] = (u16) indices[i];
+    }
+    
     uint vbo = 0;
     uint vao = 0;
     uint ebo = 0;
@@ -154,13 +386,26 @@ function create_mesh(t_slice<t_vertex> vertices, t_slice<uint32> indices) -> t_m
         
         {
             glBindBuffer(GL_ARRAY_BUFFER, vbo);
-            glBufferData(GL_ARRAY_BUFFER, sizeof(t_vertex) * vertices.length(), vertices, GL_STATIC_DRAW);
+            
+            if (packed) {
+                glBufferData(GL_ARRAY_BUFFER, sizeof(t_packed_vertex) * vertices.length(), quantized.data(), GL_STATIC_DRAW);
+                
+                glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(t_packed_vertex), (void *) offsetof(t_packed_vertex, position));
+                glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(t_packed_vertex), (void *) offsetof(t_packed_vertex, uv));
+            } else {
+                glBufferData(GL_ARRAY_BUFFER, sizeof(t_vertex) * vertices.length(), vertices, GL_STATIC_DRAW);
+                
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(t_vertex), (void *) 0);
+                glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(t_vertex), (void *) (1 * sizeof(vec3)));
+            }
             
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32) * indices.length(), indices, GL_STATIC_DRAW);
             
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(t_vertex), (void *) 0);
-            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(t_vertex), (void *) (1 * sizeof(vec3)));
+            if (short_indices) {
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(u16) * narrowed.size(), narrowed.data(), GL_STATIC_DRAW);
+            } else {
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32) * indices.length(), indices, GL_STATIC_DRAW);
+            }
             
             glEnableVertexAttribArray(0);
             glEnableVertexAttribArray(1);
@@ -176,143 +421,22 @@ function create_mesh(t_slice<t_vertex> vertices, t_slice<uint32> indices) -> t_m
         .vbo = vbo,
         .ebo = ebo,
         .vertices = vertices,
-        .indices = indices,
-    };
-}
-
-
-function create_box_mesh() -> t_mesh {
-    t_vertex static vertices[36] = {
-        
-        // front face
-        { { 0.5f, 0.5f, 0.5f }, { 0.f, 1.f } },
-        { { 0.5f, 0.5f, -0.5f }, { 0.f, 0.f } },
-        { { -0.5f, 0.5f, -0.5f }, { 1.f, 0.f } },
-        
-        { { 0.5f, 0.5f, 0.5f }, { 0.f, 1.f } },
-        { { -0.5f, 0.5f, -0.5f }, { 1.f, 0.f } },
-        { { -0.5f, 0.5f, 0.5f }, { 1.f, 1.f } },
-        
-        
-        // back face
-        { { -0.5f, -0.5f, 0.5f }, { 0.f, 1.f } },
-        { { -0.5f, -0.5f, -0.5f }, { 0.f, 0.f } },
-        { { 0.5f, -0.5f, -0.5f }, { 1.f, 0.f } },
-        
-        { { -0.5f, -0.5f, 0.5f }, { 0.f, 1.f } },
-        { { 0.5f, -0.5f, -0.5f }, { 1.f, 0.f } },
-        { { 0.5f, -0.5f, 0.5f }, { 1.f, 1.f } },
-        
-        
-        // right face
-        { { 0.5f, -0.5f, 0.5f }, { 0.f, 1.f } },
-        { { 0.5f, -0.5f, -0.5f }, { 0.f, 0.f } },
-        { { 0.5f, 0.5f, -0.5f }, { 1.f, 0.f } },
-        
-        { { 0.5f, -0.5f, 0.5f }, { 0.f, 1.f } },
-        { { 0.5f, 0.5f, -0.5f }, { 1.f, 0.f } },
-        { { 0.5f, 0.5f, 0.5f }, { 1.f, 1.f } },
-        
-        
-        // left face
-        { { -0.5f, 0.5f, 0.5f }, { 0.f, 1.f } },
-        { { -0.5f, 0.5f, -0.5f }, { 0.f, 0.f } },
-        { { -0.5f, -0.5f, -0.5f }, { 1.f, 0.f } },
-        
-        { { -0.5f, 0.5f, 0.5f }, { 0.f, 1.f } },
-        { { -0.5f, -0.5f, -0.5f }, { 1.f, 0.f } },
-        { { -0.5f, -0.5f, 0.5f }, { 1.f, 1.f } },
-        
-        
-        // top face
-        { { 0.5f, -0.5f, 0.5f }, { 0.f, 1.f } },
-        { { 0.5f, 0.5f, 0.5f }, { 0.f, 0.f } },
-        { { -0.5f, 0.5f, 0.5f }, { 1.f, 0.f } },
-        
-        { { 0.5f, -0.5f, 0.5f }, { 0.f, 1.f } },
-        { { -0.5f, 0.5f, 0.5f }, { 1.f, 0.f } },
-        { { -0.5f, -0.5f, 0.5f }, { 1.f, 1.f } },
-        
-        
-        // bottom face
-        { { 0.5f, 0.5f, -0.5f }, { 0.f, 1.f } },
-        { { 0.5f, -0.5f, -0.5f }, { 0.f, 0.f } },
-        { { -0.5f, -0.5f, -0.5f }, { 1.f, 0.f } },
-        
-        { { 0.5f, 0.5f, -0.5f }, { 0.f, 1.f } },
-        { { -0.5f, -0.5f, -0.5f }, { 1.f, 0.f } },
-        { { -0.5f, 0.5f, -0.5f }, { 1.f, 1.f } },
-        
+        .indices = { .ptr = indices.ptr, .len = lods.length() ? lods[0].index_count : indices.length() },
+        .storage = storage,
+        .lods = lods,
+        .radius = radius,
+        .index_type = (uint) (short_indices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT),
+        .quantized = packed,
+        .position_offset = packed ? quantization.offset : vec3 { 0.f, 0.f, 0.f },
+        .position_scale = packed ? quantization.scale : vec3 { 1.f, 1.f, 1.f },
     };
-    
-    return create_mesh({ vertices, 36 }, {});
-}
-
-function create_icosphere_mesh() -> t_mesh {
-    float phi = 1.618033988f;
-    
-    t_vertex static vertices[] = {
-        { { 0.f, 1.f, phi }, { 0.f, 0.f } },
-        { { 0.f, -1.f, phi }, { 0.f, 0.f } },
-        { { 0.f, 1.f, -phi }, { 0.f, 0.f } },
-        { { 0.f, -1.f, -phi }, { 0.f, 0.f } },
-        
-        { { 1.f, phi, 0.f }, { 0.f, 0.f } },
-        { { -1.f, phi, 0.f }, { 0.f, 0.f } },
-        { { 1.f, -phi, 0.f }, { 0.f, 0.f } },
-        { { -1.f, -phi, 0.f }, { 0.f, 0.f } },
-        
-        { { phi, 0.f, 1.f }, { 0.f, 0.f } },
-        { { -phi, 0.f, 1.f }, { 0.f, 0.f } },
-        { { phi, 0.f, -1.f }, { 0.f, 0.f } },
-        { { -phi, 0.f, -1.f }, { 0.f, 0.f } },
-    };
-    
-    uint32 static indices[] = {
-        {}
-    };
-    
-    
-    // TODO without any lighting and proper uv mapping this would look.. not very good
-    return {};
 }
 
-function create_sphere_mesh(uint longitude_segments, uint latitude_segments) -> t_mesh {
-    t_vertex static vertices[4 * 1024] = {}; // horrid way to do this but it'll do for now
-    uint32 static indices[4 * 1024] = {};
-    
-    u64 vertex = 0;
-    u64 index = 0;
-    
-    for (uint y = 0; y <= latitude_segments; y += 1) {
-        for (uint x = 0; x <= longitude_segments; x += 1) {
-            float x_segment = (float) x / (float) longitude_segments;
-            float y_segment = (float) y / (float) latitude_segments;
-            
-            let position = vec3 {
-                std::cosf(x_segment * tau) * std::sinf(y_segment * pi),
-                std::sinf(x_segment * tau) * std::sinf(y_segment * pi),
-                std::cosf(y_segment * pi),
-            };
-
-            vertices[vertex++] = {
-                .position = glm::normalize(position),
-                .uv = { x_segment, y_segment }
-            };
-        }
-    }
-
-    for (uint y = 0; y < latitude_segments; y += 1) {
-        for (uint x = 0; x < longitude_segments; x += 1) {
-            indices[index++] = (y + 1) * (longitude_segments + 1) + x;
-            indices[index++] = y * (longitude_segments + 1) + x + 1;
-            indices[index++] = y * (longitude_segments + 1) + x;
-
-            indices[index++] = (y + 1) * (longitude_segments + 1) + x;
-            indices[index++] = (y + 1) * (longitude_segments + 1) + x + 1;
-            indices[index++] = y * (longitude_segments + 1) + x + 1;
-        }
-    }
+function destroy_mesh(t_mesh __in * mesh) -> void {
+    glDeleteVertexArrays(1, &mesh->vao);
+    glDeleteBuffers(1, &mesh->vbo);
+    glDeleteBuffers(1, &mesh->ebo);
+    std::free(mesh->storage);
     
-    return create_mesh({ vertices, vertex }, { indices, index });
+    *mesh = {};
 }
@@ -3,6 +3,9 @@
 
 #include "camera.hh"
 #include "common.hh"
+#include "compress.hh"
+#include "image.hh"
+#include "mips.hh"
 
 using t_texture = uint;
 using t_shader = uint;
@@ -12,34 +15,82 @@ struct t_vertex {
     vec2 uv;
 };
 
+// lower detail versions of a mesh, see simplify.hh
+struct t_mesh_lod {
+    uint32 first_index; // lod 0 is the whole mesh, the others follow it in the indices
+    uint32 index_count;
+    float error; // in the mesh's units, 0 for lod 0
+    uint32 reserved;
+};
+
 struct t_mesh {
     uint vao, vbo, ebo;
-    t_slice<t_vertex> vertices;
-    t_slice<uint32> indices;
+    t_slice<t_vertex> vertices; // the mesh's own copies, as reordered for drawing
+    t_slice<uint32> indices; // lod 0's when it has lods
+    void * storage;
+    
+    // empty without lods. the others' indices follow lod 0's in the gpu's copy, drawing
+    // picks the coarsest whose error stays under a pixel at the nearest point of radius
+    t_slice<t_mesh_lod> lods;
+    float radius; // around the mesh's origin, of all its vertices
+    
+    // how the gpu's copies are laid out, see quantize.hh
+    uint index_type; // GL_UNSIGNED_SHORT when every index fits, else GL_UNSIGNED_INT
+    bool32 quantized; // the vertices are t_packed_vertex instead of t_vertex
+    vec3 position_offset; // the shaders take positions to position_offset + position_scale * v_pos,
+    vec3 position_scale; // 0 and 1 for float vertices
 };
 
+struct t_virtual_texture;
+struct t_cluster_mesh;
+
 struct t_node {
     function render(t_camera __in * camera) -> void;
+    function render_feedback(t_camera __in * camera) -> void;
     
     t_mesh * mesh;
     t_texture texture;
     t_shader shader;
     vec3 position;
     glm::quat orientation;
+    t_virtual_texture * virtual_texture; // drawn with its own shader instead of texture and shader when set
+    t_cluster_mesh * clusters; // of mesh, culled and drawn cluster by cluster when set, see meshlets.hh
 };
 
 struct t_scene {
     function render(t_camera __in * camera) -> void;
+    function render_feedback(t_camera __in * camera) -> void; // only the virtually textured nodes
     
     t_slice<t_node> nodes;
 };
 
 function create_texture(char const * path) -> t_texture;
+function create_texture(t_image __in * image) -> t_texture;
+function create_texture(t_mip_chain __in * mips) -> t_texture;
+function create_texture(t_compressed_texture __in * texture) -> t_texture;
 function create_shader(char const * vertex, char const * fragment) -> t_shader;
-function create_basic_shader() -> t_shader;
-function create_mesh(t_slice<t_vertex> vertices, t_slice<uint32> indices) -> t_mesh;
-function create_box_mesh() -> t_mesh;
-function create_icosphere_mesh() -> t_mesh;
-function create_sphere_mesh(uint longitude_segments, uint latitude_segments) -> t_mesh;
+
+// create_shader in steps, so that many programs compile at once: begin submits the
+// compiles and the link without waiting on them, and with KHR_parallel_shader_compile
+// the driver works through them on its own threads while shader_ready is polled.
+// without it shader_ready is always true. finish checks the result, blocking if it must
+struct t_shader_build {
+    t_shader program;
+    uint vertex; // 0 when the program came from the shader cache
+    uint fragment;
+    u64 key;
+};
+
+function begin_shader(char const * vertex, char const * fragment) -> t_shader_build;
+function shader_ready(t_shader_build __in * build) -> bool32;
+function finish_shader(t_shader_build __in * build) -> t_shader;
+// copies the vertices and indices, reordering the triangles for the post transform
+// cache and then the vertices for fetching, see optimize.hh. without indices the
+// vertices are welded into an indexed mesh first. the gpu gets 16 bit indices
+// when they fit, and packed vertices when halving the uvs loses little, see quantize.hh.
+// reordered meshes, like mesh files, were done ahead of time and are left as they are.
+// with lods, from build_lod_chain, indices holds all of theirs and must be reordered
+function create_mesh(t_slice<t_vertex> vertices, t_slice<uint32> indices, bool32 reordered = false, t_slice<t_mesh_lod const> lods = {}) -> t_mesh;
+function destroy_mesh(t_mesh __in * mesh) -> void;
 
 #endif // __learngl_render__
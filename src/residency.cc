@@ -0,0 +1,370 @@
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "jobs.hh"
+#include "residency.hh"
+#include "stream.hh"
+
+namespace {
+    // handles carry this bit so they never collide with gl names handed out
+    // after a backing texture was deleted
+    constexpr t_texture handle_bit = 0x80000000;
+    
+    // textures are only dropped entirely once their top level is this small
+    constexpr int min_resident_size = 64;
+    
+    enum struct t_reload_stage : int {
+        decoding,
+        decoded,
+        failed,
+    };
+    
+    struct t_reload {
+        std::string path;
+        std::atomic<t_reload_stage> stage;
+        
+        t_image image;
+        t_mip_chain mips;
+        t_compressed_texture compressed;
+    };
+    
+    struct t_resident {
+        std::string path;
+        t_texture texture; // the current backing, 0 when nothing is resident
+        
+        int internal_format;
+        int width;
+        int height;
+        uint level_count; // of the full texture
+        uint dropped; // levels missing from the top of the chain
+        u64 level_bytes[t_mip_chain::max_levels];
+        
+        u64 last_used;
+        t_reload * reload;
+        bool32 streaming; // texture_stream is still uploading it, nothing is measured yet
+        bool32 removed; // the slot stays, so that the other handles keep their index
+    };
+    
+    std::vector<t_resident> residents;
+    u64 budget = 0;
+    u64 resident_bytes = 0;
+    u64 frame = 0;
+    
+    inline function resident_size(t_resident __in * resident) -> u64 {
+        if (!resident->texture) return 0;
+        
+        u64 size = 0;
+        
+        for (uint i = resident->dropped; i < resident->level_count; i += 1) {
+            size += resident->level_bytes[i];
+        }
+        
+        return size;
+    }
+    
+    inline function full_size(t_resident __in * resident) -> u64 {
+        u64 size = 0;
+        
+        for (uint i = 0; i < resident->level_count; i += 1) {
+            size += resident->level_bytes[i];
+        }
+        
+        return size;
+    }
+    
+    function decode(void * data) -> void {
+        let reload = static_cast<t_reload *>(data);
+        let path = reload->path.c_str();
+        
+        if (is_compressed_texture_file(path)) {
+            reload->compressed = load_compressed_texture(path);
+            
+            if (!reload->compressed.level_count) {
+                reload->stage = t_reload_stage::failed;
+                return;
+            }
+        } else {
+            reload->image = load_image(path);
+            
+            if (!reload->image.pixels) {
+                reload->stage = t_reload_stage::failed;
+                return;
+            }
+            
+            reload->mips = generate_mips(&reload->image);
+        }
+        
+        reload->stage = t_reload_stage::decoded;
+    }
+    
+    function free_reload(t_reload * reload) -> void {
+        if (reload->compressed.level_count) {
+            free_compressed_texture(&reload->compressed);
+        } else {
+            if (reload->mips.storage) free_mips(&reload->mips);
+            if (reload->image.pixels) free_image(&reload->image);
+        }
+        
+        delete reload;
+    }
+    
+    // a smaller texture holding every level but the top one, copied on the gpu
+    function drop_top_level(t_resident * resident) -> void {
+        let dropped = resident->dropped + 1;
+        let levels = resident->level_count - dropped;
+        let width = m_clamp(resident->width >> dropped, 1, resident->width);
+        let height = m_clamp(resident->height >> dropped, 1, resident->height);
+        
+        uint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, levels, resident->internal_format, width, height);
+        
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        
+        // the old backing starts at level resident->dropped of the full chain
+        for (uint i = 0; i < levels; i += 1) {
+            glCopyImageSubData(
+                resident->texture, GL_TEXTURE_2D, i + 1, 0, 0, 0,
+                texture, GL_TEXTURE_2D, i, 0, 0, 0,
+                m_clamp(width >> i, 1, width), m_clamp(height >> i, 1, height), 1
+            );
+        }
+        
+        glDeleteTextures(1, &resident->texture);
+        
+        resident_bytes -= resident->level_bytes[resident->dropped];
+        resident->texture = texture;
+        resident->dropped = dropped;
+    }
+    
+    function evict(t_resident * resident) -> void {
+        let width = resident->width >> resident->dropped;
+        let height = resident->height >> resident->dropped;
+        
+        if (width > min_resident_size || height > min_resident_size) {
+            drop_top_level(resident);
+        } else {
+            resident_bytes -= resident_size(resident);
+            glDeleteTextures(1, &resident->texture);
+            resident->texture = 0;
+        }
+    }
+    
+    // the least recently used texture that wasn't drawn last frame and still holds
+    // memory. those being reloaded are left alone, they are counted at full size, and
+    // so are those still streaming in
+    function eviction_candidate() -> t_resident * {
+        t_resident * candidate = null;
+        
+        for (auto & resident : residents) {
+            if (!resident.texture || resident.reload || resident.streaming || resident.last_used + 1 >= frame) continue;
+            
+            if (!candidate || resident.last_used < candidate->last_used) {
+                candidate = &resident;
+            }
+        }
+        
+        return candidate;
+    }
+    
+    function finish_reload(t_resident * resident) -> void {
+        let reload = resident->reload;
+        
+        if (resident->removed) {
+            resident->reload = null;
+            free_reload(reload);
+            return;
+        }
+        
+        let texture = reload->compressed.level_count
+            ? create_texture(&reload->compressed)
+            : create_texture(&reload->mips);
+        
+        // the full size was already counted when the reload started
+        if (resident->texture) glDeleteTextures(1, &resident->texture);
+        
+        resident->texture = texture;
+        resident->dropped = 0;
+        resident->reload = null;
+        
+        free_reload(reload);
+    }
+    
+    // the file went missing or broke since it was first loaded. whatever is resident
+    // stays, and it isn't tried again
+    function abandon_reload(t_resident * resident) -> void {
+        std::printf("%s: couldn't reload, keeping what is resident\n", resident->path.c_str());
+        
+        if (!resident->removed) resident_bytes -= full_size(resident) - resident_size(resident);
+        
+        free_reload(resident->reload);
+        resident->reload = null;
+        resident->path.clear();
+    }
+    
+    // the levels' sizes, once the texture has its storage
+    function measure(t_resident * resident) -> void {
+        glBindTexture(GL_TEXTURE_2D, resident->texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &resident->internal_format);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &resident->width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &resident->height);
+        
+        int compressed = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+        
+        // chains can stop short of 1x1, compressed files and cpu built mips set the max level
+        int immutable = 0;
+        int levels = 0;
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+        
+        if (immutable) {
+            glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+        } else {
+            glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &levels);
+            levels = levels < (int) t_mip_chain::max_levels ? levels + 1 : (int) t_mip_chain::max_levels;
+        }
+        
+        for (int width = resident->width, height = resident->height; (int) resident->level_count < levels; width = m_clamp(width / 2, 1, width), height = m_clamp(height / 2, 1, height)) {
+            m_assert(resident->level_count < t_mip_chain::max_levels);
+            
+            let level = resident->level_count;
+            
+            if (compressed) {
+                int size = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                resident->level_bytes[level] = size;
+            } else {
+                // drivers pad three channel texels to four
+                resident->level_bytes[level] = (u64) width * height * 4;
+            }
+            
+            resident->level_count += 1;
+            
+            if (width == 1 && height == 1) break;
+        }
+    }
+}
+
+function residency::init(u64 bytes) -> void {
+    budget = bytes;
+}
+
+function residency::add(t_texture texture, char const * path) -> t_texture {
+    t_resident resident = { .path = path, .texture = texture };
+    
+    // still streaming in, it's measured and counted once texture_stream is done with it
+    resident.streaming = texture_stream::resolve(texture) != texture;
+    if (!resident.streaming) measure(&resident);
+    
+    resident.last_used = frame;
+    resident_bytes += resident_size(&resident);
+    
+    residents.push_back(resident);
+    
+    return handle_bit | (t_texture) (residents.size() - 1);
+}
+
+function residency::use(t_texture handle) -> t_texture {
+    if (!(handle & handle_bit)) return handle;
+    
+    let resident = &residents[handle & ~handle_bit];
+    resident->last_used = frame;
+    
+    return resident->texture ? resident->texture : texture_stream::placeholder();
+}
+
+function residency::remove(t_texture handle) -> void {
+    if (!(handle & handle_bit)) {
+        glDeleteTextures(1, &handle);
+        return;
+    }
+    
+    let resident = &residents[handle & ~handle_bit];
+    m_assert(!resident->removed);
+    
+    // a reload in flight was counted at full size, it is dropped once decoded
+    resident_bytes -= resident->reload ? full_size(resident) : resident_size(resident);
+    
+    if (resident->streaming) {
+        texture_stream::cancel(resident->texture);
+    } else if (resident->texture) {
+        glDeleteTextures(1, &resident->texture);
+    }
+    
+    resident->texture = 0;
+    resident->path.clear();
+    resident->removed = true;
+}
+
+function residency::update() -> void {
+    frame += 1;
+    
+    for (auto & resident : residents) {
+        if (resident.streaming && !resident.removed && texture_stream::resolve(resident.texture) == resident.texture) {
+            measure(&resident);
+            resident.streaming = false;
+            resident_bytes += resident_size(&resident);
+        }
+        
+        if (resident.reload && resident.reload->stage.load() == t_reload_stage::decoded) {
+            finish_reload(&resident);
+        } else if (resident.reload && resident.reload->stage.load() == t_reload_stage::failed) {
+            abandon_reload(&resident);
+        }
+    }
+    
+    // textures drawn last frame that aren't complete come back if they fit,
+    // pushing out whatever hasn't been drawn for the longest
+    for (auto & resident : residents) {
+        let degraded = !resident.texture || resident.dropped > 0;
+        if (resident.removed || resident.path.empty() || !degraded || resident.reload || resident.last_used + 1 < frame) continue;
+        
+        let needed = full_size(&resident) - resident_size(&resident);
+        
+        while (resident_bytes + needed > budget) {
+            let candidate = eviction_candidate();
+            if (!candidate) break;
+            
+            evict(candidate);
+        }
+        
+        if (resident_bytes + needed > budget) continue;
+        
+        // counted right away, so that later reloads see the memory as taken
+        resident_bytes += needed;
+        
+        resident.reload = new t_reload { .path = resident.path, .stage = t_reload_stage::decoding };
+        jobs::submit({ .proc = decode, .data = resident.reload });
+    }
+    
+    while (resident_bytes > budget) {
+        let candidate = eviction_candidate();
+        if (!candidate) break;
+        
+        evict(candidate);
+    }
+}
+
+function residency::usage() -> u64 {
+    return resident_bytes;
+}
+
+function residency::terminate() -> void {
+    // the workers must be joined first, they may still hold a reload
+    for (auto & resident : residents) {
+        if (resident.reload) free_reload(resident.reload);
+        if (resident.texture) glDeleteTextures(1, &resident.texture);
+    }
+    
+    residents.clear();
+    resident_bytes = 0;
+}
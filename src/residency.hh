@@ -0,0 +1,23 @@
+#ifndef __learngl_residency__
+#define __learngl_residency__
+
+#include "common.hh"
+#include "render.hh"
+
+// keeps the memory used by textures under a budget. managed textures are
+// referred to by handles rather than gl names: when memory runs short, the
+// least recently drawn textures lose their largest mip levels, and in the end
+// all of their storage. once drawn again they are reloaded from their file
+// in the background and swapped back in at full resolution. textures from
+// texture_stream::request may be added straight away, they count once uploaded
+namespace residency {
+    function init(u64 budget) -> void; // bytes
+    function add(t_texture texture, char const * path) -> t_texture; // takes ownership, returns the handle
+    function use(t_texture handle) -> t_texture; // marks it drawn this frame, returns what to bind
+    function remove(t_texture handle) -> void; // deletes the texture, plain gl names included
+    function update() -> void; // once per frame, on the gl thread
+    function usage() -> u64;
+    function terminate() -> void;
+};
+
+#endif // __learngl_residency__
@@ -0,0 +1,194 @@
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "registry.hh"
+#include "shader_cache.hh"
+
+namespace {
+    // a header, then for every program its entry followed by size bytes of binary
+    u8 const file_magic[8] = { 0xAB, 'L', 'S', 'C', ' ', '1', 0xBB, '\n' };
+    
+    struct t_file_header {
+        u8 magic[8];
+        u64 driver;
+        uint32 entry_count;
+        uint32 reserved;
+    };
+    
+    struct t_file_entry {
+        u64 key;
+        uint32 format;
+        uint32 size;
+    };
+    
+    struct t_binary {
+        uint format;
+        std::vector<u8> data;
+    };
+    
+    std::string cache_path;
+    std::unordered_map<u64, t_binary> binaries;
+    u64 driver = 0;
+    bool32 enabled = false;
+    bool32 dirty = false;
+    shader_cache::t_stats counts = {};
+    
+    // binaries only load on the driver that wrote them
+    function driver_id() -> u64 {
+        GLenum const names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+        u64 id = 0;
+        
+        for (let name : names) {
+            let string = reinterpret_cast<char const *>(glGetString(name));
+            if (!string) string = "";
+            
+            id = registry::hash({ .ptr = reinterpret_cast<u8 const *>(string), .len = std::strlen(string) + 1 }, id);
+        }
+        
+        return id;
+    }
+    
+    function read(FILE * file) -> bool32 {
+        std::fseek(file, 0, SEEK_END);
+        let size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        
+        if (size < (long) sizeof(t_file_header)) return false;
+        
+        // what's left after the header and entries read so far
+        u64 remaining = (u64) size - sizeof(t_file_header);
+        
+        t_file_header header;
+        
+        if (std::fread(&header, sizeof(header), 1, file) != 1) return false;
+        if (std::memcmp(header.magic, file_magic, sizeof(file_magic)) != 0) return false;
+        if (header.driver != driver) return false;
+        
+        for (uint32 i = 0; i < header.entry_count; i += 1) {
+            t_file_entry entry;
+            if (std::fread(&entry, sizeof(entry), 1, file) != 1) return false;
+            
+            // a damaged size must not make us allocate more than the file could hold
+            if (entry.size > remaining - sizeof(entry)) return false;
+            remaining -= sizeof(entry) + entry.size;
+            
+            t_binary binary = { .format = entry.format, .data = std::vector<u8>(entry.size) };
+            if (std::fread(binary.data.data(), 1, entry.size, file) != entry.size) return false;
+            
+            binaries[entry.key] = std::move(binary);
+        }
+        
+        return true;
+    }
+    
+    function write(FILE * file) -> bool32 {
+        t_file_header header = { .driver = driver, .entry_count = (uint32) binaries.size() };
+        std::memcpy(header.magic, file_magic, sizeof(file_magic));
+        
+        bool32 ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        
+        for (let & [key, binary] : binaries) {
+            if (!ok) break;
+            
+            t_file_entry entry = { .key = key, .format = binary.format, .size = (uint32) binary.data.size() };
+            
+            ok = std::fwrite(&entry, sizeof(entry), 1, file) == 1
+                && std::fwrite(binary.data.data(), 1, binary.data.size(), file) == binary.data.size();
+        }
+        
+        return ok;
+    }
+}
+
+function shader_cache::open(char const * path) -> void {
+    int format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    
+    // some drivers can't hand binaries out at all
+    enabled = format_count > 0;
+    if (!enabled) return;
+    
+    cache_path = path;
+    driver = driver_id();
+    
+    let file = std::fopen(path, "rb");
+    if (!file) return;
+    
+    // a stale or damaged cache is dropped whole, it gets rewritten at close
+    if (!read(file)) {
+        binaries.clear();
+        dirty = true;
+    }
+    
+    std::fclose(file);
+}
+
+function shader_cache::load(u64 key) -> t_shader {
+    if (!enabled) return 0;
+    
+    let found = binaries.find(key);
+    if (found == binaries.end()) return 0;
+    
+    let program = glCreateProgram();
+    glProgramBinary(program, found->second.format, found->second.data.data(), (int) found->second.data.size());
+    
+    int ok = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    
+    if (!ok) {
+        glDeleteProgram(program);
+        binaries.erase(found);
+        dirty = true;
+        counts.rejected += 1;
+        
+        return 0;
+    }
+    
+    counts.hits += 1;
+    
+    return program;
+}
+
+function shader_cache::store(u64 key, t_shader program) -> void {
+    if (!enabled) return;
+    
+    counts.misses += 1;
+    
+    int size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0) return;
+    
+    t_binary binary = { .data = std::vector<u8>(size) };
+    glGetProgramBinary(program, size, null, &binary.format, binary.data.data());
+    
+    binaries[key] = std::move(binary);
+    dirty = true;
+}
+
+function shader_cache::stats() -> t_stats {
+    return counts;
+}
+
+function shader_cache::close() -> void {
+    if (enabled && dirty) {
+        let file = std::fopen(cache_path.c_str(), "wb");
+        
+        if (file) {
+            let ok = write(file);
+            std::fclose(file);
+            
+            // a half written cache would only be thrown away next time
+            if (!ok) std::remove(cache_path.c_str());
+        }
+    }
+    
+    binaries.clear();
+    enabled = false;
+    dirty = false;
+}
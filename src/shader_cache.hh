@@ -0,0 +1,24 @@
+#ifndef __learngl_shader_cache__
+#define __learngl_shader_cache__
+
+#include "common.hh"
+#include "render.hh"
+
+// linked program binaries kept on disk between runs, so that create_shader only compiles
+// what the driver hasn't seen before. a cache written by another vendor, renderer or
+// driver version is thrown away and rebuilt, and so is any binary the driver refuses
+namespace shader_cache {
+    struct t_stats {
+        uint hits; // programs loaded from their binary
+        uint misses; // programs compiled from source
+        uint rejected; // binaries the driver wouldn't take, compiled again
+    };
+    
+    function open(char const * path) -> void; // once the gl context exists
+    function load(u64 key) -> t_shader; // a linked program, 0 if there's no usable binary
+    function store(u64 key, t_shader program) -> void; // the program was linked retrievable
+    function stats() -> t_stats;
+    function close() -> void; // writes the file back if anything changed
+};
+
+#endif // __learngl_shader_cache__
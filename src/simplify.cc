@@ -0,0 +1,369 @@
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "jobs.hh"
+#include "optimize.hh"
+#include "simplify.hh"
+
+namespace {
+    // how much uvs count against positions, both measured across the mesh's extent: sliding
+    // over the whole texture costs as much as moving a quarter of the way across the mesh
+    constexpr float uv_weight = 0.25f;
+    
+    // x, y, z, u, v
+    constexpr int dimensions = 5;
+    
+    struct t_point {
+        float x[dimensions];
+    };
+    
+    // squared distances to triangles' planes in x y z u v, summed and weighted by the
+    // triangles' areas. a is the upper triangle of the symmetric matrix, row by row
+    struct t_quadric {
+        float a[dimensions * (dimensions + 1) / 2];
+        float b[dimensions];
+        float c;
+        float weight;
+    };
+    
+    struct t_collapse {
+        uint32 from;
+        uint32 to;
+        float cost; // squared, of the mesh scaled to a unit
+    };
+    
+    inline function add(t_quadric __in * into, t_quadric const & q) -> void {
+        for (int i = 0; i < (int) std::size(q.a); i += 1) into->a[i] += q.a[i];
+        for (int i = 0; i < dimensions; i += 1) into->b[i] += q.b[i];
+        
+        into->c += q.c;
+        into->weight += q.weight;
+    }
+    
+    inline function dot(t_point const & p, t_point const & q) -> float {
+        float sum = 0.f;
+        for (int i = 0; i < dimensions; i += 1) sum += p.x[i] * q.x[i];
+        
+        return sum;
+    }
+    
+    inline function difference(t_point const & p, t_point const & q) -> t_point {
+        t_point result;
+        for (int i = 0; i < dimensions; i += 1) result.x[i] = p.x[i] - q.x[i];
+        
+        return result;
+    }
+    
+    // the plane through the triangle is spanned by e1 and e2, orthonormal. the squared distance
+    // of p from it is p.p - (p.e1)^2 - (p.e2)^2 after moving p0 to the origin, which expands to
+    // p'Ap + 2b.p + c
+    function triangle_quadric(t_point const & p0, t_point const & p1, t_point const & p2) -> t_quadric {
+        t_quadric q = {};
+        
+        let e1 = difference(p1, p0);
+        let e2 = difference(p2, p0);
+        let length1 = std::sqrt(dot(e1, e1));
+        if (length1 <= 0.f) return q;
+        
+        for (int i = 0; i < dimensions; i += 1) e1.x[i] /= length1;
+        
+        let along = dot(e2, e1);
+        for (int i = 0; i < dimensions; i += 1) e2.x[i] -= along * e1.x[i];
+        
+        let length2 = std::sqrt(dot(e2, e2));
+        if (length2 <= 0.f) return q;
+        
+        for (int i = 0; i < dimensions; i += 1) e2.x[i] /= length2;
+        
+        let area = 0.5f * length1 * length2;
+        let p0e1 = dot(p0, e1);
+        let p0e2 = dot(p0, e2);
+        
+        for (int i = 0, k = 0; i < dimensions; i += 1) {
+            for (int j = i; j < dimensions; j += 1, k += 1) {
+                q.a[k] = area * ((i == j ? 1.f : 0.f) - e1.x[i] * e1.x[j] - e2.x[i] * e2.x[j]);
+            }
+            
+            q.b[i] = area * (p0e1 * e1.x[i] + p0e2 * e2.x[i] - p0.x[i]);
+        }
+        
+        q.c = area * (dot(p0, p0) - p0e1 * p0e1 - p0e2 * p0e2);
+        q.weight = area;
+        
+        return q;
+    }
+    
+    // the mean squared distance, the planes weighted by their area
+    function evaluate(t_quadric const & q, t_point const & p) -> float {
+        if (q.weight <= 0.f) return 0.f;
+        
+        double sum = q.c;
+        
+        for (int i = 0, k = 0; i < dimensions; i += 1) {
+            for (int j = i; j < dimensions; j += 1, k += 1) {
+                sum += (i == j ? 1.0 : 2.0) * q.a[k] * p.x[i] * p.x[j];
+            }
+            
+            sum += 2.0 * q.b[i] * p.x[i];
+        }
+        
+        return (float) std::fmax(sum / q.weight, 0.0);
+    }
+    
+    inline function position(t_point const & p) -> vec3 {
+        return { p.x[0], p.x[1], p.x[2] };
+    }
+    
+    // whether moving from onto to turns any of the triangles around from over, or near enough
+    // (by more than about 75 degrees) that a few more passes could. the ones that have both go away
+    function flips(t_slice<uint32> triangles, uint32 const * indices, t_point const * points, uint32 from, uint32 to) -> bool32 {
+        for (u64 i = 0; i < triangles.length(); i += 1) {
+            let corners = indices + triangles[i] * 3;
+            if (corners[0] == to || corners[1] == to || corners[2] == to) continue;
+            
+            vec3 before[3], after[3];
+            
+            for (int k = 0; k < 3; k += 1) {
+                before[k] = position(points[corners[k]]);
+                after[k] = corners[k] == from ? position(points[to]) : before[k];
+            }
+            
+            let normal = glm::cross(before[1] - before[0], before[2] - before[0]);
+            let moved = glm::cross(after[1] - after[0], after[2] - after[0]);
+            
+            if (glm::dot(normal, moved) <= 0.25f * glm::length(normal) * glm::length(moved)) return true;
+        }
+        
+        return false;
+    }
+    
+    struct t_chains {
+        t_slice<t_geometry const> meshes;
+        t_slice<float const> ratios;
+        t_lod_chain * chains;
+    };
+}
+
+function simplify(t_slice<t_vertex const> vertices, t_slice<uint32 const> indices, u64 target_index_count, float max_error, uint32 * destination) -> t_simplified {
+    let vertex_count = vertices.length();
+    u64 index_count = indices.length();
+    
+    std::memcpy(destination, indices.ptr, sizeof(uint32) * index_count);
+    if (index_count <= target_index_count || !vertex_count) return { .index_count = index_count, .error = 0.f };
+    
+    // scaled to a unit, so that the quadrics keep their precision as floats
+    vec3 low = vertices[0].position;
+    vec3 high = low;
+    
+    for (u64 i = 0; i < vertex_count; i += 1) {
+        low = glm::min(low, vertices[i].position);
+        high = glm::max(high, vertices[i].position);
+    }
+    
+    let extent = std::fmax(std::fmax(high.x - low.x, high.y - low.y), std::fmax(high.z - low.z, epsilon));
+    
+    std::vector<t_point> points(vertex_count);
+    
+    for (u64 i = 0; i < vertex_count; i += 1) {
+        let p = (vertices[i].position - low) / extent;
+        points[i] = { { p.x, p.y, p.z, vertices[i].uv.x * uv_weight, vertices[i].uv.y * uv_weight } };
+    }
+    
+    // an edge is open when no triangle has it the other way around, on a border or where
+    // the uvs are split along a seam, or shared by more than two triangles
+    std::vector<u64> edges(index_count);
+    
+    for (u64 i = 0; i < index_count; i += 3) {
+        for (int k = 0; k < 3; k += 1) {
+            edges[i + k] = (u64) destination[i + k] << 32 | destination[i + (k + 1) % 3];
+        }
+    }
+    
+    std::sort(edges.begin(), edges.end());
+    
+    std::vector<u8> locked(vertex_count, 0);
+    
+    for (u64 i = 0; i < index_count; i += 1) {
+        let from = (uint32) (edges[i] >> 32);
+        let to = (uint32) edges[i];
+        
+        let reverse = (u64) to << 32 | from;
+        let repeated = (i > 0 && edges[i - 1] == edges[i]) || (i + 1 < index_count && edges[i + 1] == edges[i]);
+        
+        if (repeated || !std::binary_search(edges.begin(), edges.end(), reverse)) {
+            locked[from] = 1;
+            locked[to] = 1;
+        }
+    }
+    
+    std::vector<u64>().swap(edges);
+    
+    std::vector<t_quadric> quadrics(vertex_count, t_quadric {});
+    
+    for (u64 i = 0; i < index_count; i += 3) {
+        let q = triangle_quadric(points[destination[i]], points[destination[i + 1]], points[destination[i + 2]]);
+        for (int k = 0; k < 3; k += 1) add(&quadrics[destination[i + k]], q);
+    }
+    
+    let limit = max_error == std::numeric_limits<float>::max() ? max_error : (max_error / extent) * (max_error / extent);
+    
+    std::vector<uint32> offsets(vertex_count + 1);
+    std::vector<uint32> adjacency;
+    std::vector<t_collapse> collapses;
+    std::vector<uint32> remap(vertex_count);
+    std::vector<u8> touched(vertex_count);
+    
+    float worst = 0.f;
+    
+    // in passes: every edge is costed, then the cheapest are collapsed as long as the ones
+    // before them in the pass didn't touch their neighbourhood
+    while (index_count > target_index_count) {
+        // the triangles around each vertex
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (u64 i = 0; i < index_count; i += 1) offsets[destination[i] + 1] += 1;
+        for (u64 i = 0; i < vertex_count; i += 1) offsets[i + 1] += offsets[i];
+        
+        adjacency.resize(index_count);
+        
+        for (u64 i = 0; i < index_count; i += 1) {
+            adjacency[offsets[destination[i]]] = (uint32) (i / 3);
+            offsets[destination[i]] += 1;
+        }
+        
+        for (u64 i = vertex_count; i > 0; i -= 1) offsets[i] = offsets[i - 1];
+        offsets[0] = 0;
+        
+        // each edge inside the mesh comes up once in each direction
+        collapses.clear();
+        
+        for (u64 i = 0; i < index_count; i += 1) {
+            let from = destination[i];
+            let to = destination[i - i % 3 + (i + 1) % 3];
+            
+            if (locked[from] || from == to) continue;
+            
+            t_quadric q = quadrics[from];
+            add(&q, quadrics[to]);
+            
+            collapses.push_back({ .from = from, .to = to, .cost = evaluate(q, points[to]) });
+        }
+        
+        if (collapses.empty()) break;
+        
+        std::sort(collapses.begin(), collapses.end(), [] (t_collapse const & a, t_collapse const & b) {
+            return a.cost != b.cost ? a.cost < b.cost : a.from != b.from ? a.from < b.from : a.to < b.to;
+        });
+        
+        std::fill(touched.begin(), touched.end(), 0);
+        for (u64 i = 0; i < vertex_count; i += 1) remap[i] = (uint32) i;
+        
+        u64 removed = 0;
+        u64 collapsed = 0;
+        
+        for (let & collapse : collapses) {
+            if (collapse.cost > limit || index_count - removed <= target_index_count) break;
+            if (touched[collapse.from] || touched[collapse.to]) continue;
+            
+            t_slice<uint32> around = { .ptr = adjacency.data() + offsets[collapse.from], .len = offsets[collapse.from + 1] - offsets[collapse.from] };
+            if (flips(around, destination, points.data(), collapse.from, collapse.to)) continue;
+            
+            // nothing else this pass may change what was just checked
+            for (u64 i = 0; i < around.length(); i += 1) {
+                let corners = destination + around[i] * 3;
+                let shared = corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to;
+                
+                if (shared) removed += 3;
+                for (int k = 0; k < 3; k += 1) touched[corners[k]] = 1;
+            }
+            
+            remap[collapse.from] = collapse.to;
+            add(&quadrics[collapse.to], quadrics[collapse.from]);
+            
+            worst = std::fmax(worst, collapse.cost);
+            collapsed += 1;
+        }
+        
+        if (!collapsed) break;
+        
+        // the collapsed triangles are the ones left with a corner twice
+        u64 kept = 0;
+        
+        for (u64 i = 0; i < index_count; i += 3) {
+            let a = remap[destination[i]];
+            let b = remap[destination[i + 1]];
+            let c = remap[destination[i + 2]];
+            
+            if (a == b || b == c || c == a) continue;
+            
+            destination[kept] = a;
+            destination[kept + 1] = b;
+            destination[kept + 2] = c;
+            kept += 3;
+        }
+        
+        index_count = kept;
+    }
+    
+    return { .index_count = index_count, .error = std::sqrt(worst) * extent };
+}
+
+function build_lod_chain(t_slice<t_vertex const> vertices, t_slice<uint32 const> indices, t_slice<float const> ratios) -> t_lod_chain {
+    let start = std::chrono::steady_clock::now();
+    
+    t_lod_chain chain;
+    chain.indices.assign(indices.ptr, indices.ptr + indices.length());
+    chain.lods.push_back({ .first_index = 0, .index_count = (uint32) indices.length(), .error = 0.f });
+    
+    std::vector<uint32> current = chain.indices;
+    std::vector<uint32> simplified(indices.length());
+    
+    float error = 0.f;
+    
+    for (u64 i = 0; i < ratios.length(); i += 1) {
+        let target = (u64) (indices.length() / 3 * ratios[i]) * 3;
+        let result = simplify(
+            { .ptr = vertices.ptr, .len = vertices.length() },
+            { .ptr = current.data(), .len = current.size() },
+            target,
+            std::numeric_limits<float>::max(),
+            simplified.data()
+        );
+        
+        // not worth keeping a lod that's hardly any simpler
+        if (!result.index_count || result.index_count * 20 > current.size() * 19) break;
+        
+        optimize_vertex_cache({ .ptr = simplified.data(), .len = result.index_count }, vertices.length());
+        
+        // each is simplified from the last, so their errors add up, at most
+        error += result.error;
+        
+        chain.lods.push_back({ .first_index = (uint32) chain.indices.size(), .index_count = (uint32) result.index_count, .error = error });
+        chain.indices.insert(chain.indices.end(), simplified.begin(), simplified.begin() + result.index_count);
+        
+        current.assign(simplified.begin(), simplified.begin() + result.index_count);
+    }
+    
+    chain.time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    
+    return chain;
+}
+
+function build_lod_chains(t_slice<t_geometry const> meshes, t_slice<float const> ratios, t_lod_chain * chains) -> void {
+    t_chains work = { .meshes = meshes, .ratios = ratios, .chains = chains };
+    
+    jobs::parallel_for(meshes.length(), [] (void * data, u64 index) {
+        let work = static_cast<t_chains *>(data);
+        let mesh = work->meshes[index];
+        
+        work->chains[index] = build_lod_chain(
+            { .ptr = mesh.vertices.ptr, .len = mesh.vertices.length() },
+            { .ptr = mesh.indices.ptr, .len = mesh.indices.length() },
+            work->ratios
+        );
+    }, &work);
+}
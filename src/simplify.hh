@@ -0,0 +1,37 @@
+#ifndef __learngl_simplify__
+#define __learngl_simplify__
+
+#include <vector>
+
+#include "common.hh"
+#include "geometry.hh"
+#include "render.hh"
+
+// lower detail versions of a mesh by edge collapses, cheapest first by the quadric error
+// metric over position and uv (garland and heckbert's). a vertex only ever collapses onto
+// one of its neighbours, so the result indexes the same vertices and a mesh's lods share
+// them. vertices on an open edge, a border or a uv seam, are never moved, which keeps
+// outlines and texture seams where they were
+struct t_simplified {
+    u64 index_count;
+    float error; // the largest distance moved, roughly, in the mesh's units
+};
+
+// destination gets at most as many indices as indices. stops at target_index_count, or
+// before a collapse would cost more than max_error, or when nothing more can collapse
+function simplify(t_slice<t_vertex const> vertices, t_slice<uint32 const> indices, u64 target_index_count, float max_error, uint32 * destination) -> t_simplified;
+
+// lod 0 and one lod for each ratio of its triangles, each simplified from the one before
+// and reordered for the vertex cache. the chain ends early once a mesh won't get simpler
+struct t_lod_chain {
+    std::vector<uint32> indices;
+    std::vector<t_mesh_lod> lods;
+    float time; // seconds
+};
+
+function build_lod_chain(t_slice<t_vertex const> vertices, t_slice<uint32 const> indices, t_slice<float const> ratios) -> t_lod_chain;
+
+// a chain for every mesh, the meshes spread over the job workers
+function build_lod_chains(t_slice<t_geometry const> meshes, t_slice<float const> ratios, t_lod_chain * chains) -> void;
+
+#endif // __learngl_simplify__
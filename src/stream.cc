@@ -0,0 +1,299 @@
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "jobs.hh"
+#include "stream.hh"
+
+namespace {
+    // previews are decoded at an eighth of the size, see load_image_scaled
+    constexpr int preview_scale_shift = 3;
+    
+    enum struct t_stage : int {
+        decoding,
+        decoded,
+        failed,
+        uploading,
+    };
+    
+    struct t_request {
+        t_texture texture;
+        std::string path;
+        std::atomic<t_stage> stage;
+        bool32 cancelled = false; // dropped once its decode is done, the worker still has it until then
+        
+        t_image image = {};
+        t_mip_chain mips = {};
+        
+        // shown instead of the placeholder while the full texture decodes and uploads
+        t_image preview = {};
+        std::atomic<bool32> preview_decoded = false;
+        t_texture preview_texture = 0;
+        
+        // seconds after the request, for the report once it's in
+        std::chrono::steady_clock::time_point requested_at;
+        float preview_time = 0.f;
+        
+        uint pbo = 0;
+        u64 uploaded_bytes = 0;
+        uint level = 0; // the level being uploaded, and how far along it is
+        int uploaded_rows = 0;
+    };
+    
+    std::vector<std::unique_ptr<t_request>> requests;
+    t_texture placeholder_texture = 0;
+    u64 upload_budget = 0;
+    
+    // a single mid-grey texel, so that pending nodes don't sample garbage
+    u8 const grey[3] = { 0x80, 0x80, 0x80 };
+    
+    function fill_grey(t_texture texture) -> void {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGB8, 1, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, grey);
+    }
+    
+    function decode(void * data) -> void {
+        let request = static_cast<t_request *>(data);
+        
+        request->preview = load_image_scaled(request->path.c_str(), preview_scale_shift, 3);
+        request->preview_decoded = true;
+        
+        // always three channels, the upload format is GL_RGB
+        request->image = load_image(request->path.c_str(), 3);
+        
+        if (!request->image.pixels) {
+            request->stage = t_stage::failed;
+            return;
+        }
+        
+        request->mips = generate_mips(&request->image);
+        request->stage = t_stage::decoded;
+    }
+    
+    function begin_upload(t_request * request) -> void {
+        let mips = &request->mips;
+        
+        glBindTexture(GL_TEXTURE_2D, request->texture);
+        glTexStorage2D(GL_TEXTURE_2D, mips->level_count, GL_RGB8, mips->levels[0].width, mips->levels[0].height);
+        
+        u64 size = 0;
+        
+        for (uint i = 0; i < mips->level_count; i += 1) {
+            size += (u64) mips->levels[i].width * mips->levels[i].height * 3;
+        }
+        
+        // the whole chain goes through one buffer, level after level
+        glGenBuffers(1, &request->pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, request->pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, null, GL_STREAM_DRAW);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        
+        request->uploaded_bytes = 0;
+        request->level = 0;
+        request->uploaded_rows = 0;
+        request->stage = t_stage::uploading;
+    }
+    
+    // returns the number of bytes uploaded this call
+    function upload_rows(t_request * request, u64 budget) -> u64 {
+        let level = &request->mips.levels[request->level];
+        let row_size = (u64) level->width * 3;
+        let remaining = level->height - request->uploaded_rows;
+        let rows = (int) m_clamp(budget / row_size, (u64) 1, (u64) remaining);
+        
+        let offset = request->uploaded_bytes;
+        let size = row_size * rows;
+        
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, request->pbo);
+        
+        // every range is written exactly once, no need to sync with the gpu
+        let mapped = glMapBufferRange(
+            GL_PIXEL_UNPACK_BUFFER,
+            offset,
+            size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+        );
+        m_assert(mapped);
+        
+        std::memcpy(mapped, level->pixels + row_size * request->uploaded_rows, size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        
+        glBindTexture(GL_TEXTURE_2D, request->texture);
+        glTexSubImage2D(GL_TEXTURE_2D, request->level, 0, request->uploaded_rows, level->width, rows, GL_RGB, GL_UNSIGNED_BYTE, (void *) offset);
+        
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        
+        request->uploaded_bytes += size;
+        request->uploaded_rows += rows;
+        
+        if (request->uploaded_rows == level->height) {
+            request->level += 1;
+            request->uploaded_rows = 0;
+        }
+        
+        return size;
+    }
+    
+    // everything but the texture itself
+    inline function since_request(t_request * request) -> float {
+        return std::chrono::duration<float>(std::chrono::steady_clock::now() - request->requested_at).count();
+    }
+    
+    function release(t_request * request) -> void {
+        if (request->pbo) glDeleteBuffers(1, &request->pbo);
+        if (request->preview_texture) glDeleteTextures(1, &request->preview_texture);
+        if (request->preview.pixels) free_image(&request->preview);
+        if (request->mips.storage) free_mips(&request->mips);
+        if (request->image.pixels) free_image(&request->image);
+        
+        request->pbo = 0;
+        request->preview_texture = 0;
+    }
+}
+
+function texture_stream::init(u64 budget) -> void {
+    upload_budget = budget;
+    
+    glGenTextures(1, &placeholder_texture);
+    fill_grey(placeholder_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+function texture_stream::request(char const * path) -> t_texture {
+    uint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    
+    let request = requests.emplace_back(std::make_unique<t_request>()).get();
+    request->texture = texture;
+    request->path = path;
+    request->stage = t_stage::decoding;
+    request->requested_at = std::chrono::steady_clock::now();
+    
+    jobs::submit({ .proc = decode, .data = request });
+    
+    return texture;
+}
+
+function texture_stream::update() -> void {
+    if (requests.empty()) return;
+    
+    for (u64 i = 0; i < requests.size();) {
+        let request = requests[i].get();
+        
+        if (request->cancelled && request->stage.load() != t_stage::decoding) {
+            release(request);
+            glDeleteTextures(1, &request->texture);
+            requests.erase(requests.begin() + i);
+        } else {
+            i += 1;
+        }
+    }
+    
+    // previews are small enough to go up whole, outside the budget
+    for (auto & request : requests) {
+        if (request->cancelled || request->preview_texture || !request->preview_decoded.load() || !request->preview.pixels) continue;
+        
+        request->preview_texture = create_texture(&request->preview);
+        request->preview_time = since_request(request.get());
+        free_image(&request->preview);
+    }
+    
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    
+    let budget = upload_budget;
+    
+    for (u64 i = 0; i < requests.size() && budget > 0;) {
+        let request = requests[i].get();
+        let stage = request->stage.load();
+        
+        if (stage == t_stage::decoding || request->cancelled) {
+            i += 1;
+            continue;
+        }
+        
+        // a missing or broken file. the texture stays the grey texel for good, so that
+        // whoever holds it can keep drawing with it
+        if (stage == t_stage::failed) {
+            std::printf("%s: couldn't decode, it stays a placeholder\n", request->path.c_str());
+            
+            fill_grey(request->texture);
+            release(request);
+            requests.erase(requests.begin() + i);
+            continue;
+        }
+        
+        if (stage == t_stage::decoded) {
+            begin_upload(request);
+        }
+        
+        let uploaded = upload_rows(request, budget);
+        budget = uploaded < budget ? budget - uploaded : 0;
+        
+        if (request->level == request->mips.level_count) {
+            std::printf(
+                "%s: 1/%d preview after %.1fms, in full after %.1fms\n",
+                request->path.c_str(),
+                1 << preview_scale_shift,
+                request->preview_time * 1000.f,
+                since_request(request) * 1000.f
+            );
+            
+            release(request);
+            requests.erase(requests.begin() + i);
+        } else {
+            i += 1;
+        }
+    }
+    
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+function texture_stream::resolve(t_texture texture) -> t_texture {
+    for (u64 i = 0; i < requests.size(); i += 1) {
+        if (requests[i]->texture == texture) {
+            return requests[i]->preview_texture ? requests[i]->preview_texture : placeholder_texture;
+        }
+    }
+    
+    return texture;
+}
+
+function texture_stream::cancel(t_texture texture) -> void {
+    for (u64 i = 0; i < requests.size(); i += 1) {
+        if (requests[i]->texture == texture) requests[i]->cancelled = true;
+    }
+}
+
+function texture_stream::placeholder() -> t_texture {
+    return placeholder_texture;
+}
+
+function texture_stream::pending() -> uint {
+    return static_cast<uint>(requests.size());
+}
+
+function texture_stream::terminate() -> void {
+    // the workers must be joined first, they may still hold a request
+    for (u64 i = 0; i < requests.size(); i += 1) {
+        release(requests[i].get());
+        if (requests[i]->cancelled) glDeleteTextures(1, &requests[i]->texture);
+    }
+    
+    requests.clear();
+    glDeleteTextures(1, &placeholder_texture);
+}
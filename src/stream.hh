@@ -0,0 +1,23 @@
+#ifndef __learngl_stream__
+#define __learngl_stream__
+
+#include "common.hh"
+#include "render.hh"
+
+// asynchronous texture loading: files are decoded and their mips built on the
+// job workers, then uploaded through a pixel buffer object a few rows at a time,
+// so that no single frame pays for a whole texture. until an upload completes,
+// the texture name resolves to an eighth size preview, or before that is ready
+// to a small placeholder
+namespace texture_stream {
+    function init(u64 upload_budget) -> void; // bytes per frame
+    function request(char const * path) -> t_texture;
+    function update() -> void; // once per frame, on the gl thread
+    function resolve(t_texture texture) -> t_texture;
+    function cancel(t_texture texture) -> void; // deletes the texture once nothing uses it
+    function placeholder() -> t_texture;
+    function pending() -> uint;
+    function terminate() -> void;
+};
+
+#endif // __learngl_stream__
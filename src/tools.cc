@@ -0,0 +1,611 @@
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glfw/glfw3.h>
+
+#include "atlas.hh"
+#include "compress.hh"
+#include "geometry.hh"
+#include "image.hh"
+#include "jobs.hh"
+#include "mesh_file.hh"
+#include "mips.hh"
+#include "optimize.hh"
+#include "pack.hh"
+#include "quantize.hh"
+#include "render.hh"
+#include "simplify.hh"
+#include "tools.hh"
+#include "virtual_texture.hh"
+
+namespace {
+    // learngl compress bc1|bc7 <input> <output>
+    function compress_tool(char const * format_name, char const * input, char const * output) -> int {
+        t_block_format format;
+        
+        if (std::strcmp(format_name, "bc1") == 0) {
+            format = t_block_format::bc1;
+        } else if (std::strcmp(format_name, "bc7") == 0) {
+            format = t_block_format::bc7;
+        } else {
+            std::printf("unknown block format '%s', expected bc1 or bc7\n", format_name);
+            return 1;
+        }
+        
+        let image = load_image(input);
+        
+        if (!image.pixels) {
+            std::printf("couldn't load '%s'\n", input);
+            return 1;
+        }
+        
+        jobs::init();
+        
+        let then = std::chrono::steady_clock::now();
+        let compressed = compress_image(&image, format);
+        let elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - then).count();
+        
+        let ok = save_compressed_texture(output, &compressed);
+        
+        u64 size = 0;
+        for (uint i = 0; i < compressed.level_count; i += 1) size += compressed.levels[i].size;
+        
+        std::printf(
+            "%s: %dx%d, %u levels, %llu bytes (%.1fx smaller than rgb8 with mips) in %.2fms\n",
+            output,
+            image.width,
+            image.height,
+            compressed.level_count,
+            (unsigned long long) size,
+            (float) image.width * image.height * 3 * 4 / 3 / size,
+            elapsed * 1000.f
+        );
+        
+        free_compressed_texture(&compressed);
+        free_image(&image);
+        jobs::terminate();
+        
+        return ok ? 0 : 1;
+    }
+    
+    // learngl bench-mips <input>
+    // cpu mip chains against glGenerateMipmap, best of a few runs, upload included
+    function bench_mips_tool(char const * input) -> int {
+        let image = load_image(input);
+        
+        if (!image.pixels) {
+            std::printf("couldn't load '%s'\n", input);
+            return 1;
+        }
+        
+        m_assert(glfwInit());
+        
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        
+        let window = glfwCreateWindow(64, 64, "learngl", null, null);
+        glfwMakeContextCurrent(window);
+        m_assert(gladLoadGLLoader((GLADloadproc) glfwGetProcAddress));
+        
+        jobs::init();
+        
+        let best_of = [] (int runs, auto && body) {
+            float best = std::numeric_limits<float>::max();
+            
+            for (int i = 0; i < runs; i += 1) {
+                let then = std::chrono::steady_clock::now();
+                
+                let texture = body();
+                glFinish();
+                
+                let elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - then).count();
+                best = elapsed < best ? elapsed : best;
+                
+                glDeleteTextures(1, &texture);
+            }
+            
+            return best * 1000.f;
+        };
+        
+        let gl = best_of(5, [&] {
+            uint texture;
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            return texture;
+        });
+        
+        let cpu = [&] (t_mip_filter filter) {
+            return best_of(5, [&] {
+                let mips = generate_mips(&image, filter);
+                let texture = create_texture(&mips);
+                free_mips(&mips);
+                return texture;
+            });
+        };
+        
+        let box = cpu(t_mip_filter::box);
+        let kaiser = cpu(t_mip_filter::kaiser);
+        
+        std::printf("%s, %dx%d on %s, %u workers\n", input, image.width, image.height, (char const *) glGetString(GL_RENDERER), jobs::worker_count());
+        std::printf("glGenerateMipmap %8.2fms\n", gl);
+        std::printf("cpu box          %8.2fms\n", box);
+        std::printf("cpu kaiser       %8.2fms\n", kaiser);
+        
+        jobs::terminate();
+        free_image(&image);
+        glfwTerminate();
+        
+        return 0;
+    }
+    
+    // learngl atlas <output> <padding> <inputs...>
+    function atlas_tool(char const * output, int padding, t_slice<char const *> inputs) -> int {
+        std::vector<t_image> images;
+        u64 image_area = 0;
+        
+        for (u64 i = 0; i < inputs.length(); i += 1) {
+            let image = load_image(inputs[i]);
+            
+            if (!image.pixels) {
+                std::printf("couldn't load '%s'\n", inputs[i]);
+                for (auto & loaded : images) free_image(&loaded);
+                return 1;
+            }
+            
+            image_area += (u64) image.width * image.height;
+            images.push_back(image);
+        }
+        
+        let atlas = pack_atlas({ .ptr = images.data(), .len = images.size() }, padding, 16384);
+        
+        for (auto & image : images) free_image(&image);
+        
+        if (!atlas.storage) {
+            std::printf("%llu images don't fit in a 16384x16384 atlas\n", (unsigned long long) inputs.length());
+            return 1;
+        }
+        
+        let ok = save_atlas(output, &atlas);
+        
+        std::printf(
+            "%s: %llu images in %dx%d, %u mip levels, %.0f%% of the texels used by images\n",
+            output,
+            (unsigned long long) atlas.regions.length(),
+            atlas.image.width,
+            atlas.image.height,
+            atlas.level_count,
+            100.f * image_area / ((float) atlas.image.width * atlas.image.height)
+        );
+        
+        free_atlas(&atlas);
+        
+        return ok ? 0 : 1;
+    }
+    
+    struct t_named_generator {
+        char const * name;
+        t_geometry (* generate)();
+    };
+    
+    // what the mesh tools run on
+    t_named_generator const generators[] = {
+        { "box", [] { return generate_box(); } },
+        { "sphere 16x16", [] { return generate_sphere(16, 16); } },
+        { "sphere 24x24", [] { return generate_sphere(24, 24); } },
+        { "sphere 1024x512", [] { return generate_sphere(1024, 512); } },
+        { "icosphere 3", [] { return generate_icosphere(3); } },
+        { "icosphere 8", [] { return generate_icosphere(8); } },
+        { "cylinder 32", [] { return generate_cylinder(32); } },
+        { "torus 48x24", [] { return generate_torus(48, 24, 0.25f); } },
+        { "plane 1024x512", [] { return generate_plane(1024, 512); } },
+    };
+    
+    // learngl mesh-stats
+    // post transform cache efficiency of the generated meshes before and after create_mesh's
+    // welding and reordering, and the bytes the gpu gets for them as floats and 32 bit indices or packed.
+    // the generators are timed too, up to meshes of a million triangles
+    function mesh_stats_tool() -> int {
+        std::printf("%-16s %9s %9s %9s %15s %15s %9s %21s\n", "mesh", "triangles", "vertices", "generate", "acmr (16)", "atvr (16)", "optimize", "bytes");
+        
+        for (let & mesh : generators) {
+            let generated = std::chrono::steady_clock::now();
+            let geometry = mesh.generate();
+            let generate_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - generated).count();
+            
+            std::vector<t_vertex> vertices(geometry.vertices.ptr, geometry.vertices.ptr + geometry.vertices.length());
+            std::vector<uint32> indices(geometry.indices.ptr, geometry.indices.ptr + geometry.indices.length());
+            free_geometry(&geometry);
+            
+            // indexed the way create_mesh does it
+            if (indices.empty()) {
+                indices.resize(vertices.size());
+                
+                let welded = weld_vertices({ .ptr = vertices.data(), .len = vertices.size() }, { .ptr = indices.data(), .len = indices.size() });
+                std::printf("%-16s welded %llu vertices into %llu\n", mesh.name, (unsigned long long) vertices.size(), (unsigned long long) welded);
+                
+                vertices.resize(welded);
+            }
+            
+            t_slice<uint32> index_slice = { .ptr = indices.data(), .len = indices.size() };
+            
+            let before = analyze_vertex_cache(index_slice, vertices.size(), 16);
+            
+            let then = std::chrono::steady_clock::now();
+            optimize_vertex_cache(index_slice, vertices.size());
+            let vertex_count = optimize_vertex_fetch({ .ptr = vertices.data(), .len = vertices.size() }, index_slice);
+            let elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - then).count();
+            
+            let after = analyze_vertex_cache(index_slice, vertex_count, 16);
+            
+            // as create_mesh decides it
+            std::vector<t_packed_vertex> packed(vertex_count);
+            let quantization = quantize_vertices({ .ptr = vertices.data(), .len = vertex_count }, packed.data());
+            
+            let packed_vertices = quantization.uv_error <= max_uv_error && quantization.position_error <= max_position_error;
+            let vertex_size = packed_vertices ? sizeof(t_packed_vertex) : sizeof(t_vertex);
+            let index_size = vertex_count <= 0x10000 ? sizeof(u16) : sizeof(uint32);
+            
+            let unpacked_bytes = sizeof(t_vertex) * vertex_count + sizeof(uint32) * indices.size();
+            let packed_bytes = vertex_size * vertex_count + index_size * indices.size();
+            
+            std::printf(
+                "%-16s %9llu %9llu %7.2fms %6.3f -> %.3f %6.3f -> %.3f %7.2fms %9llu -> %llu\n",
+                mesh.name,
+                (unsigned long long) indices.size() / 3,
+                (unsigned long long) vertex_count,
+                generate_time * 1000.f,
+                before.acmr,
+                after.acmr,
+                before.atvr,
+                after.atvr,
+                elapsed * 1000.f,
+                (unsigned long long) unpacked_bytes,
+                (unsigned long long) packed_bytes
+            );
+        }
+        
+        return 0;
+    }
+    
+    // learngl mesh-lods
+    // lod chains for the generated meshes at a half, a quarter, an eighth and a sixteenth of
+    // their triangles, the meshes simplified side by side on the job workers
+    function mesh_lods_tool() -> int {
+        constexpr u64 count = sizeof(generators) / sizeof(t_named_generator);
+        float const ratios[] = { 0.5f, 0.25f, 0.125f, 0.0625f };
+        
+        jobs::init();
+        
+        std::vector<t_vertex> vertices[count];
+        std::vector<uint32> indices[count];
+        t_geometry meshes[count] = {};
+        
+        // welded and reordered first, as create_mesh would
+        for (u64 i = 0; i < count; i += 1) {
+            let geometry = generators[i].generate();
+            vertices[i].assign(geometry.vertices.ptr, geometry.vertices.ptr + geometry.vertices.length());
+            indices[i].assign(geometry.indices.ptr, geometry.indices.ptr + geometry.indices.length());
+            free_geometry(&geometry);
+            
+            if (indices[i].empty()) {
+                indices[i].resize(vertices[i].size());
+                vertices[i].resize(weld_vertices({ .ptr = vertices[i].data(), .len = vertices[i].size() }, { .ptr = indices[i].data(), .len = indices[i].size() }));
+            }
+            
+            meshes[i].vertices = { .ptr = vertices[i].data(), .len = vertices[i].size() };
+            meshes[i].indices = { .ptr = indices[i].data(), .len = indices[i].size() };
+            
+            optimize_vertex_cache(meshes[i].indices, meshes[i].vertices.length());
+            meshes[i].vertices.len = optimize_vertex_fetch(meshes[i].vertices, meshes[i].indices);
+        }
+        
+        t_lod_chain chains[count];
+        
+        let then = std::chrono::steady_clock::now();
+        build_lod_chains({ .ptr = meshes, .len = count }, { .ptr = ratios, .len = sizeof(ratios) / sizeof(float) }, chains);
+        let elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - then).count();
+        
+        std::printf("%-16s %4s %9s %9s %12s %9s\n", "mesh", "lod", "triangles", "ratio", "error", "time");
+        
+        float total = 0.f;
+        
+        for (u64 i = 0; i < count; i += 1) {
+            let lods = &chains[i].lods;
+            let triangles = (*lods)[0].index_count / 3;
+            
+            for (u64 k = 0; k < lods->size(); k += 1) {
+                std::printf(
+                    "%-16s %4llu %9u %8.1f%% %12.6f",
+                    k ? "" : generators[i].name,
+                    (unsigned long long) k,
+                    (*lods)[k].index_count / 3,
+                    100.f * (*lods)[k].index_count / 3 / triangles,
+                    (*lods)[k].error
+                );
+                
+                if (k) {
+                    std::printf("\n");
+                } else {
+                    std::printf(" %7.2fms\n", chains[i].time * 1000.f);
+                }
+            }
+            
+            total += chains[i].time;
+        }
+        
+        std::printf("%.2fms on %u workers, %.2fms one after the other\n", elapsed * 1000.f, jobs::worker_count(), total * 1000.f);
+        
+        jobs::terminate();
+        
+        return 0;
+    }
+    
+    // learngl bench-simd [inputs...]
+    // single threaded decode time at each simd level the cpu has, the resource jpegs by default
+    function bench_simd_tool(t_slice<char const *> inputs) -> int {
+        char const * const level_names[] = { "scalar", "sse2", "avx2", "avx-512" };
+        
+        std::vector<std::string> paths;
+        
+        for (u64 i = 0; i < inputs.length(); i += 1) {
+            paths.push_back(inputs[i]);
+        }
+        
+        if (paths.empty()) {
+            std::error_code error;
+            
+            for (auto & entry : std::filesystem::directory_iterator("..\\resources", error)) {
+                if (entry.path().extension() == ".jpg") paths.push_back(entry.path().string());
+            }
+        }
+        
+        let levels = decoding_simd_level() + 1;
+        
+        std::printf("%-32s", "");
+        for (int level = 0; level < levels; level += 1) std::printf("%10s", level_names[level]);
+        std::printf("\n");
+        
+        for (auto & path : paths) {
+            let file = std::fopen(path.c_str(), "rb");
+            
+            if (!file) {
+                std::printf("couldn't open '%s'\n", path.c_str());
+                continue;
+            }
+            
+            std::vector<u8> bytes;
+            std::fseek(file, 0, SEEK_END);
+            bytes.resize(std::ftell(file));
+            std::fseek(file, 0, SEEK_SET);
+            bytes.resize(std::fread(bytes.data(), 1, bytes.size(), file));
+            std::fclose(file);
+            
+            t_slice<u8 const> data = { .ptr = bytes.data(), .len = bytes.size() };
+            
+            t_image reference = {};
+            float scalar_ms = 0.f;
+            float best_ms = 0.f;
+            bool32 same = true;
+            
+            std::printf("%-32s", std::filesystem::path(path).filename().string().c_str());
+            
+            for (int level = 0; level < levels; level += 1) {
+                set_decoding_simd_limit(level);
+                
+                t_image image = {};
+                float best = std::numeric_limits<float>::max();
+                
+                for (int run = 0; run < 5; run += 1) {
+                    if (image.pixels) free_image(&image);
+                    
+                    let then = std::chrono::steady_clock::now();
+                    image = load_image(data);
+                    let elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - then).count();
+                    
+                    best = elapsed < best ? elapsed : best;
+                }
+                
+                if (!image.pixels) break;
+                
+                best *= 1000.f;
+                std::printf("%8.2fms", best);
+                
+                // every level is meant to give exactly the scalar pixels
+                if (level == 0) {
+                    reference = image;
+                    scalar_ms = best;
+                } else {
+                    same = same && std::memcmp(reference.pixels, image.pixels, (u64) image.width * image.height * image.channels) == 0;
+                    free_image(&image);
+                }
+                
+                best_ms = best;
+            }
+            
+            if (!reference.pixels) {
+                std::printf(" couldn't decode\n");
+                continue;
+            }
+            
+            std::printf("  %.2fx%s\n", scalar_ms / best_ms, same ? "" : ", OUTPUT DIFFERS");
+            free_image(&reference);
+        }
+        
+        set_decoding_simd_limit(3);
+        
+        return 0;
+    }
+    
+    // learngl bench-jpeg <inputs...>
+    // decode throughput on one thread against the job workers, best of a few runs
+    function bench_jpeg_tool(t_slice<char const *> inputs) -> int {
+        jobs::init();
+        
+        std::printf("%u workers\n", jobs::worker_count());
+        
+        for (u64 i = 0; i < inputs.length(); i += 1) {
+            let file = std::fopen(inputs[i], "rb");
+            
+            if (!file) {
+                std::printf("couldn't open '%s'\n", inputs[i]);
+                continue;
+            }
+            
+            std::vector<u8> bytes;
+            std::fseek(file, 0, SEEK_END);
+            bytes.resize(std::ftell(file));
+            std::fseek(file, 0, SEEK_SET);
+            bytes.resize(std::fread(bytes.data(), 1, bytes.size(), file));
+            std::fclose(file);
+            
+            t_slice<u8 const> data = { .ptr = bytes.data(), .len = bytes.size() };
+            
+            // a scale shift above zero times the reduced decode used for previews
+            let best_of = [&] (int runs, t_image * result, int scale_shift) {
+                float best = std::numeric_limits<float>::max();
+                
+                for (int run = 0; run < runs; run += 1) {
+                    if (result->pixels) free_image(result);
+                    
+                    let then = std::chrono::steady_clock::now();
+                    *result = scale_shift ? load_image_scaled(data, scale_shift) : load_image(data);
+                    let elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - then).count();
+                    
+                    best = elapsed < best ? elapsed : best;
+                }
+                
+                return best * 1000.f;
+            };
+            
+            let allocations = decode_allocations();
+            
+            t_image serial = {};
+            t_image parallel = {};
+            
+            set_parallel_decoding(false);
+            let serial_ms = best_of(5, &serial, 0);
+            
+            set_parallel_decoding(true);
+            let parallel_ms = best_of(5, &parallel, 0);
+            
+            if (!serial.pixels || !parallel.pixels) {
+                std::printf("couldn't decode '%s'\n", inputs[i]);
+                
+                if (serial.pixels) free_image(&serial);
+                if (parallel.pixels) free_image(&parallel);
+                continue;
+            }
+            
+            let megapixels = (float) serial.width * serial.height / 1e6f;
+            let same = std::memcmp(serial.pixels, parallel.pixels, (u64) serial.width * serial.height * serial.channels) == 0;
+            
+            std::printf(
+                "%s, %dx%d: serial %7.2fms (%6.1f MP/s), parallel %7.2fms (%6.1f MP/s), %.2fx%s\n",
+                inputs[i],
+                serial.width,
+                serial.height,
+                serial_ms,
+                megapixels / serial_ms * 1000.f,
+                parallel_ms,
+                megapixels / parallel_ms * 1000.f,
+                serial_ms / parallel_ms,
+                same ? "" : ", OUTPUT DIFFERS"
+            );
+            
+            for (int shift = 1; shift <= 3; shift += 1) {
+                t_image scaled = {};
+                let scaled_ms = best_of(5, &scaled, shift);
+                
+                std::printf("    1/%d: %dx%d in %7.2fms\n", 1 << shift, scaled.width, scaled.height, scaled_ms);
+                
+                free_image(&scaled);
+            }
+            
+            // after the first decode warms up the pool, the rest shouldn't need the heap
+            let heap = decode_allocations().heap - allocations.heap;
+            std::printf("    %llu heap allocations over 25 decodes\n", (unsigned long long) heap);
+            
+            free_image(&serial);
+            free_image(&parallel);
+        }
+        
+        set_parallel_decoding(false);
+        jobs::terminate();
+        
+        return 0;
+    }
+}
+
+function run_tool(int argc, char ** argv, int __out * status) -> bool32 {
+    if (argc == 5 && std::strcmp(argv[1], "compress") == 0) {
+        *status = compress_tool(argv[2], argv[3], argv[4]);
+        return true;
+    }
+    
+    if (argc >= 4 && std::strcmp(argv[1], "pack") == 0) {
+        let ok = pack::build(argv[2], { .ptr = (char const **) argv + 3, .len = (u64) argc - 3 });
+        std::printf(ok ? "packed %d files into %s\n" : "failed to pack %d files into %s\n", argc - 3, argv[2]);
+        *status = ok ? 0 : 1;
+        return true;
+    }
+    
+    if (argc == 3 && std::strcmp(argv[1], "bench-mips") == 0) {
+        *status = bench_mips_tool(argv[2]);
+        return true;
+    }
+    
+    if (argc >= 3 && std::strcmp(argv[1], "bench-jpeg") == 0) {
+        *status = bench_jpeg_tool({ .ptr = (char const **) argv + 2, .len = (u64) argc - 2 });
+        return true;
+    }
+    
+    if (argc >= 2 && std::strcmp(argv[1], "bench-simd") == 0) {
+        *status = bench_simd_tool({ .ptr = (char const **) argv + 2, .len = (u64) argc - 2 });
+        return true;
+    }
+    
+    if (argc >= 5 && std::strcmp(argv[1], "atlas") == 0) {
+        *status = atlas_tool(argv[2], std::atoi(argv[3]), { .ptr = (char const **) argv + 4, .len = (u64) argc - 4 });
+        return true;
+    }
+    
+    if (argc == 2 && std::strcmp(argv[1], "mesh-stats") == 0) {
+        *status = mesh_stats_tool();
+        return true;
+    }
+    
+    if (argc == 2 && std::strcmp(argv[1], "mesh-lods") == 0) {
+        *status = mesh_lods_tool();
+        return true;
+    }
+    
+    if (argc == 4 && std::strcmp(argv[1], "mesh-convert") == 0) {
+        let ok = convert_obj(argv[2], argv[3]);
+        std::printf(ok ? "converted %s\n" : "failed to convert %s\n", argv[2]);
+        *status = ok ? 0 : 1;
+        return true;
+    }
+    
+    if (argc == 4 && std::strcmp(argv[1], "vt-build") == 0) {
+        let ok = build_virtual_texture(argv[2], argv[3]);
+        std::printf(ok ? "built %s\n" : "failed to build %s\n", argv[3]);
+        *status = ok ? 0 : 1;
+        return true;
+    }
+    
+    return false;
+}
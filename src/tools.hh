@@ -0,0 +1,10 @@
+#ifndef __learngl_tools__
+#define __learngl_tools__
+
+#include "common.hh"
+
+// the command line tools, 'learngl <tool> <args...>', see the readme. false when argv
+// names none of them and the app should start instead
+function run_tool(int argc, char ** argv, int __out * status) -> bool32;
+
+#endif // __learngl_tools__
@@ -0,0 +1,640 @@
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <glad/glad.h>
+
+#include "jobs.hh"
+#include "mips.hh"
+#include "virtual_texture.hh"
+
+namespace {
+    // a header, then every page of every level, finest level first, pages in row
+    // major order. a page is page_size squared rgb texels, border included
+    u8 const file_magic[8] = { 0xAB, 'L', 'V', 'T', ' ', '1', 0xBB, '\n' };
+    
+    struct t_file_header {
+        u8 magic[8];
+        uint32 width;
+        uint32 height;
+        uint32 level_count;
+        uint32 page_size;
+        uint32 page_border;
+        uint32 reserved;
+    };
+    
+    using t_vt = t_virtual_texture;
+    
+    constexpr u64 page_bytes = (u64) t_vt::page_size * t_vt::page_size * 3;
+    constexpr int cache_size = t_vt::page_size * t_vt::cache_pages;
+    constexpr u64 free_slot = ~0ull;
+    
+    inline function page_key(int level, int x, int y) -> u64 {
+        return (u64) level << 48 | (u64) y << 24 | (u64) x;
+    }
+    
+    inline function key_level(u64 key) -> int { return (int) (key >> 48); }
+    inline function key_y(u64 key) -> int { return (int) (key >> 24 & 0xFFFFFF); }
+    inline function key_x(u64 key) -> int { return (int) (key & 0xFFFFFF); }
+    
+    inline function next_power_of_two(int value) -> int {
+        int result = 1;
+        while (result < value) result *= 2;
+        return result;
+    }
+    
+    inline function seek(FILE * file, u64 offset) -> bool32 {
+        #if defined(_WIN32)
+        return _fseeki64(file, (long long) offset, SEEK_SET) == 0;
+        #else
+        return fseeko(file, (off_t) offset, SEEK_SET) == 0;
+        #endif
+    }
+    
+    inline function file_size(FILE * file, u64 __out * size) -> bool32 {
+        #if defined(_WIN32)
+        let ok = _fseeki64(file, 0, SEEK_END) == 0;
+        let end = ok ? _ftelli64(file) : -1;
+        #else
+        let ok = fseeko(file, 0, SEEK_END) == 0;
+        let end = ok ? (long long) ftello(file) : -1;
+        #endif
+        
+        *size = (u64) end;
+        return end >= 0;
+    }
+    
+    // the level and page under a fragment, shared by the real and the feedback shader.
+    // the constants mirror t_virtual_texture
+    char const * vt_common = R"(
+        const float page_size = 128.0;
+        const float page_border = 4.0;
+        const float page_payload = 120.0;
+        const float cache_size = 2048.0;
+        
+        uniform usampler2D page_table;
+        uniform vec2 vt_size;
+        uniform int vt_levels;
+        uniform float lod_bias;
+        
+        int vt_level(vec2 uv) {
+            vec2 dx = dFdx(uv * vt_size);
+            vec2 dy = dFdy(uv * vt_size);
+            float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + lod_bias;
+            
+            return int(clamp(floor(lod), 0.0, float(vt_levels - 1)));
+        }
+        
+        vec2 vt_level_size(int level) {
+            return max(floor(vt_size / exp2(float(level))), vec2(1.0));
+        }
+        
+        ivec2 vt_page(vec2 uv, int level) {
+            vec2 pages = ceil(vt_level_size(level) / page_payload);
+            return ivec2(min(floor(uv * vt_level_size(level) / page_payload), pages - 1.0));
+        }
+    )";
+    
+    char const * vt_vertex = R"(
+        #version 450 core
+        
+        layout (location = 0) in vec3 v_pos;
+        layout (location = 1) in vec2 v_tex;
+        
+        out vec2 f_tex;
+        
+        uniform mat4 mvp;
+        uniform vec3 position_offset; // see quantize.hh
+        uniform vec3 position_scale;
+        
+        void main() {
+            gl_Position = mvp * vec4(position_offset + position_scale * v_pos, 1.0);
+            f_tex = v_tex;
+        }
+    )";
+    
+    char const * vt_fragment = R"(
+        in vec2 f_tex;
+        
+        out vec4 color;
+        
+        uniform sampler2D f_texture; // the page cache
+        
+        void main() {
+            vec2 uv = fract(f_tex);
+            int level = vt_level(f_tex);
+            
+            // the entry names the slot of this page, or of the closest resident ancestor
+            uvec4 entry = texelFetch(page_table, vt_page(uv, level), level);
+            
+            vec2 texel = uv * vt_level_size(int(entry.z));
+            vec2 in_page = texel - floor(texel / page_payload) * page_payload;
+            vec2 cache_uv = (vec2(entry.xy) * page_size + page_border + in_page) / cache_size;
+            
+            color = textureLod(f_texture, cache_uv, 0.0);
+        }
+    )";
+    
+    char const * vt_feedback_fragment = R"(
+        in vec2 f_tex;
+        
+        out uvec4 feedback;
+        
+        void main() {
+            int level = vt_level(f_tex);
+            feedback = uvec4(vt_page(fract(f_tex), level), level, 1);
+        }
+    )";
+    
+    function begin_vt_shader(char const * fragment) -> t_shader_build {
+        std::string source = "#version 450 core\n";
+        source += vt_common;
+        source += fragment;
+        
+        return begin_shader(vt_vertex, source.c_str());
+    }
+}
+
+struct t_virtual_texture::t_page_load {
+    t_virtual_texture * texture;
+    u64 key;
+    std::atomic<bool32> done;
+    bool32 ok;
+    u8 pixels[page_bytes];
+};
+
+namespace {
+    function read_page(void * data) -> void {
+        let load = static_cast<t_vt::t_page_load *>(data);
+        let vt = load->texture;
+        let level = key_level(load->key);
+        let index = (u64) key_y(load->key) * vt->pages_x[level] + key_x(load->key);
+        
+        {
+            std::lock_guard<std::mutex> lock(vt->file_mutex);
+            load->ok = seek(vt->file, vt->level_offsets[level] + index * page_bytes);
+            load->ok = load->ok && std::fread(load->pixels, page_bytes, 1, vt->file) == 1;
+        }
+        
+        load->done = true;
+    }
+    
+    // a free slot, or the one used longest ago that feedback hasn't asked for since
+    function take_slot(t_vt * vt) -> int {
+        int candidate = -1;
+        
+        for (int i = 0; i < t_vt::cache_pages * t_vt::cache_pages; i += 1) {
+            let slot = &vt->slots[i];
+            
+            if (slot->page == free_slot) return i;
+            if (slot->locked || slot->last_used + 2 >= vt->frame) continue;
+            
+            if (candidate < 0 || slot->last_used < vt->slots[candidate].last_used) {
+                candidate = i;
+            }
+        }
+        
+        if (candidate >= 0) {
+            vt->resident.erase(vt->slots[candidate].page);
+            vt->slots[candidate].page = free_slot;
+            vt->tables_dirty = true;
+        }
+        
+        return candidate;
+    }
+    
+    function place_page(t_vt * vt, int slot, u64 key, u8 const * pixels) -> void {
+        glBindTexture(GL_TEXTURE_2D, vt->cache);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(
+            GL_TEXTURE_2D, 0,
+            slot % t_vt::cache_pages * t_vt::page_size, slot / t_vt::cache_pages * t_vt::page_size,
+            t_vt::page_size, t_vt::page_size,
+            GL_RGB, GL_UNSIGNED_BYTE, pixels
+        );
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        
+        vt->slots[slot] = { .page = key, .last_used = vt->frame, .locked = false };
+        vt->resident[key] = slot;
+        vt->tables_dirty = true;
+    }
+    
+    // every page points at itself if resident, else at whatever its parent points at.
+    // the coarsest level is always resident, so every chain ends somewhere
+    function rebuild_tables(t_vt * vt) -> void {
+        glBindTexture(GL_TEXTURE_2D, vt->page_table);
+        
+        for (int level = vt->level_count - 1; level >= 0; level -= 1) {
+            let table = vt->tables[level].data();
+            let parent = level + 1 < vt->level_count ? vt->tables[level + 1].data() : null;
+            let pages_x = vt->pages_x[level];
+            let pages_y = vt->pages_y[level];
+            
+            for (int y = 0; y < pages_y; y += 1) {
+                for (int x = 0; x < pages_x; x += 1) {
+                    let entry = table + ((u64) y * pages_x + x) * 4;
+                    let found = vt->resident.find(page_key(level, x, y));
+                    
+                    if (found != vt->resident.end()) {
+                        entry[0] = (u16) (found->second % t_vt::cache_pages);
+                        entry[1] = (u16) (found->second / t_vt::cache_pages);
+                        entry[2] = (u16) level;
+                        entry[3] = 0;
+                    } else {
+                        m_assert(parent);
+                        std::memcpy(entry, parent + ((u64) (y / 2) * vt->pages_x[level + 1] + x / 2) * 4, sizeof(u16) * 4);
+                    }
+                }
+            }
+            
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, pages_x, pages_y, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, table);
+        }
+        
+        vt->tables_dirty = false;
+    }
+    
+    // feedback from two frames ago, so that mapping it doesn't wait on the gpu
+    function read_feedback(t_vt * vt) -> void {
+        vt->requested.clear();
+        
+        if (vt->frame < 2) return;
+        
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, vt->feedback_pbos[vt->frame % 2]);
+        
+        let pixels = static_cast<u16 const *>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+        
+        if (pixels) {
+            for (int i = 0; i < t_vt::feedback_width * t_vt::feedback_height; i += 1) {
+                let pixel = pixels + i * 4;
+                if (!pixel[3] || pixel[2] >= vt->level_count) continue;
+                
+                vt->requested.push_back(page_key(pixel[2], pixel[0], pixel[1]));
+            }
+            
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        
+        std::sort(vt->requested.begin(), vt->requested.end());
+        vt->requested.erase(std::unique(vt->requested.begin(), vt->requested.end()), vt->requested.end());
+    }
+}
+
+function t_virtual_texture::update() -> void {
+    frame += 1;
+    
+    // finished reads go into the cache, if a slot can be freed for them. those
+    // that can't are dropped and will be asked for again
+    for (u64 i = 0; i < loading.size();) {
+        let load = loading[i];
+        
+        if (!load->done.load()) {
+            i += 1;
+            continue;
+        }
+        
+        if (load->ok) {
+            let slot = take_slot(this);
+            if (slot >= 0) place_page(this, slot, load->key, load->pixels);
+        }
+        
+        delete load;
+        loading[i] = loading.back();
+        loading.pop_back();
+    }
+    
+    read_feedback(this);
+    
+    // every page seen, and the ancestors standing in for it, is in use. whatever
+    // is missing along the way is wanted
+    std::vector<u64> wanted;
+    
+    for (let key : requested) {
+        let x = key_x(key);
+        let y = key_y(key);
+        
+        for (int level = key_level(key), shift = 0; level < level_count; level += 1, shift += 1) {
+            let ancestor = page_key(level, x >> shift, y >> shift);
+            let found = resident.find(ancestor);
+            
+            if (found != resident.end()) {
+                slots[found->second].last_used = frame;
+            } else {
+                wanted.push_back(ancestor);
+            }
+        }
+    }
+    
+    // coarse pages first: they cover more of the screen and unblock the finer ones
+    std::sort(wanted.begin(), wanted.end(), [] (u64 a, u64 b) { return a > b; });
+    wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+    
+    for (let key : wanted) {
+        if (loading.size() >= max_loads_in_flight) break;
+        
+        let in_flight = std::find_if(loading.begin(), loading.end(), [=] (t_page_load * load) { return load->key == key; });
+        if (in_flight != loading.end()) continue;
+        
+        let load = new t_page_load { .texture = this, .key = key, .done = false };
+        loading.push_back(load);
+        jobs::submit({ .proc = read_page, .data = load });
+    }
+    
+    if (tables_dirty) rebuild_tables(this);
+}
+
+function t_virtual_texture::begin_feedback(int width, int height) -> void {
+    viewport_width = width;
+    viewport_height = height;
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, feedback_fbo);
+    glViewport(0, 0, feedback_width, feedback_height);
+    
+    uint32 const zero[4] = {};
+    float const far = 1.f;
+    glClearBufferuiv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_DEPTH, 0, &far);
+}
+
+function t_virtual_texture::end_feedback() -> void {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pbos[frame % 2]);
+    glReadPixels(0, 0, feedback_width, feedback_height, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, viewport_width, viewport_height);
+}
+
+function t_virtual_texture::use(bool32 feedback) -> t_shader {
+    let program = feedback ? feedback_shader : shader;
+    glUseProgram(program);
+    
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, page_table);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, cache);
+    
+    // the feedback target is smaller than the screen, which the lod has to undo
+    let bias = feedback && viewport_width > 0 ? std::log2f((float) feedback_width / viewport_width) : 0.f;
+    
+    glUniform1i(glGetUniformLocation(program, "page_table"), 1);
+    glUniform2f(glGetUniformLocation(program, "vt_size"), (float) width, (float) height);
+    glUniform1i(glGetUniformLocation(program, "vt_levels"), level_count);
+    glUniform1f(glGetUniformLocation(program, "lod_bias"), bias);
+    
+    return program;
+}
+
+function t_virtual_texture::destroy() -> void {
+    // the workers must be joined first, they may still be reading a page
+    for (let load : loading) delete load;
+    loading.clear();
+    resident.clear();
+    
+    glDeleteTextures(1, &cache);
+    glDeleteTextures(1, &page_table);
+    glDeleteTextures(1, &feedback_target);
+    glDeleteRenderbuffers(1, &feedback_depth);
+    glDeleteFramebuffers(1, &feedback_fbo);
+    glDeleteBuffers(2, feedback_pbos);
+    glDeleteProgram(shader);
+    glDeleteProgram(feedback_shader);
+    
+    if (file) std::fclose(file);
+    file = null;
+}
+
+function create_virtual_texture(char const * path, t_virtual_texture __out * vt) -> bool32 {
+    let file = std::fopen(path, "rb");
+    if (!file) return false;
+    
+    t_file_header header;
+    
+    let ok = std::fread(&header, sizeof(header), 1, file) == 1;
+    ok = ok && std::memcmp(header.magic, file_magic, sizeof(file_magic)) == 0;
+    ok = ok && header.page_size == t_vt::page_size && header.page_border == t_vt::page_border;
+    ok = ok && header.level_count > 0 && header.level_count <= t_vt::max_levels;
+    ok = ok && header.width >= t_vt::page_payload && header.height >= t_vt::page_payload;
+    ok = ok && header.width <= (u64) t_vt::page_payload << 14 && header.height <= (u64) t_vt::page_payload << 14;
+    
+    if (!ok) {
+        std::fclose(file);
+        return false;
+    }
+    
+    vt->file = file;
+    vt->width = (int) header.width;
+    vt->height = (int) header.height;
+    vt->level_count = (int) header.level_count;
+    vt->frame = 0;
+    
+    u64 offset = sizeof(header);
+    
+    for (int level = 0; level < vt->level_count; level += 1) {
+        vt->pages_x[level] = m_clamp((vt->width / t_vt::page_payload) >> level, 1, vt->width);
+        vt->pages_y[level] = m_clamp((vt->height / t_vt::page_payload) >> level, 1, vt->height);
+        vt->level_offsets[level] = offset;
+        vt->tables[level].assign((u64) vt->pages_x[level] * vt->pages_y[level] * 4, 0);
+        
+        offset += (u64) vt->pages_x[level] * vt->pages_y[level] * page_bytes;
+    }
+    
+    // the coarsest level has to fit in the cache, it is what everything falls back to,
+    // and every page has to be in the file before any is read
+    let coarsest = vt->level_count - 1;
+    u64 size;
+    
+    ok = vt->pages_x[coarsest] * vt->pages_y[coarsest] < t_vt::cache_pages * t_vt::cache_pages;
+    ok = ok && file_size(file, &size) && size >= offset;
+    
+    if (!ok) {
+        std::fclose(file);
+        vt->file = null;
+        return false;
+    }
+    
+    glGenTextures(1, &vt->cache);
+    glBindTexture(GL_TEXTURE_2D, vt->cache);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGB8, cache_size, cache_size);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    
+    glGenTextures(1, &vt->page_table);
+    glBindTexture(GL_TEXTURE_2D, vt->page_table);
+    glTexStorage2D(GL_TEXTURE_2D, vt->level_count, GL_RGBA16UI, vt->pages_x[0], vt->pages_y[0]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    
+    glGenTextures(1, &vt->feedback_target);
+    glBindTexture(GL_TEXTURE_2D, vt->feedback_target);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16UI, t_vt::feedback_width, t_vt::feedback_height);
+    
+    glGenRenderbuffers(1, &vt->feedback_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, vt->feedback_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, t_vt::feedback_width, t_vt::feedback_height);
+    
+    glGenFramebuffers(1, &vt->feedback_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, vt->feedback_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, vt->feedback_target, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, vt->feedback_depth);
+    m_assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    
+    glGenBuffers(2, vt->feedback_pbos);
+    
+    for (int i = 0; i < 2; i += 1) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, vt->feedback_pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, t_vt::feedback_width * t_vt::feedback_height * 4 * sizeof(u16), null, GL_STREAM_READ);
+    }
+    
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    
+    // both compile at once
+    let shader = begin_vt_shader(vt_fragment);
+    let feedback_shader = begin_vt_shader(vt_feedback_fragment);
+    
+    vt->shader = finish_shader(&shader);
+    vt->feedback_shader = finish_shader(&feedback_shader);
+    
+    for (auto & slot : vt->slots) {
+        slot = { .page = free_slot, .last_used = 0, .locked = false };
+    }
+    
+    // the coarsest level is read up front and locked
+    t_vt::t_page_load load = { .texture = vt };
+    
+    for (int y = 0; y < vt->pages_y[coarsest]; y += 1) {
+        for (int x = 0; x < vt->pages_x[coarsest]; x += 1) {
+            load.key = page_key(coarsest, x, y);
+            read_page(&load);
+            
+            if (!load.ok) {
+                vt->destroy();
+                return false;
+            }
+            
+            let slot = take_slot(vt);
+            place_page(vt, slot, load.key, load.pixels);
+            vt->slots[slot].locked = true;
+        }
+    }
+    
+    rebuild_tables(vt);
+    
+    return true;
+}
+
+namespace {
+    // bilinear, wrapping at the edges. only used to stretch the source to a whole
+    // number of pages per side, so the stretch is always less than 2x
+    function resize_image(t_image __in * image, int width, int height) -> t_image {
+        let n = image->channels;
+        let pixels = static_cast<u8 *>(std::malloc((u64) width * height * n));
+        
+        for (int y = 0; y < height; y += 1) {
+            let fy = (y + 0.5f) * image->height / height - 0.5f;
+            let y0 = (int) std::floor(fy);
+            let ty = fy - y0;
+            let row0 = image->pixels + (u64) ((y0 % image->height + image->height) % image->height) * image->width * n;
+            let row1 = image->pixels + (u64) (((y0 + 1) % image->height + image->height) % image->height) * image->width * n;
+            
+            for (int x = 0; x < width; x += 1) {
+                let fx = (x + 0.5f) * image->width / width - 0.5f;
+                let x0 = (int) std::floor(fx);
+                let tx = fx - x0;
+                let c0 = (u64) ((x0 % image->width + image->width) % image->width) * n;
+                let c1 = (u64) (((x0 + 1) % image->width + image->width) % image->width) * n;
+                
+                for (int c = 0; c < n; c += 1) {
+                    let top = row0[c0 + c] + (row0[c1 + c] - row0[c0 + c]) * tx;
+                    let bottom = row1[c0 + c] + (row1[c1 + c] - row1[c0 + c]) * tx;
+                    pixels[((u64) y * width + x) * n + c] = (u8) (top + (bottom - top) * ty + 0.5f);
+                }
+            }
+        }
+        
+        return { .pixels = pixels, .width = width, .height = height, .channels = n };
+    }
+    
+    // one page with its border, wrapping around the level's edges
+    function extract_page(t_image __in * level, int page_x, int page_y, u8 * out) -> void {
+        for (int y = 0; y < t_vt::page_size; y += 1) {
+            let sy = ((page_y * t_vt::page_payload + y - t_vt::page_border) % level->height + level->height) % level->height;
+            
+            for (int x = 0; x < t_vt::page_size; x += 1) {
+                let sx = ((page_x * t_vt::page_payload + x - t_vt::page_border) % level->width + level->width) % level->width;
+                std::memcpy(out + ((u64) y * t_vt::page_size + x) * 3, level->pixels + ((u64) sy * level->width + sx) * 3, 3);
+            }
+        }
+    }
+}
+
+function build_virtual_texture(char const * image_path, char const * output) -> bool32 {
+    let image = load_image(image_path, 3);
+    if (!image.pixels) return false;
+    
+    // whole pages, a power of two of them per side, so that every level halves
+    // exactly and a page's parent is always at half its coordinates
+    let pages_x = next_power_of_two((image.width + t_vt::page_payload - 1) / t_vt::page_payload);
+    let pages_y = next_power_of_two((image.height + t_vt::page_payload - 1) / t_vt::page_payload);
+    
+    int level_count = 1;
+    while ((pages_x | pages_y) >> (level_count - 1) > 1) level_count += 1;
+    
+    if (level_count > t_vt::max_levels) {
+        free_image(&image);
+        return false;
+    }
+    
+    jobs::init();
+    
+    let resized = resize_image(&image, pages_x * t_vt::page_payload, pages_y * t_vt::page_payload);
+    let mips = generate_mips(&resized);
+    
+    let file = std::fopen(output, "wb");
+    bool32 ok = file != null;
+    
+    if (ok) {
+        t_file_header header = {
+            .width = (uint32) resized.width,
+            .height = (uint32) resized.height,
+            .level_count = (uint32) level_count,
+            .page_size = t_vt::page_size,
+            .page_border = t_vt::page_border,
+        };
+        
+        std::memcpy(header.magic, file_magic, sizeof(file_magic));
+        ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        
+        let page = static_cast<u8 *>(std::malloc(page_bytes));
+        
+        for (int level = 0; ok && level < level_count; level += 1) {
+            let level_pages_x = m_clamp(pages_x >> level, 1, pages_x);
+            let level_pages_y = m_clamp(pages_y >> level, 1, pages_y);
+            
+            for (int y = 0; ok && y < level_pages_y; y += 1) {
+                for (int x = 0; ok && x < level_pages_x; x += 1) {
+                    extract_page(&mips.levels[level], x, y, page);
+                    ok = std::fwrite(page, page_bytes, 1, file) == 1;
+                }
+            }
+        }
+        
+        std::free(page);
+        ok = std::fclose(file) == 0 && ok;
+    }
+    
+    free_mips(&mips);
+    std::free(resized.pixels);
+    free_image(&image);
+    jobs::terminate();
+    
+    return ok;
+}
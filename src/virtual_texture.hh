@@ -0,0 +1,79 @@
+#ifndef __learngl_virtual_texture__
+#define __learngl_virtual_texture__
+
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hh"
+#include "render.hh"
+
+// sparse virtual texturing, for images too big to keep resident. the image and its
+// mips are cut into pages on disk ('learngl vt-build'), only the pages the camera
+// actually sees are streamed into a fixed cache texture, and a page table per level
+// tells the shader which cache slot holds a page, or which coarser page stands in
+// for it. what the camera sees comes from a small feedback pass, read back late
+struct t_virtual_texture {
+    static constexpr int page_size = 128; // in the cache, border included
+    static constexpr int page_border = 4;
+    static constexpr int page_payload = page_size - 2 * page_border;
+    static constexpr int cache_pages = 16; // per side
+    static constexpr int max_levels = 16;
+    static constexpr int max_loads_in_flight = 16;
+    static constexpr int feedback_width = 160;
+    static constexpr int feedback_height = 120;
+    
+    struct t_slot {
+        u64 page; // see page_key in virtual_texture.cc, ~0 when free
+        u64 last_used;
+        bool32 locked; // the coarsest level never leaves
+    };
+    
+    struct t_page_load;
+    
+    function update() -> void; // once a frame, before the feedback pass
+    function begin_feedback(int viewport_width, int viewport_height) -> void;
+    function end_feedback() -> void;
+    function use(bool32 feedback) -> t_shader; // binds the program, page table and cache
+    function destroy() -> void;
+    
+    int width; // of level 0, a power of two multiple of page_payload
+    int height;
+    int level_count;
+    int pages_x[max_levels];
+    int pages_y[max_levels];
+    u64 level_offsets[max_levels]; // in the page file
+    
+    FILE * file;
+    std::mutex file_mutex;
+    
+    t_texture cache;
+    t_texture page_table;
+    t_shader shader;
+    t_shader feedback_shader;
+    
+    uint feedback_fbo;
+    uint feedback_target;
+    uint feedback_depth;
+    uint feedback_pbos[2];
+    int viewport_width;
+    int viewport_height;
+    u64 frame;
+    
+    t_slot slots[cache_pages * cache_pages];
+    std::unordered_map<u64, int> resident; // page key to slot
+    std::vector<t_page_load *> loading;
+    std::vector<u64> requested;
+    
+    std::vector<u16> tables[max_levels]; // per page: slot x, slot y, resident level, padding
+    bool32 tables_dirty;
+};
+
+// false if the page file is missing or malformed
+function create_virtual_texture(char const * path, t_virtual_texture __out * texture) -> bool32;
+
+// learngl vt-build <image> <output>
+function build_virtual_texture(char const * image_path, char const * output) -> bool32;
+
+#endif // __learngl_virtual_texture__